@@ -1,6 +1,6 @@
-
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <kbelf.h>
 
@@ -25,8 +25,9 @@ void kbelfx_free(void *mem) {
 
 // Memory allocator function to use for loading program segments.
 // Takes a segment with requested address and permissions and returns a segment with physical and virtual address
-// information. If `paddr` is zero the allocation has failed. User-defined.
+// information. Returns success status. User-defined.
 bool kbelfx_seg_alloc(kbelf_inst inst, size_t segs_len, kbelf_segment *segs) {
+    (void)inst;
     if (!segs_len)
         return false;
 
@@ -47,12 +48,13 @@ bool kbelfx_seg_alloc(kbelf_inst inst, size_t segs_len, kbelf_segment *segs) {
     if (!mem)
         return false;
 
-    // Compute segment addresses.
+    // Compute segment addresses; the program runs where it is loaded.
     for (size_t i = 0; i < segs_len; i++) {
         kbelf_laddr laddr    = (kbelf_laddr)mem + segs[i].vaddr_req - addr_min;
         segs[i].alloc_cookie = NULL;
         segs[i].laddr        = laddr;
-        segs[i].vaddr_real   = segs[i].vaddr_req;
+        segs[i].paddr        = laddr;
+        segs[i].vaddr_real   = laddr;
     }
     segs[0].alloc_cookie = mem;
 
@@ -63,6 +65,7 @@ bool kbelfx_seg_alloc(kbelf_inst inst, size_t segs_len, kbelf_segment *segs) {
 // Takes a previously allocated segment and unloads it.
 // User-defined.
 void kbelfx_seg_free(kbelf_inst inst, size_t segs_len, kbelf_segment *segs) {
+    (void)inst;
     if (!segs_len)
         return;
     free(segs[0].alloc_cookie);
@@ -81,24 +84,49 @@ void kbelfx_close(void *fd) {
     fclose((FILE *)fd);
 }
 
-// Reads a single byte from a file.
-// Returns byte on success, -1 on error.
+// Reads a number of bytes from a file.
+// Returns the number of bytes read, or less than that on error.
 // User-defined.
-int kbelfx_getc(void *fd) {
-    return fgetc((FILE *)fd);
+long kbelfx_read(void *fd, void *buf, long buf_len) {
+    return (long)fread(buf, 1, buf_len, (FILE *)fd);
 }
 
-// Reads a number of bytes from a file.
+// Reads a number of bytes from a file to a load address in the program.
 // Returns the number of bytes read, or less than that on error.
 // User-defined.
-int kbelfx_read(void *fd, void *buf, int buf_len) {
-    return fread(buf, 1, buf_len, (FILE *)fd);
+long kbelfx_load(kbelf_inst inst, void *fd, kbelf_laddr laddr, kbelf_laddr file_size, kbelf_laddr mem_size) {
+    (void)inst;
+    long len = (long)fread((void *)laddr, 1, file_size, (FILE *)fd);
+    memset((char *)laddr + file_size, 0, mem_size - file_size);
+    return len;
 }
 
 // Sets the absolute offset in the file.
-// Returns >=0 on success, -1 on error.
+// Returns 0 on success, -1 on error.
+// User-defined.
 int kbelfx_seek(void *fd, long pos) {
-    return fseek((FILE *)fd, pos, SEEK_SET);
+    return fseek((FILE *)fd, pos, SEEK_SET) ? -1 : 0;
+}
+
+
+// Read bytes from a load address in the program.
+bool kbelfx_copy_from_user(kbelf_inst inst, void *buf, kbelf_laddr laddr, size_t len) {
+    (void)inst;
+    memcpy(buf, (void const *)laddr, len);
+    return true;
+}
+
+// Write bytes to a load address in the program.
+bool kbelfx_copy_to_user(kbelf_inst inst, kbelf_laddr laddr, void *buf, size_t len) {
+    (void)inst;
+    memcpy((void *)laddr, buf, len);
+    return true;
+}
+
+// Get string length from a load address in the program.
+ptrdiff_t kbelfx_strlen_from_user(kbelf_inst inst, kbelf_laddr laddr) {
+    (void)inst;
+    return (ptrdiff_t)strlen((char const *)laddr);
 }
 
 
@@ -109,14 +137,38 @@ kbelf_file kbelfx_find_lib(char const *needed) {
     return kbelf_file_open(needed, NULL);
 }
 
-// Number of built-in libraries.
-// Optional user-defined.
-size_t                   kbelfx_builtin_libs_len = 1;
-// Array of built-in libraries.
-// Optional user-defined.
-kbelf_builtin_lib const *kbelfx_builtin_libs     = (kbelf_builtin_lib const[]
-){{.path        = "libstub0.elf",
-       .symbols_len = 1,
-       .symbols     = (kbelf_builtin_sym const[]){
-       {"pront", (kbelf_addr)&abi_pront, (kbelf_addr)&abi_pront},
-   }}};
+
+// Measure the length of `str`.
+size_t kbelfq_strlen(char const *str) {
+    return strlen(str);
+}
+
+// Copy string from `src` to `dst`.
+void kbelfq_strcpy(char *dst, char const *src) {
+    strcpy(dst, src);
+}
+
+// Find last occurrance of `c` in `str`.
+char const *kbelfq_strrchr(char const *str, char c) {
+    return strrchr(str, c);
+}
+
+// Compare string `a` to `b`.
+bool kbelfq_streq(char const *a, char const *b) {
+    return !strcmp(a, b);
+}
+
+// Copy memory from `src` to `dst`.
+void kbelfq_memcpy(void *dst, void const *src, size_t nmemb) {
+    memcpy(dst, src, nmemb);
+}
+
+// Fill memory `dst` with `c`.
+void kbelfq_memset(void *dst, uint8_t c, size_t nmemb) {
+    memset(dst, c, nmemb);
+}
+
+// Compare memory `a` to `b`.
+bool kbelfq_memeq(void const *a, void const *b, size_t nmemb) {
+    return !memcmp(a, b, nmemb);
+}
@@ -0,0 +1,91 @@
+// Reference `KBELF_TRACE` backend for Linux that writes Chrome trace-event JSON.
+// Open the result in chrome://tracing or https://ui.perfetto.dev to see where loading time goes.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <kbelf.h>
+
+// Names of the phases in the trace.
+static char const *const phase_names[KBELF_PHASE_COUNT] = {
+    [KBELF_PHASE_OPEN]        = "open",
+    [KBELF_PHASE_HEADER]      = "header",
+    [KBELF_PHASE_PROGHEADERS] = "program headers",
+    [KBELF_PHASE_SEG_ALLOC]   = "segment alloc",
+    [KBELF_PHASE_SEG_LOAD]    = "segment load",
+    [KBELF_PHASE_DYNAMIC]     = "dynamic table",
+    [KBELF_PHASE_DEPS]        = "dependencies",
+    [KBELF_PHASE_INIT_ORDER]  = "init order",
+    [KBELF_PHASE_SYMBOL]      = "symbol lookup",
+    [KBELF_PHASE_RELOC]       = "relocation",
+    [KBELF_PHASE_CACHE_SYNC]  = "cache sync",
+};
+
+// File the trace is written to, if any.
+static FILE *trace_fd;
+
+// Start writing the trace to a file.
+// Returns 0 on success, -1 on error.
+int kbelfx_trace_chrome_open(char const *path) {
+    trace_fd = fopen(path, "w");
+    if (!trace_fd)
+        return -1;
+    fputs("[\n", trace_fd);
+    return 0;
+}
+
+// Finish the trace and close the file.
+void kbelfx_trace_chrome_close() {
+    if (!trace_fd)
+        return;
+    fprintf(trace_fd, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"kbelf\"}}\n]\n", getpid());
+    fclose(trace_fd);
+    trace_fd = NULL;
+}
+
+// Get the current time in microseconds.
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Write a string as a JSON string literal.
+static void write_str(char const *str) {
+    fputc('"', trace_fd);
+    for (; str && *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', trace_fd);
+        if ((unsigned char)*str >= 0x20)
+            fputc(*str, trace_fd);
+    }
+    fputc('"', trace_fd);
+}
+
+// Write one trace event; the file is locked so events from parallel loading do not interleave.
+static void write_event(char ph, kbelf_phase phase, char const *name, size_t const *count) {
+    if (!trace_fd)
+        return;
+    double ts = now_us();
+    flockfile(trace_fd);
+    fprintf(trace_fd, "{\"name\":\"%s\",\"cat\":\"kbelf\",\"ph\":\"%c\",\"ts\":%.3f,", phase_names[phase], ph, ts);
+    fprintf(trace_fd, "\"pid\":%d,\"tid\":%ld,\"args\":{\"object\":", getpid(), (long)syscall(SYS_gettid));
+    write_str(name);
+    if (count)
+        fprintf(trace_fd, ",\"count\":%zu", *count);
+    fputs("}},\n", trace_fd);
+    funlockfile(trace_fd);
+}
+
+// Start of a phase of loading.
+void kbelfx_trace_begin(kbelf_phase phase, char const *name) {
+    write_event('B', phase, name, NULL);
+}
+
+// End of a phase of loading.
+void kbelfx_trace_end(kbelf_phase phase, char const *name, size_t count) {
+    write_event('E', phase, name, &count);
+}
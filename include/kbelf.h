@@ -35,13 +35,13 @@ extern "C" {
 /* ==== User-defined ==== */
 
 // Memory allocator function to use for allocating metadata.
-// User-defined.
+// User-defined; not used if `KBELF_STATIC_ALLOC` is enabled.
 extern void *kbelfx_malloc(size_t len);
 // Memory allocator function to use for allocating metadata.
-// User-defined.
+// User-defined; not used if `KBELF_STATIC_ALLOC` is enabled.
 extern void *kbelfx_realloc(void *mem, size_t len);
 // Memory allocator function to use for allocating metadata.
-// User-defined.
+// User-defined; not used if `KBELF_STATIC_ALLOC` is enabled.
 extern void  kbelfx_free(void *mem);
 
 // Memory allocator function to use for loading program segments.
@@ -78,6 +78,43 @@ extern int   kbelfx_seek(void *fd, long pos);
 // and invalidate the instruction cache for the given address range.
 // Default implementation is a no-op. Override in platform port if needed.
 extern void kbelfx_cache_sync(kbelf_laddr addr, size_t size);
+// Synchronize caches for a number of loaded ranges at once.
+// The ranges are sorted by address and neither overlap nor touch. Only segments with execute permission are passed
+// unless `KBELF_CACHE_SYNC_DATA` is enabled; segments shared through a `kbelf_libcache` were synchronized when they
+// were first loaded. Optional user-defined; the default implementation calls `kbelfx_cache_sync` for each range.
+extern void kbelfx_cache_sync_ranges(kbelf_range const *ranges, size_t ranges_len);
+
+// Read a pre-relocated process image from a persistent cache.
+// Returns the number of bytes read, or less than `len` if no image of exactly that length is stored under `key`.
+// Optional user-defined; the default implementation caches nothing.
+extern long kbelfx_imgcache_load(uint64_t key, void *buf, long len);
+// Write a pre-relocated process image to a persistent cache, replacing any image stored under `key`.
+// Optional user-defined; the default implementation discards the image.
+extern void kbelfx_imgcache_store(uint64_t key, void const *buf, long len);
+
+// Release the memory of a range of a loaded segment that is no longer used, see `kbelf_dyn_reclaim`.
+// The range is page-aligned and lies within one segment that is not shared; it stays allocated as far as KBELF is
+// concerned and is passed to `kbelfx_seg_free` with the rest of the segment later.
+// Optional user-defined; the default implementation keeps the memory.
+extern void kbelfx_seg_discard(kbelf_inst inst, kbelf_range range);
+
+// Start running `func(arg)` on another thread or task for `kbelf_dyn_set_parallel`.
+// Returns a handle for `kbelfx_job_join`, or NULL to make the caller run it instead.
+// Optional user-defined; the default implementation returns NULL.
+extern void *kbelfx_job_submit(void (*func)(void *arg), void *arg);
+// Wait for a job started by `kbelfx_job_submit` to finish.
+// Optional user-defined; the default implementation does nothing.
+extern void  kbelfx_job_join(void *job);
+
+#if KBELF_TRACE
+// Start of a phase of loading; `name` is the file, library or symbol it concerns, if any.
+// Phases may be nested, and phases of different libraries may run on different threads with
+// `kbelf_dyn_set_parallel`. User-defined if `KBELF_TRACE` is enabled.
+extern void kbelfx_trace_begin(kbelf_phase phase, char const *name);
+// End of a phase of loading; `count` is the amount of work done, see `kbelf_phase`, or 0 if the phase failed.
+// Every phase is ended. User-defined if `KBELF_TRACE` is enabled.
+extern void kbelfx_trace_end(kbelf_phase phase, char const *name, size_t count);
+#endif
 
 // Read bytes from a load address in the program.
 extern bool      kbelfx_copy_from_user(kbelf_inst inst, void *buf, kbelf_laddr laddr, size_t len);
@@ -95,11 +132,29 @@ extern kbelf_file kbelfx_find_lib(char const *needed);
 // Optional user-defined.
 extern size_t                   kbelfx_builtin_libs_len;
 // Array of built-in libraries.
+// Indexed by file name by each context when it first looks up a library; must not change while a context is loading.
 // Optional user-defined.
 extern kbelf_builtin_lib const *kbelfx_builtin_libs[];
 
 
 
+#if KBELF_STATIC_ALLOC
+/* ==== Static allocation ==== */
+
+// Set the memory that all metadata is allocated from instead of `kbelfx_malloc`.
+// Must be called before anything else; discards everything allocated from a previous workspace.
+void   kbelf_workspace_set(void *mem, size_t size);
+// Get the amount of the workspace in use, for `kbelf_workspace_release`.
+size_t kbelf_workspace_mark();
+// Release everything allocated from the workspace after `kbelf_workspace_mark` returned `mark`.
+// Contexts and instances created after the mark must not be used anymore; KBELF keeps no metadata outside of them.
+void   kbelf_workspace_release(size_t mark);
+// Get the highest amount of the workspace that has been in use since `kbelf_workspace_set`.
+size_t kbelf_workspace_peak();
+#endif
+
+
+
 /* ==== ELF file interpretation ==== */
 
 // Create a context for interpreting an ELF file.
@@ -108,9 +163,12 @@ extern kbelf_builtin_lib const *kbelfx_builtin_libs[];
 // KBELF calls `kbelfx_close` on `fd` when `kbelf_file_close` is called on an `kbelf_file` or when `kbelf_file_open`
 // fails. Returns non-null on success, NULL on error.
 kbelf_file kbelf_file_open(char const *path, void *fd);
+// Take another reference to a `kbelf_file` context.
+// Each reference is dropped with `kbelf_file_close`.
+kbelf_file kbelf_file_ref(kbelf_file file);
 // Get the file descriptor in use by the `kbelf_file`.
 void      *kbelf_file_getfd(kbelf_file file) __attribute__((pure));
-// Clean up a `kbelf_file` context.
+// Drop a reference to a `kbelf_file` context and clean it up when it was the last one.
 // Calls `kbelfx_close` on the `fd` originally provided to `kbelf_file_open`.
 void       kbelf_file_close(kbelf_file file);
 
@@ -125,12 +183,71 @@ bool                kbelf_file_prog_get(kbelf_file file, kbelf_progheader *prog,
 
 
 
+/* ==== ELF file cache ==== */
+
+// Create an empty cache of opened and validated ELF files.
+// The cache is not thread-safe and its files share their `fd`; use of the cache must be serialized.
+// Returns non-null on success, NULL on error.
+kbelf_filecache kbelf_filecache_create();
+// Clean up a `kbelf_filecache` context.
+// Files still referenced elsewhere stay open until they are closed.
+void            kbelf_filecache_destroy(kbelf_filecache cache);
+// Get a reference to the cached ELF file for `path`, opening it with `kbelf_file_open` if it is not cached.
+// The `generation` number (for example a modification time) is compared to the cached file's; if it differs, the
+// cached file is replaced. Typically called from `kbelfx_find_lib`; close the result with `kbelf_file_close`.
+// Returns non-null on success, NULL on error.
+kbelf_file      kbelf_filecache_open(kbelf_filecache cache, char const *path, uint64_t generation);
+// Remove the file for `path` from the cache, or all files if `path` is NULL.
+void            kbelf_filecache_invalidate(kbelf_filecache cache, char const *path);
+
+
+
 /* ==== Loading ==== */
 
 // Load all loadable segments from an ELF file.
 // The `pid` number is passed to `kbelfx_seg_alloc` and is otherwise ignored.
 // Returns non-null on success, NULL on error.
 kbelf_inst    kbelf_inst_load(kbelf_file file, int pid);
+// Load all loadable segments from an ELF file, mapping the segments shared through a `kbelf_libcache` instead of
+// loading another copy. The `pid` number is passed to `kbelfx_seg_alloc` and is otherwise ignored.
+// Returns non-null on success, NULL on error.
+kbelf_inst    kbelf_inst_load_cached(kbelf_file file, int pid, kbelf_libcache cache);
+// Allocate all loadable segments from an ELF file but only load the pages needed for dynamic linking.
+// The other pages are loaded and relocated on demand by `kbelf_inst_fault`.
+// The `pid` number is passed to `kbelfx_seg_alloc` and is otherwise ignored.
+// Returns non-null on success, NULL on error.
+kbelf_inst    kbelf_inst_load_lazy(kbelf_file file, int pid);
+// Load and relocate the page containing a virtual address in a loaded instance.
+// Typically called from the page fault handler; the `kbelf_file` must not have been closed yet.
+// Returns true if the page is present afterwards, false if the address is not in this instance or on error.
+bool          kbelf_inst_fault(kbelf_inst inst, kbelf_addr vaddr);
+// Load and relocate all pages overlapping a range of virtual addresses in a loaded instance.
+// Returns success status.
+bool          kbelf_inst_fault_range(kbelf_inst inst, kbelf_addr vaddr, kbelf_addr len);
+// Copy a relocated instance into a new process.
+// The copy is relocated again if any of its segments is at a different virtual address, which requires the
+// relocations to have been kept with `kbelf_reloc_set_keep_fixups`. Lazily loaded and reclaimed instances cannot be
+// copied.
+// The `pid` number is passed to `kbelfx_seg_alloc` and is otherwise ignored.
+// Returns non-null on success, NULL on error.
+kbelf_inst    kbelf_inst_clone(kbelf_inst inst, int pid);
+// Move the segments of a relocated instance to new addresses and fix up the words that depend on them.
+// `new_segments` has the same layout as the instance's segments with `laddr`, `paddr` and `vaddr_real` set to the
+// already allocated destination; shared segments cannot move. The destinations may overlap the old memory in any order
+// but not each other. The old memory is not freed. Requires the relocations to have been kept with
+// `kbelf_reloc_set_keep_fixups`; other instances that use its symbols must be fixed up with `kbelf_dyn_rebase`
+// instead. Reclaimed instances cannot be moved. Returns success status.
+bool          kbelf_inst_rebase(kbelf_inst inst, kbelf_segment const *new_segments);
+// Get the page-aligned ranges of a relocated instance that only hold relocation tables and, unless `keep_symbols`
+// is set, the dynamic symbol, string and hash tables. Writes at most `cap` ranges to `ranges`; there are never more
+// than `KBELF_RECLAIM_MAX`. Lazily loaded and already reclaimed instances have none. Returns the number of ranges.
+size_t        kbelf_inst_reclaimable(kbelf_inst inst, bool keep_symbols, kbelf_range *ranges, size_t cap);
+// Pass the ranges from `kbelf_inst_reclaimable` to `kbelfx_seg_discard`.
+// Symbol lookups in this instance are no longer possible unless `keep_symbols` is set, and the instance can no longer
+// be cloned or rebased. Reclaiming an instance again does nothing. Returns the number of bytes discarded.
+kbelf_addr    kbelf_inst_reclaim(kbelf_inst inst, bool keep_symbols);
+// Check whether the page containing a virtual address in a loaded instance is present.
+bool          kbelf_inst_is_present(kbelf_inst inst, kbelf_addr vaddr) __attribute__((pure));
 // Get a pointer to the file from which this was created.
 kbelf_file    kbelf_inst_getfile(kbelf_inst inst) __attribute__((pure));
 // Unloads an instance created with `kbelf_load` and clean up the handle.
@@ -191,6 +308,9 @@ kbelf_segment kbelf_inst_segment_get(kbelf_inst inst, size_t index) __attribute_
 kbelf_reloc kbelf_reloc_create();
 // Clean up a `kbelf_reloc` context.
 void        kbelf_reloc_destroy(kbelf_reloc reloc);
+// Set whether to keep the applied relocations in the instances so they can be applied again.
+// Required to clone instances into a process where they are at a different virtual address.
+void        kbelf_reloc_set_keep_fixups(kbelf_reloc reloc, bool keep);
 // Perform the relocation.
 // Returns success status.
 bool        kbelf_reloc_perform(kbelf_reloc reloc);
@@ -203,6 +323,28 @@ bool        kbelf_reloc_add_builtin(kbelf_reloc reloc, kbelf_builtin_lib const *
 
 
 
+/* ==== Library cache ==== */
+
+// Create an empty cache of library segments shared between processes.
+// The cache is not thread-safe; loading and unloading processes that use it must be serialized. Sharing requires
+// address translation: a shared segment keeps the load address of the first process, so `kbelfx_seg_alloc` must map
+// it at a virtual address with the same offset from the requested address as the other segments. If it does not, as
+// without an MMU where the virtual address equals the load address, a private copy of the library is loaded instead.
+// Returns non-null on success, NULL on error.
+kbelf_libcache kbelf_libcache_create();
+// Clean up a `kbelf_libcache` context.
+// Shared segments stay loaded until the last process using them is unloaded.
+void           kbelf_libcache_destroy(kbelf_libcache cache);
+// Stop sharing the segments of `path` with future loads, for example after the file has changed, or of all files if
+// `path` is NULL. Processes already using them keep them until they are unloaded.
+void           kbelf_libcache_invalidate(kbelf_libcache cache, char const *path);
+// Share the read-only segments of a relocated instance that contain no relocations with future loads of the same
+// file. Marks those segments as `shared`; they are released when the last instance using them is unloaded.
+// Returns success status.
+bool           kbelf_libcache_add(kbelf_libcache cache, kbelf_inst inst);
+
+
+
 /* ==== Executable loading ==== */
 
 // Create a dynamic executable loading context.
@@ -215,11 +357,83 @@ void       kbelf_dyn_destroy(kbelf_dyn dyn);
 // Set the executable file.
 // Returns success status.
 bool       kbelf_dyn_set_exec(kbelf_dyn dyn, char const *path, void *fd);
+// Set the executable file from an already opened `kbelf_file`.
+// Takes over the reference to `file`, even on failure. Returns success status.
+bool       kbelf_dyn_set_exec_file(kbelf_dyn dyn, kbelf_file file);
+// Enable or disable demand-paged loading of the process image.
+// Must be called before `kbelf_dyn_load`; pages are then loaded by `kbelf_dyn_fault`, so the context must not be
+// destroyed while the process is running. Returns success status.
+bool       kbelf_dyn_set_lazy(kbelf_dyn dyn, bool lazy);
+// Set the cache used to share read-only library segments with other processes.
+// Must be called before `kbelf_dyn_load`; the process must be unloaded with `kbelf_dyn_unload` to release its
+// references to the shared segments. Not used for lazily loaded process images. Returns success status.
+bool       kbelf_dyn_set_libcache(kbelf_dyn dyn, kbelf_libcache cache);
+// Set whether to keep the applied relocations so the process image can be cloned into a process where it is at a
+// different virtual address. Must be called before `kbelf_dyn_load`. Returns success status.
+bool       kbelf_dyn_set_keep_fixups(kbelf_dyn dyn, bool keep);
+// Enable or disable restoring the relocated process image from `kbelfx_imgcache_load`.
+// The image is stored with `kbelfx_imgcache_store` after relocation and found again by a digest of the loaded
+// segments, their addresses and the built-in library symbols. Not used for lazily loaded process images or with
+// `kbelf_dyn_set_keep_fixups`. Must be called before `kbelf_dyn_load`. Returns success status.
+bool       kbelf_dyn_set_imgcache(kbelf_dyn dyn, bool enable);
+// Enable or disable opening and loading the libraries of each dependency level concurrently with
+// `kbelfx_job_submit`. The jobs call `kbelfx_find_lib` and the loading hooks from several threads at once, so these
+// must be thread-safe. Libraries shared through a `kbelf_libcache` are opened concurrently but loaded by the calling
+// thread. The load and initialisation order are the same as without. Not available if `KBELF_STATIC_ALLOC` is
+// enabled. Must be called before `kbelf_dyn_load`. Returns success status.
+bool       kbelf_dyn_set_parallel(kbelf_dyn dyn, bool parallel);
+// Set whether `kbelf_dyn_reclaim` keeps the dynamic symbol, string and hash tables for symbol lookups.
+// Returns success status.
+bool       kbelf_dyn_set_keep_symbols(kbelf_dyn dyn, bool keep);
 // Interpret the files and create a process image.
 // Returns success status.
 bool       kbelf_dyn_load(kbelf_dyn dyn);
+// Copy a loaded process image into a new process without reading the files again.
+// The copy holds its own references to the files and is relocated again if any of its segments is at a different
+// virtual address, which requires `kbelf_dyn_set_keep_fixups`. Lazily loaded process images and those passed to
+// `kbelf_dyn_reclaim` cannot be copied.
+// Returns non-null on success, NULL on error.
+kbelf_dyn  kbelf_dyn_clone(kbelf_dyn dyn, int pid);
+// Move the segments of one instance in a loaded process image to new addresses, see `kbelf_inst_rebase`.
+// Also fixes up the words in the other instances that refer to its symbols. Requires `kbelf_dyn_set_keep_fixups`.
+// Process images passed to `kbelf_dyn_reclaim` cannot be rebased. Returns success status.
+bool       kbelf_dyn_rebase(kbelf_dyn dyn, kbelf_inst inst, kbelf_segment const *new_segments);
+// Release the files and loading metadata of a loaded process image and keep the instances, their segments and the
+// initialisation and finalisation functions in a single allocation. Afterwards, the process image can only be queried,
+// unloaded and destroyed; it cannot be cloned or rebased and `kbelf_inst_getfile` returns NULL. Lazily loaded process
+// images cannot be finalized. Returns success status.
+bool       kbelf_dyn_finalize(kbelf_dyn dyn);
+// Pass the memory of a loaded process image that only holds relocation tables and, unless
+// `kbelf_dyn_set_keep_symbols` is set, symbol tables to `kbelfx_seg_discard`, see `kbelf_inst_reclaim`.
+// Segments shared through a `kbelf_libcache` are kept. Lazily loaded process images are not reclaimed.
+// Returns the number of bytes discarded.
+kbelf_addr kbelf_dyn_reclaim(kbelf_dyn dyn);
+// Load and relocate the page containing a virtual address in a lazily loaded process image.
+// Returns true if the page is present afterwards, false if the address is not in the process image or on error.
+bool       kbelf_dyn_fault(kbelf_dyn dyn, kbelf_addr vaddr);
 // Unloads the process image if it was successfully created.
+// Afterwards, the process has no entrypoint and no (pre-)initialisation or finalisation functions.
 void       kbelf_dyn_unload(kbelf_dyn dyn);
+// Copy the statistics counted while the process image was set up, loaded, cloned, rebased, faulted in, finalized
+// and reclaimed. Jobs started by `kbelf_dyn_set_parallel` count separately and are added when they are joined.
+// Returns false if `KBELF_STATS` is disabled, in which case `stats` is cleared.
+bool       kbelf_dyn_get_stats(kbelf_dyn dyn, kbelf_stats *stats);
+// Pass a record of every loaded segment and function of the process image to `writer`, so profilers can symbolise
+// its addresses. Functions are taken from the symbol table in the section headers if the file has one and from the
+// dynamic symbol table otherwise. Finalized process images no longer have their files, so their segments are
+// exported without file names and only the dynamic symbols, which `kbelf_dyn_reclaim` discards unless
+// `kbelf_dyn_set_keep_symbols` is set, are exported.
+// Returns false on error or if `writer` stopped the export.
+bool       kbelf_dyn_export_map(kbelf_dyn dyn, kbelf_map_writer writer, void *ctx);
+// Build the index used by `kbelf_dyn_addr2sym` from the same functions as `kbelf_dyn_export_map` if it has not been
+// built yet. Building reads the files and allocates memory; call it again after `kbelf_dyn_rebase`, which drops the
+// index. Returns success status.
+bool       kbelf_dyn_index_symbols(kbelf_dyn dyn);
+// Find the function containing virtual address `vaddr` in O(log n) time. Never allocates memory or reads files, so it
+// may be called from interrupt context. On success, `name` is set to the function name, which stays valid until the
+// process image is unloaded, rebased or destroyed, and `offset` to the offset of `vaddr` in the function.
+// Returns false if no function of known size contains `vaddr` or `kbelf_dyn_index_symbols` has not built the index.
+bool       kbelf_dyn_addr2sym(kbelf_dyn dyn, kbelf_addr vaddr, char const **name, kbelf_addr *offset);
 // Get the virtual entrypoint address of the process.
 kbelf_addr kbelf_dyn_entrypoint(kbelf_dyn dyn) __attribute__((pure));
 // Get the number of pre-initialisation functions for the process.
@@ -227,16 +441,25 @@ size_t     kbelf_dyn_preinit_len(kbelf_dyn dyn) __attribute__((pure));
 // Get the virtual address of an initialisation function by index.
 // Functions are sorted; the first index is the first in the running order.
 kbelf_addr kbelf_dyn_preinit_get(kbelf_dyn dyn, size_t index) __attribute__((pure));
-// Get the number of pre-initialisation functions for the process.
+// Copy the virtual addresses of up to `cap` pre-initialisation functions in running order.
+// Returns the number of addresses copied.
+size_t     kbelf_dyn_preinit_copy(kbelf_dyn dyn, kbelf_addr *out, size_t cap);
+// Get the number of initialisation functions for the process.
 size_t     kbelf_dyn_init_len(kbelf_dyn dyn) __attribute__((pure));
 // Get the virtual address of an initialisation function by index.
 // Functions are sorted; the first index is the first in the running order.
 kbelf_addr kbelf_dyn_init_get(kbelf_dyn dyn, size_t index) __attribute__((pure));
+// Copy the virtual addresses of up to `cap` initialisation functions in running order.
+// Returns the number of addresses copied.
+size_t     kbelf_dyn_init_copy(kbelf_dyn dyn, kbelf_addr *out, size_t cap);
 // Get the number of finalisation functions for the process.
 size_t     kbelf_dyn_fini_len(kbelf_dyn dyn) __attribute__((pure));
 // Get the virtual address of an finalisation function by index.
 // Functions are sorted; the first index is the first in the running order.
 kbelf_addr kbelf_dyn_fini_get(kbelf_dyn dyn, size_t index) __attribute__((pure));
+// Copy the virtual addresses of up to `cap` finalisation functions in running order.
+// Returns the number of addresses copied.
+size_t     kbelf_dyn_fini_copy(kbelf_dyn dyn, kbelf_addr *out, size_t cap);
 
 
 
@@ -30,3 +30,58 @@
 
 #include <kbelf/machine.h>
 #include <kbelf/string.h>
+
+
+
+// Page size used for demand-paged loading.
+#ifndef KBELF_PAGE_SIZE
+#define KBELF_PAGE_SIZE 4096
+#endif
+
+// Synchronize caches for loaded segments without execute permission too.
+#ifndef KBELF_CACHE_SYNC_DATA
+#define KBELF_CACHE_SYNC_DATA 0
+#endif
+
+// Report the phases of loading to `kbelfx_trace_begin` and `kbelfx_trace_end`.
+#ifndef KBELF_TRACE
+#define KBELF_TRACE 0
+#endif
+
+// Count I/O, allocations, relocations and lookups per process image for `kbelf_dyn_get_stats`.
+#ifndef KBELF_STATS
+#define KBELF_STATS 0
+#endif
+
+// Number of relocation types counted separately by `kbelf_dyn_get_stats`; higher types share the last counter.
+#ifndef KBELF_STATS_RELOC_TYPES
+#define KBELF_STATS_RELOC_TYPES 64
+#endif
+
+// Storage class of per-thread variables; define it empty if loading never happens on more than one thread.
+#ifndef KBELF_THREAD_LOCAL
+#define KBELF_THREAD_LOCAL _Thread_local
+#endif
+
+// Allocate all metadata from a fixed-size workspace given to `kbelf_workspace_set` instead of `kbelfx_malloc`.
+#ifndef KBELF_STATIC_ALLOC
+#define KBELF_STATIC_ALLOC 0
+#endif
+
+// Maximum number of libraries in one process image, or 0 for no limit.
+#ifndef KBELF_MAX_LIBS
+#if KBELF_STATIC_ALLOC
+#define KBELF_MAX_LIBS 16
+#else
+#define KBELF_MAX_LIBS 0
+#endif
+#endif
+
+// Maximum number of loadable segments in one ELF file, or 0 for no limit.
+#ifndef KBELF_MAX_SEGMENTS
+#if KBELF_STATIC_ALLOC
+#define KBELF_MAX_SEGMENTS 8
+#else
+#define KBELF_MAX_SEGMENTS 0
+#endif
+#endif
@@ -160,6 +160,11 @@ typedef enum {
     DT_ENCODING        = 0x1f,
     DT_PREINIT_ARRAY   = 0x20,
     DT_PREINIT_ARRAYSZ = 0x21,
+    DT_RELRSZ          = 0x23,
+    DT_RELR            = 0x24,
+    DT_RELRENT         = 0x25,
+    DT_GNU_HASH        = 0x6ffffef5,
+    DT_FLAGS_1         = 0x6ffffffb,
 } kbelf_dt;
 
 
@@ -314,12 +319,21 @@ typedef struct {
     kbelf_addrdiff addend;
 } kbelf_relaentry;
 
+#if KBELF_IS_ELF64
+// Get the `symbol` value from a relocation entry's `info` field.
+#define KBELF_R_SYM(x)          ((x) >> 32)
+// Get the `type` value from a relocation entry's `info` field.
+#define KBELF_R_TYPE(x)         ((x) & 0xffffffff)
+// Conbine the `symbol` and `type` values into a relocation entry's `info` field.
+#define KBELF_R_INFO(sym, type) (((kbelf_addr)(sym) << 32) | ((type) & 0xffffffff))
+#else
 // Get the `symbol` value from a relocation entry's `info` field.
 #define KBELF_R_SYM(x)          ((x) >> 8)
 // Get the `type` value from a relocation entry's `info` field.
 #define KBELF_R_TYPE(x)         ((x) & 255)
 // Conbine the `symbol` and `type` values into a relocation entry's `info` field.
 #define KBELF_R_INFO(sym, type) (((sym) << 8) | ((type) & 255))
+#endif
 
 
 
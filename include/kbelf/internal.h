@@ -0,0 +1,232 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <kbelf/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* ==== Memory ==== */
+
+#if KBELF_STATIC_ALLOC || KBELF_STATS
+// Allocate metadata memory from the workspace or with `kbelfx_malloc`.
+void *kbelfi_malloc(size_t len);
+// Resize metadata memory allocated by `kbelfi_malloc`.
+void *kbelfi_realloc(void *mem, size_t len);
+// Free metadata memory allocated by `kbelfi_malloc`.
+void  kbelfi_free(void *mem);
+#else
+#define kbelfi_malloc  kbelfx_malloc
+#define kbelfi_realloc kbelfx_realloc
+#define kbelfi_free    kbelfx_free
+#endif
+
+// Allocate memory from an arena; it is freed by `kbelfi_arena_free`.
+// Returns non-null on success, NULL on error.
+void *kbelfi_arena_alloc(kbelf_arena *arena, size_t size);
+// Copy a string into an arena.
+// Returns non-null on success, NULL on error.
+char *kbelfi_arena_strdup(kbelf_arena *arena, char const *str);
+// Make room for at least one more element in an array allocated from an arena, doubling its capacity if full.
+// `array` points to the array pointer. Returns success status.
+bool  kbelfi_arena_grow(kbelf_arena *arena, void *array, size_t *cap, size_t len, size_t ent_size);
+// Free all memory allocated from an arena.
+void  kbelfi_arena_free(kbelf_arena *arena);
+
+
+
+/* ==== Library cache ==== */
+
+// Find the cache entry for a file path.
+kbelf_libent *kbelfi_libcache_find(kbelf_libcache cache, char const *path);
+// Drop an instance's reference to its shared library segments.
+// Releases the segments with `kbelfx_seg_free` when the last reference is dropped.
+void kbelfi_libcache_release(kbelf_inst inst);
+
+
+
+/* ==== Loading ==== */
+
+// Copy the segments of a relocated instance into a new process without applying the kept relocations.
+// Returns non-null on success, NULL on error.
+kbelf_inst kbelfi_inst_clone(kbelf_inst inst, int pid);
+// Check whether any segment of a copy of an instance is at a different virtual address.
+bool       kbelfi_inst_moved(kbelf_inst inst, kbelf_inst clone);
+// Apply all kept relocations of an instance again.
+// Returns success status.
+bool       kbelfi_inst_reapply(kbelf_inst inst);
+// Apply the kept relocations of an instance that refer to symbols defined by another instance again.
+// Returns success status.
+bool       kbelfi_inst_reapply_from(kbelf_inst inst, kbelf_inst def);
+// Move the segments of a relocated instance to new addresses without relocating it from scratch.
+// Returns success status.
+bool       kbelfi_inst_move(kbelf_inst inst, kbelf_segment const *new_segments);
+// Synchronize caches for an instance and `more_len` other instances in one `kbelfx_cache_sync_ranges` call.
+void       kbelfi_cache_sync_insts(kbelf_inst inst, size_t more_len, kbelf_inst const *more);
+
+
+
+/* ==== Tracing ==== */
+
+#if KBELF_TRACE
+// Report the start of a phase of loading to `kbelfx_trace_begin`.
+#define KBELF_TRACE_BEGIN(phase, name)                                                                                 \
+    { kbelfx_trace_begin(phase, name); }
+// Report the end of a phase of loading to `kbelfx_trace_end`.
+#define KBELF_TRACE_END(phase, name, count)                                                                            \
+    { kbelfx_trace_end(phase, name, count); }
+#else
+#define KBELF_TRACE_BEGIN(phase, name)                                                                                 \
+    { (void)(name); }
+#define KBELF_TRACE_END(phase, name, count)                                                                            \
+    {                                                                                                                  \
+        (void)(name);                                                                                                  \
+        (void)(count);                                                                                                 \
+    }
+#endif
+
+
+
+/* ==== Statistics ==== */
+
+#if KBELF_STATS
+// Statistics that the work done by this thread is counted in, if any.
+extern KBELF_THREAD_LOCAL kbelf_stats *kbelfi_stats;
+
+// Add to a counter of the statistics that the work done by this thread is counted in.
+#define KBELF_STAT(field, n)                                                                                           \
+    {                                                                                                                  \
+        if (kbelfi_stats)                                                                                              \
+            kbelfi_stats->field += (n);                                                                                \
+    }
+
+// Count the work done by this thread in other statistics.
+// Returns the statistics it was counted in before.
+static inline kbelf_stats *kbelfi_stats_swap(kbelf_stats *stats) {
+    kbelf_stats *prev = kbelfi_stats;
+    kbelfi_stats      = stats;
+    return prev;
+}
+
+// Counting wrapper for `kbelfx_read`.
+static inline long kbelfi_read(void *fd, void *buf, long buf_len) {
+    long res = kbelfx_read(fd, buf, buf_len);
+    KBELF_STAT(read_calls, 1)
+    KBELF_STAT(read_bytes, res > 0 ? (size_t)res : 0)
+    return res;
+}
+
+// Counting wrapper for `kbelfx_load`.
+static inline long kbelfi_load(
+    kbelf_inst inst, void *fd, kbelf_laddr laddr, kbelf_laddr file_size, kbelf_laddr mem_size
+) {
+    long res = kbelfx_load(inst, fd, laddr, file_size, mem_size);
+    KBELF_STAT(read_calls, 1)
+    KBELF_STAT(read_bytes, res > 0 ? (size_t)res : 0)
+    return res;
+}
+
+// Counting wrapper for `kbelfx_seek`.
+static inline int kbelfi_seek(void *fd, long pos) {
+    KBELF_STAT(seek_calls, 1)
+    return kbelfx_seek(fd, pos);
+}
+
+// Counting wrapper for `kbelfx_copy_from_user`.
+static inline bool kbelfi_copy_from_user(kbelf_inst inst, void *buf, kbelf_laddr laddr, size_t len) {
+    KBELF_STAT(copy_from_calls, 1)
+    KBELF_STAT(copy_from_bytes, len)
+    return kbelfx_copy_from_user(inst, buf, laddr, len);
+}
+
+// Counting wrapper for `kbelfx_copy_to_user`.
+static inline bool kbelfi_copy_to_user(kbelf_inst inst, kbelf_laddr laddr, void *buf, size_t len) {
+    KBELF_STAT(copy_to_calls, 1)
+    KBELF_STAT(copy_to_bytes, len)
+    return kbelfx_copy_to_user(inst, laddr, buf, len);
+}
+#else
+#define KBELF_STAT(field, n)                                                                                           \
+    { (void)(n); }
+
+// Count the work done by this thread in other statistics.
+// Returns the statistics it was counted in before.
+static inline kbelf_stats *kbelfi_stats_swap(kbelf_stats *stats) {
+    (void)stats;
+    return NULL;
+}
+
+#define kbelfi_read           kbelfx_read
+#define kbelfi_load           kbelfx_load
+#define kbelfi_seek           kbelfx_seek
+#define kbelfi_copy_from_user kbelfx_copy_from_user
+#define kbelfi_copy_to_user   kbelfx_copy_to_user
+#endif
+
+// Count a relocation of type `type` in the statistics.
+#define KBELF_STAT_RELOC(type)                                                                                         \
+    KBELF_STAT(relocs[(type) < KBELF_STATS_RELOC_TYPES ? (type) : KBELF_STATS_RELOC_TYPES - 1], 1)
+
+
+
+/* ==== Image cache ==== */
+
+// Compute the image cache key of a loaded process image that has not been relocated yet.
+uint64_t kbelfi_imgcache_key(kbelf_dyn dyn);
+// Restore the relocated segments and initialisation order of a process image from the image cache.
+// Returns true if the image was cached, false otherwise.
+bool     kbelfi_imgcache_restore(kbelf_dyn dyn, uint64_t key);
+// Store the relocated segments and initialisation order of a process image in the image cache.
+void     kbelfi_imgcache_save(kbelf_dyn dyn, uint64_t key);
+
+
+
+/* ==== Relocation ==== */
+
+// Relocation type of kept relocations decoded from a RELR table; the word is set to the load bias plus the addend.
+#define KBELF_FIXUP_RELR UINT32_MAX
+
+// Apply a deferred or kept relocation to an instance.
+// Returns success status.
+bool kbelfi_fixup_apply(kbelf_inst inst, kbelf_fixup const *fixup);
+// Determine which segments of a loaded instance are written by relocations.
+// Returns success status.
+bool kbelfi_reloc_targets(kbelf_inst inst, bool *relocated);
+
+
+
+/* ==== Symbols ==== */
+
+// Free the address-to-symbol index of a process image so it is built again on next use.
+void kbelfi_symidx_free(kbelf_dyn dyn);
+
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
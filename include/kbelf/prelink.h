@@ -0,0 +1,69 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+// Magic value of a prelinked image descriptor ("KBPL").
+#define KBELF_PRELINK_MAGIC   0x4c50424b
+// Version of the prelinked image descriptor format.
+#define KBELF_PRELINK_VERSION 1
+
+// Descriptor of a prelinked boot image created by `kbelf_prelink`.
+// The flat image is copied as-is to `load_addr`; nothing needs to be relocated.
+// The descriptor is followed by `preinit_len`, `init_len` and `fini_len` function addresses as `uint64_t`, each list
+// in running order. All fields are in the byte order of the target.
+typedef struct {
+    // Must be `KBELF_PRELINK_MAGIC`.
+    uint32_t magic;
+    // Must be `KBELF_PRELINK_VERSION`.
+    uint32_t version;
+    // Virtual address of the first byte of the flat image.
+    uint64_t load_addr;
+    // Size of the flat image in bytes.
+    uint64_t image_size;
+    // Virtual entrypoint address.
+    uint64_t entry;
+    // Number of pre-initialisation functions.
+    uint32_t preinit_len;
+    // Number of initialisation functions.
+    uint32_t init_len;
+    // Number of finalisation functions.
+    uint32_t fini_len;
+    // Reserved; must be zero.
+    uint32_t reserved;
+} kbelf_prelink_desc;
+
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
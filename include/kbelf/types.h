@@ -35,6 +35,8 @@ extern "C" {
 struct struct_kbelf_file;
 struct struct_kbelf_inst;
 struct struct_kbelf_dyn;
+struct struct_kbelf_libcache;
+struct struct_kbelf_filecache;
 
 // Context used to read, write, load and relocate ELF files.
 typedef struct struct_kbelf_file  *kbelf_file;
@@ -44,6 +46,10 @@ typedef struct struct_kbelf_inst  *kbelf_inst;
 typedef struct struct_kbelf_reloc *kbelf_reloc;
 // Context used to load and interpret dynamic executables.
 typedef struct struct_kbelf_dyn   *kbelf_dyn;
+// Cache of library segments shared between processes.
+typedef struct struct_kbelf_libcache  *kbelf_libcache;
+// Cache of opened ELF files.
+typedef struct struct_kbelf_filecache *kbelf_filecache;
 #else
 // Context used to read, write, load and relocate ELF files.
 typedef void *kbelf_file;
@@ -53,6 +59,10 @@ typedef void *kbelf_inst;
 typedef void *kbelf_reloc;
 // Context used to load and interpret dynamic executables.
 typedef void *kbelf_dyn;
+// Cache of library segments shared between processes.
+typedef void *kbelf_libcache;
+// Cache of opened ELF files.
+typedef void *kbelf_filecache;
 #endif
 
 // Loaded segment offset information.
@@ -90,8 +100,103 @@ typedef struct {
     bool w;
     // Loaded segment exec permission.
     bool x;
+
+    // Segment is shared with other processes through a `kbelf_libcache`.
+    // If set before `kbelfx_seg_alloc`, `laddr` and `paddr` refer to already loaded memory that only needs to be
+    // mapped. `kbelfx_seg_free` must not release the memory of shared segments.
+    bool shared;
 } kbelf_segment;
 
+// Range of loaded memory.
+typedef struct {
+    // Load address of the first byte.
+    kbelf_laddr laddr;
+    // Size in bytes.
+    kbelf_addr  size;
+} kbelf_range;
+
+// Maximum number of ranges returned by `kbelf_inst_reclaimable`.
+#define KBELF_RECLAIM_MAX 7
+
+// Phases of loading reported to `kbelfx_trace_begin` and `kbelfx_trace_end`.
+typedef enum {
+    // Opening a file; the count is 0.
+    KBELF_PHASE_OPEN,
+    // Reading and validating the ELF header; the count is in bytes.
+    KBELF_PHASE_HEADER,
+    // Reading the program headers; the count is in entries.
+    KBELF_PHASE_PROGHEADERS,
+    // Allocating the segments of an instance with `kbelfx_seg_alloc`; the count is in segments.
+    KBELF_PHASE_SEG_ALLOC,
+    // Reading the contents of the segments of an instance; the count is in bytes.
+    KBELF_PHASE_SEG_LOAD,
+    // Decoding the dynamic table of an instance; the count is in entries.
+    KBELF_PHASE_DYNAMIC,
+    // Finding the libraries needed by an instance; the count is in libraries.
+    KBELF_PHASE_DEPS,
+    // Sorting the libraries in initialisation order; the count is in libraries.
+    KBELF_PHASE_INIT_ORDER,
+    // Looking up a symbol by name; the count is in symbols compared.
+    KBELF_PHASE_SYMBOL,
+    // Relocating an instance; the count is in relocations.
+    KBELF_PHASE_RELOC,
+    // Synchronizing caches for one or more instances; the count is in bytes.
+    KBELF_PHASE_CACHE_SYNC,
+    // Number of phases.
+    KBELF_PHASE_COUNT,
+} kbelf_phase;
+
+// Statistics about loading a process image, counted if `KBELF_STATS` is enabled.
+typedef struct {
+    // Number of calls to `kbelfx_read` and `kbelfx_load`.
+    size_t read_calls;
+    // Number of bytes read by `kbelfx_read` and `kbelfx_load`.
+    size_t read_bytes;
+    // Number of calls to `kbelfx_seek`.
+    size_t seek_calls;
+    // Number of calls to `kbelfx_copy_from_user`.
+    size_t copy_from_calls;
+    // Number of bytes copied by `kbelfx_copy_from_user`.
+    size_t copy_from_bytes;
+    // Number of calls to `kbelfx_copy_to_user`.
+    size_t copy_to_calls;
+    // Number of bytes copied by `kbelfx_copy_to_user`.
+    size_t copy_to_bytes;
+    // Number of metadata allocations.
+    size_t allocs;
+    // Number of bytes of metadata allocated.
+    size_t alloc_bytes;
+    // Number of bytes of metadata allocated and not yet freed.
+    size_t meta_bytes;
+    // Highest value of `meta_bytes`.
+    size_t meta_peak;
+    // Number of relocations read from RELA tables by type; the last counter includes all higher types.
+    size_t relocs[KBELF_STATS_RELOC_TYPES];
+    // Number of relocations decoded from RELR tables.
+    size_t relr_relocs;
+    // Number of symbols looked up by name.
+    size_t sym_lookups;
+    // Number of symbol or library names compared to a name being looked up.
+    size_t str_compares;
+    // Number of library name table entries skipped because their hash differs.
+    size_t hash_rejects;
+    // Number of address translations between the address spaces of a loaded instance.
+    size_t translations;
+} kbelf_stats;
+
+// Kinds of records passed to a `kbelf_map_writer`.
+typedef enum {
+    // A loaded segment: virtual address, size, file name and permissions.
+    KBELF_MAP_SEGMENT,
+    // A function: virtual address, size and name, as in a `/tmp/perf-<pid>.map` file.
+    KBELF_MAP_SYMBOL,
+} kbelf_map_kind;
+
+// Receives the records of `kbelf_dyn_export_map` one line at a time.
+// `line` is the record formatted as hexadecimal address, hexadecimal size and text separated by spaces, and ends in a
+// newline. Returns false to stop exporting.
+typedef bool (*kbelf_map_writer)(void *ctx, kbelf_map_kind kind, char const *line);
+
 // Symbol definition for a built-in library.
 typedef struct {
     // Symbol name.
@@ -111,6 +216,87 @@ typedef struct {
 } kbelf_builtin_lib;
 
 #ifdef KBELF_REVEAL_PRIVATE
+// Address spaces of the segments of a loaded instance.
+typedef enum {
+    // Virtual addresses as requested by the ELF file.
+    KBELF_SPACE_REQ,
+    // Virtual addresses in the loaded instance.
+    KBELF_SPACE_REAL,
+    // Physical addresses.
+    KBELF_SPACE_PHYS,
+    // Load addresses.
+    KBELF_SPACE_LOAD,
+    // Number of address spaces.
+    KBELF_SPACE_COUNT,
+} kbelf_addrspace;
+
+// Location of a table in a loaded instance.
+typedef struct {
+    // Virtual address as requested by the ELF file, or 0 if not present.
+    kbelf_addr vaddr;
+    // Size in bytes.
+    kbelf_addr size;
+    // Size of an entry in bytes.
+    kbelf_addr ent;
+} kbelf_dyntab;
+
+// Information decoded from the dynamic table of a loaded instance.
+typedef struct {
+    // Number of needed libraries.
+    size_t       needed_len;
+    // Dynamic string table offsets of the needed library names.
+    kbelf_addr  *needed;
+    // Dynamic string table offset of the library's own name, or 0 if not present.
+    kbelf_addr   soname;
+    // Relocation table without addends.
+    kbelf_dyntab rel;
+    // Relocation table with addends.
+    kbelf_dyntab rela;
+    // PLT relocation table; `ent` tells whether its entries have addends.
+    kbelf_dyntab jmprel;
+    // Relative relocation table in the compact RELR format.
+    kbelf_dyntab relr;
+    // Virtual address of the SysV hash table as requested by the ELF file, or 0 if not present.
+    kbelf_addr   hash;
+    // Virtual address of the GNU hash table as requested by the ELF file, or 0 if not present.
+    kbelf_addr   gnu_hash;
+    // Value of `DT_FLAGS`.
+    kbelf_addr   flags;
+    // Value of `DT_FLAGS_1`.
+    kbelf_addr   flags_1;
+} kbelf_dyninfo;
+
+// Relocation kept to be applied again after the initial relocation pass.
+typedef struct {
+    // Virtual address of the relocated word as requested by the ELF file.
+    kbelf_addr     offset;
+    // Symbol value; an address as requested by `def` if it is set, an absolute value otherwise.
+    kbelf_addr     sym;
+    // Addend.
+    kbelf_addrdiff addend;
+    // Instance that defines the symbol, if any.
+    kbelf_inst     def;
+    // Relocation type.
+    uint32_t       type;
+} kbelf_fixup;
+
+// Block of memory in a `kbelf_arena`; the memory follows the header.
+typedef struct struct_kbelf_arenablk kbelf_arenablk;
+struct struct_kbelf_arenablk {
+    // Previously allocated block.
+    kbelf_arenablk *prev;
+    // Usable size of this block.
+    size_t          cap;
+    // Used size of this block.
+    size_t          len;
+};
+
+// Allocator for memory that is freed all at once.
+typedef struct {
+    // Block currently allocated from.
+    kbelf_arenablk *head;
+} kbelf_arena;
+
 // Context used to read, write, load and relocate ELF files.
 struct struct_kbelf_file {
     // File descriptor used for loading.
@@ -121,16 +307,36 @@ struct struct_kbelf_file {
     // Sub-string of the path that is the name.
     char const *name;
 
+    // Number of references to this file.
+    size_t refcount;
+
     // A copy of the header information.
-    kbelf_header header;
+    kbelf_header      header;
+    // A copy of the program header table.
+    kbelf_progheader *prog;
     // Length of the string table.
-    size_t       strtab_len;
+    size_t            strtab_len;
     // A copy of the string table.
-    char        *strtab;
+    char             *strtab;
     // Length of the section name table.
-    size_t       shstr_len;
+    size_t            shstr_len;
     // A copy of the section name table.
-    char        *shstr;
+    char             *shstr;
+};
+
+// Read-only segments of a library shared between processes.
+typedef struct kbelf_libent kbelf_libent;
+struct kbelf_libent {
+    // Cache this entry belongs to, or NULL if the cache was destroyed.
+    kbelf_libcache cache;
+    // Copy of the path of the ELF file.
+    char          *path;
+    // Number of instances using the shared segments.
+    size_t         refcount;
+    // Number of segments in the library.
+    size_t         segments_len;
+    // Descriptors of all segments; only those with `shared` set are used.
+    kbelf_segment *segments;
 };
 
 // Loaded instance of an ELF file.
@@ -141,11 +347,33 @@ struct struct_kbelf_inst {
     int        pid;
     // Whether this is a PIE file.
     bool       is_pie;
+    // Whether this instance and its segment descriptors are stored in the block of a finalized `kbelf_dyn`.
+    bool       compact;
 
     // Number of loaded segments.
     size_t         segments_len;
     // Information about loaded segments.
     kbelf_segment *segments;
+    // Segment indices sorted by start address for each `kbelf_addrspace`, or NULL to search linearly.
+    size_t        *seg_index;
+    // Index of the segment found by the last address translation for each `kbelf_addrspace`.
+    size_t         seg_mru[KBELF_SPACE_COUNT];
+
+    // Whether segments are loaded on demand by `kbelf_inst_fault`.
+    bool         lazy;
+    // Bitmap of present pages for all segments in order.
+    uint8_t     *lazy_present;
+    // Whether all applied relocations are kept in `fixups`.
+    bool         fixups_kept;
+    // Whether the relocation and symbol tables were passed to `kbelfx_seg_discard`.
+    bool         reclaimed;
+    // Number of kept relocations.
+    size_t       fixups_len;
+    // Relocations waiting for their page to be loaded or kept for cloning, sorted by offset.
+    kbelf_fixup *fixups;
+
+    // Library cache entry of the shared segments, if any.
+    kbelf_libent *libent;
 
     // Entrypoint address, if any.
     kbelf_addr entry;
@@ -166,6 +394,9 @@ struct struct_kbelf_inst {
     // Virtual address of init_array, if any.
     kbelf_addr fini_array;
 
+    // Information decoded from the dynamic table.
+    kbelf_dyninfo dyninfo;
+
     // Length of the dynamic table.
     kbelf_addr  dynamic_len;
     // Load address of the dynamic table.
@@ -182,51 +413,203 @@ struct struct_kbelf_inst {
 
 // Context used to perform relocation.
 struct struct_kbelf_reloc {
+    // Memory for the arrays and names below.
+    kbelf_arena               arena;
+    // Whether to keep the applied relocations in the instances.
+    bool                      keep_fixups;
     // Number of loaded ELF files.
     size_t                    libs_len;
+    // Capacity of `libs_file` and `libs_inst`.
+    size_t                    libs_cap;
     // Source ELF files.
     kbelf_file               *libs_file;
     // Loaded instances.
     kbelf_inst               *libs_inst;
     // Number of built-in libraries.
     size_t                    builtins_len;
+    // Capacity of `builtins`.
+    size_t                    builtins_cap;
     // Built-in libraries.
     kbelf_builtin_lib const **builtins;
+    // Capacity of `symname`.
+    size_t                    symname_cap;
+    // Buffer for the name of the symbol being looked up.
+    char                     *symname;
+    // Capacity of `candname`.
+    size_t                    candname_cap;
+    // Buffer for the name of a symbol that may match it.
+    char                     *candname;
+};
+
+// Cache of library segments shared between processes.
+struct struct_kbelf_libcache {
+    // Number of cached libraries.
+    size_t         entries_len;
+    // Cached libraries.
+    kbelf_libent **entries;
 };
 
+// Opened ELF file in a `kbelf_filecache`.
+typedef struct {
+    // The file, referenced by the cache.
+    kbelf_file file;
+    // Generation number passed when the file was opened.
+    uint64_t   generation;
+} kbelf_fileent;
+
+// Cache of opened ELF files.
+struct struct_kbelf_filecache {
+    // Number of cached files.
+    size_t         entries_len;
+    // Cached files.
+    kbelf_fileent *entries;
+};
+
+// Dependency of one loaded library on another.
+typedef struct {
+    // Index of the library that depends on `dep`.
+    size_t lib;
+    // Index of the library it depends on.
+    size_t dep;
+} kbelf_libdep;
+
+// Library opened and loaded by a job while loading a process image.
+typedef struct {
+    // Context the library is loaded for.
+    kbelf_dyn   dyn;
+    // Name the library is needed by if it has not been opened yet.
+    char const *needed;
+    // Opened library file.
+    kbelf_file  file;
+    // Loaded library.
+    kbelf_inst  inst;
+    // Whether the library is loaded by the calling thread instead of the job.
+    bool        deferred;
+    // Handle from `kbelfx_job_submit`, or NULL if the job ran on the calling thread.
+    void       *handle;
+#if KBELF_STATS
+    // Statistics counted by the job, added to those of the context after it is joined.
+    kbelf_stats stats;
+#endif
+} kbelf_loadjob;
+
+// Entry in a hashed table of library names.
+typedef struct {
+    // Library name, or NULL if the entry is empty.
+    char const              *name;
+    // Hash of the name.
+    uint32_t                 hash;
+    // Index of the loaded library, or SIZE_MAX for built-in libraries.
+    size_t                   lib;
+    // Built-in library, if any.
+    kbelf_builtin_lib const *builtin;
+} kbelf_libname;
+
+// Function in the address-to-symbol index of a process image.
+typedef struct {
+    // Virtual address of the function.
+    kbelf_addr vaddr;
+    // Size of the function in bytes.
+    kbelf_addr size;
+    // Offset of the name of the function in the name pool of the index.
+    size_t     name;
+} kbelf_symidx_ent;
+
 // Context used to load and interpret dynamic executables.
 struct struct_kbelf_dyn {
     // Original executable file.
-    kbelf_file exec_file;
+    kbelf_file     exec_file;
     // Loaded executable file.
-    kbelf_inst exec_inst;
+    kbelf_inst     exec_inst;
     // Identifier value as specified when program loading was initiated.
-    int        pid;
+    int            pid;
+    // Whether segments are loaded on demand by `kbelf_dyn_fault`.
+    bool           lazy;
+    // Cache to share library segments with other processes, if any.
+    kbelf_libcache libcache;
+    // Whether to keep the applied relocations so the process image can be cloned.
+    bool           keep_fixups;
+    // Whether to restore the relocated process image from `kbelfx_imgcache_load` if possible.
+    bool           imgcache;
+    // Whether to open and load the libraries of each dependency level concurrently.
+    bool           parallel;
+    // Whether `kbelf_dyn_reclaim` keeps the dynamic symbol, string and hash tables.
+    bool           keep_symbols;
+    // Memory for the arrays and names below.
+    kbelf_arena    arena;
 
     // Number of loaded library files.
     size_t      libs_len;
+    // Capacity of `libs_file`, `libs_inst` and `libs_needed`.
+    size_t      libs_cap;
     // Source library files.
     kbelf_file *libs_file;
     // Loaded libraries.
     kbelf_inst *libs_inst;
+    // Names that the libraries not opened yet are needed by.
+    char      **libs_needed;
 
     // Number of built-in libraries.
     size_t                    builtins_len;
+    // Capacity of `builtins`.
+    size_t                    builtins_cap;
     // Built-in libraries.
     kbelf_builtin_lib const **builtins;
 
     // Entrypoint virtual address.
     kbelf_addr entrypoint;
 
+    // Total number of pre-initialisation functions.
+    size_t      preinit_len;
     // Total number of initialisation functions.
-    size_t init_len;
+    size_t      init_len;
     // Total number of finalisation functions.
-    size_t fini_len;
+    size_t      fini_len;
+    // Pre-initialisation, initialisation and finalisation functions in running order.
+    kbelf_addr *funcs;
 
     // Number of entries in the initialisation order.
     size_t  init_order_len;
     // Initialisation order of the libraries by index.
     size_t *init_order;
+
+    // Number of dependencies between libraries.
+    size_t        deps_len;
+    // Capacity of `deps`.
+    size_t        deps_cap;
+    // Dependencies between libraries, found while loading them.
+    kbelf_libdep *deps;
+
+    // Capacity of the library name table, zero or a power of two.
+    size_t         names_cap;
+    // Number of entries in the library name table.
+    size_t         names_len;
+    // Hashed table of the file names and sonames of the loaded and built-in libraries.
+    kbelf_libname *names;
+
+    // Capacity of the index of `kbelfx_builtin_libs`, zero until the first built-in library is looked up.
+    size_t         builtin_names_cap;
+    // Hashed table of `kbelfx_builtin_libs` by file name.
+    kbelf_libname *builtin_names;
+
+    // Whether the metadata has been compacted by `kbelf_dyn_finalize`.
+    bool        finalized;
+    // Single allocation holding the instances, segments and functions after `kbelf_dyn_finalize`.
+    void       *final_block;
+
+    // Whether the address-to-symbol index has been built.
+    bool              symidx_built;
+    // Number of functions in the address-to-symbol index.
+    size_t            symidx_len;
+    // Address-to-symbol index sorted by address, without overlapping starts.
+    kbelf_symidx_ent *symidx;
+    // Null-terminated names of the functions in `symidx`.
+    char             *symidx_names;
+
+#if KBELF_STATS
+    // Statistics about loading this process image.
+    kbelf_stats stats;
+#endif
 };
 #endif
 
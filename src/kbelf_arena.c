@@ -0,0 +1,261 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#define KBELF_REVEAL_PRIVATE
+#include <kbelf.h>
+#include <kbelf/internal.h>
+
+// Alignment of memory allocated from an arena.
+#define ARENA_ALIGN     (2 * sizeof(void *))
+// Usable size of the first block of an arena.
+#define ARENA_FIRST_CAP 256
+
+// Round a size up to the arena alignment.
+static inline size_t arena_round(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+// Allocate memory from an arena; it is freed by `kbelfi_arena_free`.
+// Returns non-null on success, NULL on error.
+void *kbelfi_arena_alloc(kbelf_arena *arena, size_t size) {
+    size_t          hdr  = arena_round(sizeof(kbelf_arenablk));
+    kbelf_arenablk *head = arena->head;
+    size                 = arena_round(size ? size : 1);
+    if (!head || head->cap - head->len < size) {
+        // Each block is at least twice as large as the previous one.
+        size_t cap = head ? 2 * head->cap : ARENA_FIRST_CAP;
+        while (cap < size) {
+            cap *= 2;
+        }
+        kbelf_arenablk *blk = kbelfi_malloc(hdr + cap);
+        if (!blk)
+            return NULL;
+        blk->prev   = head;
+        blk->cap    = cap;
+        blk->len    = 0;
+        arena->head = head = blk;
+    }
+    void *mem  = (char *)head + hdr + head->len;
+    head->len += size;
+    return mem;
+}
+
+// Copy a string into an arena.
+// Returns non-null on success, NULL on error.
+char *kbelfi_arena_strdup(kbelf_arena *arena, char const *str) {
+    size_t len  = kbelfq_strlen(str);
+    char  *copy = kbelfi_arena_alloc(arena, len + 1);
+    if (copy)
+        kbelfq_memcpy(copy, str, len + 1);
+    return copy;
+}
+
+// Make room for at least one more element in an array allocated from an arena, doubling its capacity if full.
+// Returns success status.
+bool kbelfi_arena_grow(kbelf_arena *arena, void *array, size_t *cap, size_t len, size_t ent_size) {
+    void **ptr = array;
+    if (len < *cap)
+        return true;
+    size_t new_cap = *cap ? 2 * *cap : 4;
+    while (new_cap <= len) {
+        new_cap *= 2;
+    }
+    void  *mem     = kbelfi_arena_alloc(arena, new_cap * ent_size);
+    if (!mem)
+        return false;
+    if (len)
+        kbelfq_memcpy(mem, *ptr, len * ent_size);
+    *ptr = mem;
+    *cap = new_cap;
+    return true;
+}
+
+// Free all memory allocated from an arena.
+void kbelfi_arena_free(kbelf_arena *arena) {
+    while (arena->head) {
+        kbelf_arenablk *prev = arena->head->prev;
+        kbelfi_free(arena->head);
+        arena->head = prev;
+    }
+}
+
+
+
+#if KBELF_STATS
+// Count a change in the size of a metadata allocation in the statistics.
+static void stats_mem(size_t old_size, size_t new_size) {
+    kbelf_stats *stats = kbelfi_stats;
+    if (!stats)
+        return;
+    if (new_size > old_size) {
+        stats->alloc_bytes += new_size - old_size;
+        stats->meta_bytes  += new_size - old_size;
+    } else {
+        // Memory allocated before the statistics were counted may be freed.
+        stats->meta_bytes = stats->meta_bytes > old_size - new_size ? stats->meta_bytes - (old_size - new_size) : 0;
+    }
+    if (stats->meta_bytes > stats->meta_peak)
+        stats->meta_peak = stats->meta_bytes;
+}
+#else
+#define stats_mem(old_size, new_size)
+#endif
+
+
+
+#if KBELF_STATIC_ALLOC
+// Size of the header in front of each allocation from the workspace.
+#define WS_HDR ARENA_ALIGN
+
+// Caller-provided memory that all metadata is allocated from.
+static char  *ws_mem;
+// Size of the workspace.
+static size_t ws_size;
+// Amount of the workspace in use.
+static size_t ws_used;
+// Highest amount of the workspace in use.
+static size_t ws_peak;
+
+// Set the memory that all metadata is allocated from.
+void kbelf_workspace_set(void *mem, size_t size) {
+    size_t skip = (ARENA_ALIGN - (size_t)mem % ARENA_ALIGN) % ARENA_ALIGN;
+    ws_mem      = mem ? (char *)mem + skip : NULL;
+    ws_size     = mem && size > skip ? size - skip : 0;
+    ws_used     = 0;
+    ws_peak     = 0;
+}
+
+// Get the amount of the workspace in use, for `kbelf_workspace_release`.
+size_t kbelf_workspace_mark() {
+    return ws_used;
+}
+
+// Release everything allocated from the workspace after `kbelf_workspace_mark` returned `mark`.
+void kbelf_workspace_release(size_t mark) {
+    if (mark < ws_used)
+        ws_used = mark;
+}
+
+// Get the highest amount of the workspace that has been in use since `kbelf_workspace_set`.
+size_t kbelf_workspace_peak() {
+    return ws_peak;
+}
+
+// Test whether an allocation from the workspace is the last one.
+static inline bool ws_is_last(char *blk) {
+    return blk + WS_HDR + *(size_t *)blk == ws_mem + ws_used;
+}
+
+// Allocate metadata memory from the workspace.
+void *kbelfi_malloc(size_t len) {
+    size_t size = arena_round(len ? len : 1);
+    if (ws_size - ws_used < WS_HDR + size)
+        return NULL;
+    char *blk       = ws_mem + ws_used;
+    *(size_t *)blk  = size;
+    ws_used        += WS_HDR + size;
+    if (ws_used > ws_peak)
+        ws_peak = ws_used;
+    KBELF_STAT(allocs, 1)
+    stats_mem(0, size);
+    return blk + WS_HDR;
+}
+
+// Resize metadata memory allocated from the workspace.
+// The last allocation is resized in place, others are copied.
+void *kbelfi_realloc(void *mem, size_t len) {
+    if (!mem)
+        return kbelfi_malloc(len);
+    char  *blk  = (char *)mem - WS_HDR;
+    size_t old  = *(size_t *)blk;
+    size_t size = arena_round(len ? len : 1);
+    if (ws_is_last(blk)) {
+        if (size > old && ws_size - ws_used < size - old)
+            return NULL;
+        ws_used        = ws_used - old + size;
+        *(size_t *)blk = size;
+        if (ws_used > ws_peak)
+            ws_peak = ws_used;
+        stats_mem(old, size);
+        return mem;
+    }
+    if (size <= old)
+        return mem;
+    void *copy = kbelfi_malloc(len);
+    if (copy) {
+        kbelfq_memcpy(copy, mem, old);
+        stats_mem(old, 0);
+    }
+    return copy;
+}
+
+// Free metadata memory allocated from the workspace.
+// Only the last allocation is given back; the rest is given back by `kbelf_workspace_release`.
+void kbelfi_free(void *mem) {
+    if (!mem)
+        return;
+    char *blk = (char *)mem - WS_HDR;
+    stats_mem(*(size_t *)blk, 0);
+    if (ws_is_last(blk))
+        ws_used = blk - ws_mem;
+}
+
+#elif KBELF_STATS
+// Size of the header in front of each allocation that holds its size.
+#define MEM_HDR ARENA_ALIGN
+
+// Allocate metadata memory with `kbelfx_malloc`.
+void *kbelfi_malloc(size_t len) {
+    char *blk = kbelfx_malloc(MEM_HDR + len);
+    if (!blk)
+        return NULL;
+    *(size_t *)blk = len;
+    KBELF_STAT(allocs, 1)
+    stats_mem(0, len);
+    return blk + MEM_HDR;
+}
+
+// Resize metadata memory allocated by `kbelfi_malloc`.
+void *kbelfi_realloc(void *mem, size_t len) {
+    if (!mem)
+        return kbelfi_malloc(len);
+    char  *blk = (char *)mem - MEM_HDR;
+    size_t old = *(size_t *)blk;
+    blk        = kbelfx_realloc(blk, MEM_HDR + len);
+    if (!blk)
+        return NULL;
+    *(size_t *)blk = len;
+    stats_mem(old, len);
+    return blk + MEM_HDR;
+}
+
+// Free metadata memory allocated by `kbelfi_malloc`.
+void kbelfi_free(void *mem) {
+    if (!mem)
+        return;
+    char *blk = (char *)mem - MEM_HDR;
+    stats_mem(*(size_t *)blk, 0);
+    kbelfx_free(blk);
+}
+#endif
@@ -24,6 +24,7 @@
 
 #define KBELF_REVEAL_PRIVATE
 #include <kbelf.h>
+#include <kbelf/internal.h>
 
 // Default no-op cache sync for platforms with coherent caches.
 __attribute__((weak)) void kbelfx_cache_sync(kbelf_laddr addr, size_t size) {
@@ -31,11 +32,45 @@ __attribute__((weak)) void kbelfx_cache_sync(kbelf_laddr addr, size_t size) {
     (void)size;
 }
 
+// Default batched cache sync that synchronizes the ranges one by one.
+__attribute__((weak)) void kbelfx_cache_sync_ranges(kbelf_range const *ranges, size_t ranges_len) {
+    for (size_t i = 0; i < ranges_len; i++) {
+        kbelfx_cache_sync(ranges[i].laddr, ranges[i].size);
+    }
+}
+
+// Default job hook that makes the caller run every job itself.
+__attribute__((weak)) void *kbelfx_job_submit(void (*func)(void *arg), void *arg) {
+    (void)func;
+    (void)arg;
+    return NULL;
+}
+
+// Default job hook for when no job is ever started.
+__attribute__((weak)) void kbelfx_job_join(void *job) {
+    (void)job;
+}
+
+#if KBELF_STATS
+// Statistics that the work done by this thread is counted in, if any.
+KBELF_THREAD_LOCAL kbelf_stats *kbelfi_stats;
+#endif
+
+// Get the statistics of a context, or NULL if they are not counted.
+static inline kbelf_stats *dyn_stats(kbelf_dyn dyn) {
+#if KBELF_STATS
+    return &dyn->stats;
+#else
+    (void)dyn;
+    return NULL;
+#endif
+}
+
 // Create a dynamic executable loading context.
 // Returns non-null on success, NULL on error.
 kbelf_dyn kbelf_dyn_create(int pid) {
     // Allocate memory.
-    kbelf_dyn dyn = kbelfx_malloc(sizeof(struct struct_kbelf_dyn));
+    kbelf_dyn dyn = kbelfi_malloc(sizeof(struct struct_kbelf_dyn));
     if (!dyn)
         KBELF_ERROR(abort, "Out of memory")
     kbelfq_memset(dyn, 0, sizeof(struct struct_kbelf_dyn));
@@ -57,30 +92,36 @@ void kbelf_dyn_destroy(kbelf_dyn dyn) {
     if (dyn->exec_inst)
         kbelf_inst_destroy(dyn->exec_inst);
     for (size_t i = 0; i < dyn->libs_len; i++) {
-        kbelf_file_close(dyn->libs_file[i]);
+        if (dyn->libs_file)
+            kbelf_file_close(dyn->libs_file[i]);
         kbelf_inst_destroy(dyn->libs_inst[i]);
     }
-    if (dyn->libs_len) {
-        kbelfx_free(dyn->libs_file);
-        kbelfx_free(dyn->libs_inst);
-    }
-    if (dyn->builtins_len)
-        kbelfx_free(dyn->builtins);
-    if (dyn->init_order)
-        kbelfx_free(dyn->init_order);
-    kbelfx_free(dyn);
+    kbelfi_arena_free(&dyn->arena);
+    if (dyn->final_block)
+        kbelfi_free(dyn->final_block);
+    kbelfi_symidx_free(dyn);
+    kbelfi_free(dyn);
 }
 
 // Unloads the process image if it was successfully created.
 void kbelf_dyn_unload(kbelf_dyn dyn) {
     if (!dyn)
         return;
+    kbelfi_symidx_free(dyn);
     kbelf_inst_unload(dyn->exec_inst);
     dyn->exec_inst = NULL;
     for (size_t i = 0; i < dyn->libs_len; i++) {
         kbelf_inst_unload(dyn->libs_inst[i]);
         dyn->libs_inst[i] = NULL;
     }
+
+    // The functions refer to the unloaded image; their memory is freed with the context.
+    dyn->entrypoint     = 0;
+    dyn->preinit_len    = 0;
+    dyn->init_len       = 0;
+    dyn->fini_len       = 0;
+    dyn->funcs          = NULL;
+    dyn->init_order_len = 0;
 }
 
 // Set the executable file.
@@ -90,10 +131,89 @@ bool kbelf_dyn_set_exec(kbelf_dyn dyn, char const *path, void *fd) {
         return false;
     if (dyn->exec_file)
         return false;
-    dyn->exec_file = kbelf_file_open(path, fd);
+    kbelf_stats *prev = kbelfi_stats_swap(dyn_stats(dyn));
+    dyn->exec_file    = kbelf_file_open(path, fd);
+    kbelfi_stats_swap(prev);
     return dyn->exec_file;
 }
 
+// Set the executable file from an already opened `kbelf_file`.
+// Returns success status.
+bool kbelf_dyn_set_exec_file(kbelf_dyn dyn, kbelf_file file) {
+    if (!dyn || dyn->exec_file) {
+        kbelf_file_close(file);
+        return false;
+    }
+    dyn->exec_file = file;
+    return file;
+}
+
+// Enable or disable demand-paged loading of the process image.
+// Must be called before `kbelf_dyn_load`.
+// Returns success status.
+bool kbelf_dyn_set_lazy(kbelf_dyn dyn, bool lazy) {
+    if (!dyn || dyn->exec_inst)
+        return false;
+    dyn->lazy = lazy;
+    return true;
+}
+
+
+
+// Set the cache used to share read-only library segments with other processes.
+// Must be called before `kbelf_dyn_load`.
+// Returns success status.
+bool kbelf_dyn_set_libcache(kbelf_dyn dyn, kbelf_libcache cache) {
+    if (!dyn || dyn->exec_inst)
+        return false;
+    dyn->libcache = cache;
+    return true;
+}
+
+// Set whether to keep the applied relocations so the process image can be cloned.
+// Must be called before `kbelf_dyn_load`.
+// Returns success status.
+bool kbelf_dyn_set_keep_fixups(kbelf_dyn dyn, bool keep) {
+    if (!dyn || dyn->exec_inst)
+        return false;
+    dyn->keep_fixups = keep;
+    return true;
+}
+
+// Enable or disable restoring the relocated process image from `kbelfx_imgcache_load`.
+// Must be called before `kbelf_dyn_load`.
+// Returns success status.
+bool kbelf_dyn_set_imgcache(kbelf_dyn dyn, bool enable) {
+    if (!dyn || dyn->exec_inst)
+        return false;
+    dyn->imgcache = enable;
+    return true;
+}
+
+// Enable or disable opening and loading the libraries of each dependency level concurrently.
+// Must be called before `kbelf_dyn_load`.
+// Returns success status.
+bool kbelf_dyn_set_parallel(kbelf_dyn dyn, bool parallel) {
+    if (!dyn || dyn->exec_inst)
+        return false;
+#if KBELF_STATIC_ALLOC
+    // The workspace is not thread-safe.
+    if (parallel)
+        return false;
+#endif
+    dyn->parallel = parallel;
+    return true;
+}
+
+// Set whether `kbelf_dyn_reclaim` keeps the dynamic symbol, string and hash tables for symbol lookups.
+// Returns success status.
+bool kbelf_dyn_set_keep_symbols(kbelf_dyn dyn, bool keep) {
+    if (!dyn)
+        return false;
+    dyn->keep_symbols = keep;
+    return true;
+}
+
 
 
 // Extract filename from path.
@@ -109,30 +229,166 @@ static char const *path_to_filename(char const *path) {
     return path;
 }
 
-// Add a library file.
-static bool add_lib(kbelf_dyn dyn, kbelf_file file, kbelf_inst inst) {
-    if (!dyn || !file)
+// Hash a library name.
+static uint32_t name_hash(char const *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Find a library name in a hashed table.
+static kbelf_libname const *names_find(kbelf_libname const *names, size_t cap, char const *name, uint32_t hash) {
+    if (!cap)
+        return NULL;
+    for (size_t i = hash & (cap - 1);; i = (i + 1) & (cap - 1)) {
+        if (!names[i].name)
+            return NULL;
+        if (names[i].hash != hash) {
+            KBELF_STAT(hash_rejects, 1)
+            continue;
+        }
+        KBELF_STAT(str_compares, 1)
+        if (kbelfq_streq(names[i].name, name))
+            return &names[i];
+    }
+}
+
+// Insert a library name into a hashed table that has room for it.
+static void names_insert(kbelf_libname *names, size_t cap, kbelf_libname ent) {
+    size_t i = ent.hash & (cap - 1);
+    while (names[i].name) {
+        i = (i + 1) & (cap - 1);
+    }
+    names[i] = ent;
+}
+
+// Add a name to the library name table; the name must stay valid until the context is destroyed.
+// Names that are already present keep the library they refer to.
+static bool add_name(kbelf_dyn dyn, char const *name, size_t lib, kbelf_builtin_lib const *builtin) {
+    uint32_t hash = name_hash(name);
+    if (names_find(dyn->names, dyn->names_cap, name, hash))
+        return true;
+
+    // Keep the table at most half full.
+    if (2 * (dyn->names_len + 1) > dyn->names_cap) {
+        size_t         cap   = dyn->names_cap ? 2 * dyn->names_cap : 8;
+        kbelf_libname *names = kbelfi_arena_alloc(&dyn->arena, cap * sizeof(kbelf_libname));
+        if (!names)
+            return false;
+        kbelfq_memset(names, 0, cap * sizeof(kbelf_libname));
+        for (size_t i = 0; i < dyn->names_cap; i++) {
+            if (dyn->names[i].name)
+                names_insert(names, cap, dyn->names[i]);
+        }
+        dyn->names     = names;
+        dyn->names_cap = cap;
+    }
+
+    names_insert(
+        dyn->names,
+        dyn->names_cap,
+        (kbelf_libname){.name = name, .hash = hash, .lib = lib, .builtin = builtin}
+    );
+    dyn->names_len++;
+    return true;
+}
+
+// Add a library file, or the name a library is needed by if it is opened later by `load_libs`.
+// `needed` must be allocated from the context's arena.
+static bool add_lib(kbelf_dyn dyn, kbelf_file file, char *needed) {
+    if (!dyn || (!file && !needed))
         return false;
-    size_t file_sz  = (1 + dyn->libs_len) * sizeof(struct struct_kbelf_file);
-    size_t inst_sz  = (1 + dyn->libs_len) * sizeof(struct struct_kbelf_inst);
-    void  *file_mem = kbelfx_realloc(dyn->libs_file, file_sz);
-    void  *inst_mem = kbelfx_realloc(dyn->libs_inst, inst_sz);
-    if (file_mem)
-        dyn->libs_file = file_mem;
-    if (inst_mem)
-        dyn->libs_inst = inst_mem;
-    if (!file_mem || !inst_mem)
+#if KBELF_MAX_LIBS
+    if (dyn->libs_len >= KBELF_MAX_LIBS) {
+        KBELF_LOGE("More than " KBELF_FMT_DEC " libraries", KBELF_MAX_LIBS)
         return false;
-    dyn->libs_file[dyn->libs_len] = file;
-    dyn->libs_inst[dyn->libs_len] = inst;
+    }
+#endif
+    size_t file_cap = dyn->libs_cap, inst_cap = dyn->libs_cap, needed_cap = dyn->libs_cap;
+    size_t len      = dyn->libs_len;
+    if (!kbelfi_arena_grow(&dyn->arena, &dyn->libs_file, &file_cap, len, sizeof(kbelf_file))
+        || !kbelfi_arena_grow(&dyn->arena, &dyn->libs_inst, &inst_cap, len, sizeof(kbelf_inst))
+        || !kbelfi_arena_grow(&dyn->arena, &dyn->libs_needed, &needed_cap, len, sizeof(char *)))
+        return false;
+    dyn->libs_cap                   = file_cap;
+    dyn->libs_file[dyn->libs_len]   = file;
+    dyn->libs_inst[dyn->libs_len]   = NULL;
+    dyn->libs_needed[dyn->libs_len] = needed;
     dyn->libs_len++;
+    return add_name(dyn, file ? file->name : path_to_filename(needed), dyn->libs_len - 1, NULL);
+}
+
+// Read a string from the dynamic string table of a loaded instance into the context's arena.
+// Returns non-null on success, NULL on error.
+static char *read_dynstr(kbelf_dyn dyn, kbelf_inst inst, kbelf_addr offset) {
+    kbelf_laddr laddr = inst->dynstr + offset;
+    ptrdiff_t   len   = kbelfx_strlen_from_user(inst, laddr);
+    if (len < 0)
+        KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
+    char *str = kbelfi_arena_alloc(&dyn->arena, len + 1);
+    if (!str)
+        KBELF_ERROR(abort, "Out of memory")
+    if (!kbelfi_copy_from_user(inst, str, laddr, len + 1) || str[len])
+        KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
+    return str;
+
+abort:
+    return NULL;
+}
+
+// Add the soname of a loaded library to the library name table.
+static bool add_soname(kbelf_dyn dyn, size_t lib) {
+    kbelf_inst inst = dyn->libs_inst[lib];
+    if (!inst->dyninfo.soname)
+        return true;
+    char *soname = read_dynstr(dyn, inst, inst->dyninfo.soname);
+    if (!soname)
+        return false;
+    if (!add_name(dyn, soname, lib, NULL))
+        KBELF_ERROR(abort, "Out of memory")
+    return true;
+
+abort:
+    return false;
+}
+
+// Index `kbelfx_builtin_libs` by file name in the context's arena.
+// Returns success status.
+static bool index_builtins(kbelf_dyn dyn) {
+    size_t cap = 4;
+    while (cap < 2 * kbelfx_builtin_libs_len) {
+        cap *= 2;
+    }
+    kbelf_libname *names = kbelfi_arena_alloc(&dyn->arena, cap * sizeof(kbelf_libname));
+    if (!names)
+        return false;
+    kbelfq_memset(names, 0, cap * sizeof(kbelf_libname));
+    for (size_t i = 0; i < kbelfx_builtin_libs_len; i++) {
+        char const *name = path_to_filename(kbelfx_builtin_libs[i]->path);
+        names_insert(
+            names,
+            cap,
+            (kbelf_libname){.name = name, .hash = name_hash(name), .lib = SIZE_MAX, .builtin = kbelfx_builtin_libs[i]}
+        );
+    }
+    dyn->builtin_names     = names;
+    dyn->builtin_names_cap = cap;
     return true;
 }
 
 // Find a built-in library.
-static kbelf_builtin_lib const *find_builtin(char const *needed) {
+static kbelf_builtin_lib const *find_builtin(kbelf_dyn dyn, char const *needed) {
+    needed = path_to_filename(needed);
+    if (dyn->builtin_names || index_builtins(dyn)) {
+        kbelf_libname const *ent = names_find(dyn->builtin_names, dyn->builtin_names_cap, needed, name_hash(needed));
+        return ent ? ent->builtin : NULL;
+    }
+    // Fall back to a linear search if the index could not be allocated.
     for (size_t i = 0; i < kbelfx_builtin_libs_len; i++) {
-        if (kbelfq_streq(path_to_filename(needed), path_to_filename(kbelfx_builtin_libs[i]->path)))
+        if (kbelfq_streq(needed, path_to_filename(kbelfx_builtin_libs[i]->path)))
             return kbelfx_builtin_libs[i];
     }
     return NULL;
@@ -142,191 +398,296 @@ static kbelf_builtin_lib const *find_builtin(char const *needed) {
 static bool add_builtin(kbelf_dyn dyn, kbelf_builtin_lib const *lib) {
     if (!dyn || !lib)
         return false;
-    size_t cap = (1 + dyn->builtins_len) * sizeof(kbelf_builtin_lib *);
-    void  *mem = kbelfx_realloc(dyn->builtins, cap);
-    if (!mem)
+    size_t len = dyn->builtins_len;
+    if (!kbelfi_arena_grow(&dyn->arena, &dyn->builtins, &dyn->builtins_cap, len, sizeof(kbelf_builtin_lib *)))
         return false;
-    dyn->builtins                      = mem;
     dyn->builtins[dyn->builtins_len++] = lib;
-    return true;
+    return add_name(dyn, path_to_filename(lib->path), SIZE_MAX, lib);
 }
 
 // Check whether a library is loaded.
-static bool check_lib(kbelf_dyn dyn, char const *needed) {
-    needed = path_to_filename(needed);
-    for (size_t i = 0; i < dyn->builtins_len; i++) {
-        if (kbelfq_streq(path_to_filename(dyn->builtins[i]->path), needed))
-            return true;
-    }
-    for (size_t i = 0; i < dyn->libs_len; i++) {
-        if (kbelfq_streq(dyn->libs_file[i]->name, needed))
-            return true;
-    }
-    return false;
+// Stores the index of the library or SIZE_MAX for built-in libraries in `lib_index`.
+static bool check_lib(kbelf_dyn dyn, char const *needed, size_t *lib_index) {
+    needed                   = path_to_filename(needed);
+    kbelf_libname const *ent = names_find(dyn->names, dyn->names_cap, needed, name_hash(needed));
+    if (!ent)
+        return false;
+    *lib_index = ent->lib;
+    return true;
+}
+
+// Record that one library depends on another.
+static bool add_dep(kbelf_dyn dyn, size_t lib, size_t dep) {
+    if (!kbelfi_arena_grow(&dyn->arena, &dyn->deps, &dyn->deps_cap, dyn->deps_len, sizeof(kbelf_libdep)))
+        return false;
+    dyn->deps[dyn->deps_len++] = (kbelf_libdep){.lib = lib, .dep = dep};
+    return true;
 }
 
 // Check a file for its dependencies and add any missing ones.
-static bool check_deps(kbelf_dyn dyn, kbelf_file file, kbelf_inst inst) {
-    (void)file;
-    for (size_t i = 0; i < inst->dynamic_len; i++) {
-        kbelf_dynentry dt = {0};
-        if (!kbelfx_copy_from_user(inst, &dt, inst->dynamic + i * sizeof(kbelf_dynentry), sizeof(kbelf_dynentry)))
-            KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
-        if (dt.tag == DT_NULL) {
-            inst->dynamic_len = i - 1;
-            break;
-        } else if (dt.tag == DT_NEEDED) {
-            ptrdiff_t len = kbelfx_strlen_from_user(inst, inst->dynstr + dt.value);
-            if (len < 0)
-                KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
-            char *needed = kbelfx_malloc(len + 1);
-            if (!needed)
-                KBELF_ERROR(abort, "Out of memory")
-            if (!kbelfx_copy_from_user(inst, needed, inst->dynstr + dt.value, len + 1) || needed[len]) {
-                kbelfx_free(needed);
-                KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
-            }
-            if (!check_lib(dyn, needed)) {
-                // Check for built-in libs first.
-                kbelf_builtin_lib const *builtin = find_builtin(needed);
-                if (builtin) {
-                    kbelfx_free(needed);
-                    if (!add_builtin(dyn, builtin))
-                        KBELF_ERROR(abort, "Out of memory")
-                } else {
-                    // If built-in fails, check for external libs.
-                    kbelf_file lib = kbelfx_find_lib(needed);
-                    if (!lib)
-                        KBELF_LOGE("Unable to find " KBELF_FMT_CSTR, needed)
-                    kbelfx_free(needed);
-                    if (!lib)
-                        goto abort;
-                    if (!add_lib(dyn, lib, NULL))
-                        KBELF_ERROR(abort, "Out of memory")
-                }
+// Records the dependencies of library `lib_index`, or none for the executable if it is SIZE_MAX.
+static bool check_deps(kbelf_dyn dyn, kbelf_file file, kbelf_inst inst, size_t lib_index) {
+    KBELF_TRACE_BEGIN(KBELF_PHASE_DEPS, file->name)
+    for (size_t i = 0; i < inst->dyninfo.needed_len; i++) {
+        char *needed = read_dynstr(dyn, inst, inst->dyninfo.needed[i]);
+        if (!needed)
+            goto abort;
+        size_t dep_index = SIZE_MAX;
+        if (!check_lib(dyn, needed, &dep_index)) {
+            // Check for built-in libs first.
+            kbelf_builtin_lib const *builtin = find_builtin(dyn, needed);
+            if (builtin) {
+                if (!add_builtin(dyn, builtin))
+                    KBELF_ERROR(abort, "Out of memory")
+            } else if (dyn->parallel) {
+                // Opened by `load_libs` together with the other libraries found at this level.
+                if (!add_lib(dyn, NULL, needed))
+                    KBELF_ERROR(abort, "Out of memory")
+                dep_index = dyn->libs_len - 1;
             } else {
-                kbelfx_free(needed);
+                // If built-in fails, check for external libs.
+                kbelf_file lib = kbelfx_find_lib(needed);
+                if (!lib)
+                    KBELF_ERROR(abort, "Unable to find " KBELF_FMT_CSTR, needed)
+                // The file found may be named differently, so remember the name it was needed by too.
+                if (!add_lib(dyn, lib, NULL) || !add_name(dyn, path_to_filename(needed), dyn->libs_len - 1, NULL))
+                    KBELF_ERROR(abort, "Out of memory")
+                dep_index = dyn->libs_len - 1;
             }
         }
+        if (lib_index != SIZE_MAX && dep_index != SIZE_MAX && dep_index != lib_index
+            && !add_dep(dyn, lib_index, dep_index))
+            KBELF_ERROR(abort, "Out of memory")
     }
+    KBELF_TRACE_END(KBELF_PHASE_DEPS, file->name, inst->dyninfo.needed_len)
 
     return true;
 
 abort:
+    KBELF_TRACE_END(KBELF_PHASE_DEPS, file->name, 0)
     return false;
 }
 
 
-// Test whether an instance has init and/or fini functions.
-static inline bool has_init_funcs(kbelf_inst inst) {
-    return kbelf_inst_preinit_len(inst) || kbelf_inst_init_len(inst) || kbelf_inst_fini_len(inst);
+// Open and load a library; runs as a job started by `load_libs`.
+static void load_job(void *arg) {
+    kbelf_loadjob *job = arg;
+    kbelf_dyn      dyn = job->dyn;
+#if KBELF_STATS
+    // Jobs count in their own statistics so that no atomics are needed.
+    kbelf_stats *prev = kbelfi_stats_swap(&job->stats);
+#endif
+    if (!job->file)
+        job->file = kbelfx_find_lib(job->needed);
+    if (job->file && !job->deferred)
+        job->inst = dyn->lazy ? kbelf_inst_load_lazy(job->file, dyn->pid)
+                              : kbelf_inst_load_cached(job->file, dyn->pid, dyn->libcache);
+#if KBELF_STATS
+    kbelfi_stats_swap(prev);
+#endif
 }
 
-// Test whether instance A depends directly or indirectly on instance B.
-static bool depends_on_recursive(kbelf_dyn dyn, kbelf_inst a, kbelf_inst b, size_t recursion_limit) {
-    if (recursion_limit == 0)
-        return true;
-    for (size_t i = 0; i < a->dynamic_len; i++) {
-        kbelf_dynentry dt = {0};
-        if (!kbelfx_copy_from_user(a, &dt, a->dynamic + i * sizeof(kbelf_dynentry), sizeof(kbelf_dynentry)))
-            KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
-
-        if (dt.tag == DT_NEEDED) {
-            ptrdiff_t len = kbelfx_strlen_from_user(a, a->dynstr + dt.value);
-            if (len < 0)
-                KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
-            char *needed = kbelfx_malloc(len + 1);
-            if (!needed)
-                KBELF_ERROR(abort, "Out of memory")
-            if (!kbelfx_copy_from_user(a, needed, a->dynstr + dt.value, len + 1) || needed[len]) {
-                kbelfx_free(needed);
-                KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
-            }
-            char const *file = path_to_filename(needed);
-            if (kbelfq_streq(file, b->file->name)) {
-                kbelfx_free(needed);
-                return true;
+#if KBELF_STATS
+// Add the statistics counted by a job to those of its context.
+static void stats_merge(kbelf_stats *to, kbelf_stats const *from) {
+    // The job allocated on top of what the context already had.
+    size_t peak = to->meta_bytes + from->meta_peak;
+    if (peak < to->meta_peak)
+        peak = to->meta_peak;
+    // All counters are `size_t`.
+    size_t       *dst = (size_t *)to;
+    size_t const *src = (size_t const *)from;
+    for (size_t i = 0; i < sizeof(kbelf_stats) / sizeof(size_t); i++) {
+        dst[i] += src[i];
+    }
+    to->meta_peak = peak;
+}
+#endif
+
+// Open and load the libraries from index `start` up to `end`, concurrently if enabled.
+static bool load_libs(kbelf_dyn dyn, size_t start, size_t end) {
+    kbelf_loadjob *jobs = kbelfi_malloc((end - start) * sizeof(kbelf_loadjob));
+    if (!jobs)
+        KBELF_ERROR(abort, "Out of memory")
+    // The library cache is not thread-safe, so cached libraries are loaded by the calling thread.
+    bool deferred = dyn->parallel && dyn->libcache && !dyn->lazy;
+
+    // Start the jobs.
+    for (size_t i = 0; i < end - start; i++) {
+        jobs[i] = (kbelf_loadjob){
+            .dyn      = dyn,
+            .needed   = dyn->libs_needed[start + i],
+            .file     = dyn->libs_file[start + i],
+            .inst     = NULL,
+            .deferred = deferred,
+            .handle   = NULL,
+        };
+        if (dyn->parallel)
+            jobs[i].handle = kbelfx_job_submit(load_job, &jobs[i]);
+        if (!jobs[i].handle)
+            load_job(&jobs[i]);
+    }
+    for (size_t i = 0; i < end - start; i++) {
+        if (jobs[i].handle)
+            kbelfx_job_join(jobs[i].handle);
+#if KBELF_STATS
+        stats_merge(&dyn->stats, &jobs[i].stats);
+#endif
+    }
+
+    // Collect the results in order; all of them are kept so they are cleaned up on error.
+    bool success = true;
+    for (size_t i = 0; i < end - start; i++) {
+        size_t lib          = start + i;
+        dyn->libs_inst[lib] = jobs[i].inst;
+        if (!dyn->libs_file[lib]) {
+            dyn->libs_file[lib] = jobs[i].file;
+            if (!jobs[i].file) {
+                KBELF_LOGE("Unable to find " KBELF_FMT_CSTR, dyn->libs_needed[lib])
+                success = false;
+                continue;
             }
-            for (size_t x = 0; x < dyn->libs_len; x++) {
-                if (kbelfq_streq(dyn->libs_inst[x]->file->name, file)) {
-                    if (depends_on_recursive(dyn, dyn->libs_inst[x], b, recursion_limit - 1)) {
-                        kbelfx_free(needed);
-                        return true;
-                    }
-                }
+            if (!add_name(dyn, jobs[i].file->name, lib, NULL)) {
+                KBELF_LOGE("Out of memory")
+                success = false;
             }
-            kbelfx_free(needed);
+        }
+        if (success && deferred)
+            dyn->libs_inst[lib] = kbelf_inst_load_cached(dyn->libs_file[lib], dyn->pid, dyn->libcache);
+        if (success && !dyn->libs_inst[lib]) {
+            KBELF_LOGE("Unable to load " KBELF_FMT_CSTR, dyn->libs_file[lib]->path)
+            success = false;
         }
     }
+    kbelfi_free(jobs);
+    return success;
+
 abort:
     return false;
 }
 
-// Test whether instance A depends directly or indirectly on instance B.
-static inline bool depends_on(kbelf_dyn dyn, kbelf_inst a, kbelf_inst b) {
-    return depends_on_recursive(dyn, a, b, dyn->libs_len + 1);
+
+// Test whether an instance has init and/or fini functions.
+static inline bool has_init_funcs(kbelf_inst inst) {
+    return kbelf_inst_preinit_len(inst) || kbelf_inst_init_len(inst) || kbelf_inst_fini_len(inst);
 }
 
-// Comparator for sorting function.
-static inline int comparator(kbelf_dyn dyn, size_t a, size_t b) {
-    kbelf_inst la = dyn->libs_inst[a];
-    kbelf_inst lb = dyn->libs_inst[b];
-    if (depends_on(dyn, la, lb)) {
-        return -1;
-    } else if (depends_on(dyn, lb, la)) {
-        return 1;
-    } else {
-        return 0;
+// Compute the initialisation order; dependencies are initialised before the libraries that use them.
+// Libraries that do not depend on each other keep their load order.
+static bool sort_init_order(kbelf_dyn dyn) {
+    size_t  libs_len = dyn->libs_len;
+    size_t *mem      = kbelfi_malloc(sizeof(size_t) * (3 * libs_len + 1 + dyn->deps_len));
+    if (!mem)
+        return false;
+    // Number of dependencies of each library that are not initialised yet.
+    size_t *pending = mem;
+    // Start of the users of each library in `users`.
+    size_t *first   = pending + libs_len;
+    // Libraries that use each library.
+    size_t *users   = first + libs_len + 1;
+    // Libraries in initialisation order.
+    size_t *queue   = users + dyn->deps_len;
+
+    // Build the reverse adjacency list.
+    kbelfq_memset(pending, 0, sizeof(size_t) * (2 * libs_len + 1));
+    for (size_t i = 0; i < dyn->deps_len; i++) {
+        pending[dyn->deps[i].lib]++;
+        first[dyn->deps[i].dep + 1]++;
+    }
+    for (size_t i = 0; i < libs_len; i++) {
+        first[i + 1] += first[i];
+        queue[i]      = first[i];
+    }
+    for (size_t i = 0; i < dyn->deps_len; i++) {
+        users[queue[dyn->deps[i].dep]++] = dyn->deps[i].lib;
     }
-}
 
-// Sort the initialisation order.
-static void sort_init_order_recursive(kbelf_dyn dyn, size_t *arr, size_t len, size_t *tmp) {
-    if (len == 1) {
-        // Base case: 1 element.
-        return;
-    } else if (len == 2) {
-        // Base case: 2 elements.
-        if (comparator(dyn, arr[0], arr[1]) < 0) {
-            size_t tmp = arr[0];
-            arr[0]     = arr[1];
-            arr[1]     = tmp;
+    // Kahn's algorithm.
+    size_t head = 0, tail = 0;
+    for (size_t i = 0; i < libs_len; i++) {
+        if (!pending[i])
+            queue[tail++] = i;
+    }
+    while (head < tail) {
+        size_t lib = queue[head++];
+        for (size_t i = first[lib]; i < first[lib + 1]; i++) {
+            if (!--pending[users[i]])
+                queue[tail++] = users[i];
+        }
+    }
+    if (tail < libs_len) {
+        KBELF_LOGW("Circular library dependencies; initialisation order is not guaranteed")
+        for (size_t i = 0; i < libs_len; i++) {
+            if (pending[i])
+                queue[tail++] = i;
         }
-        return;
     }
 
-    // Determine midpoint.
-    size_t midpoint = len / 2;
+    // Keep only libraries with init and/or fini functions.
+    for (size_t i = 0, li = 0; i < libs_len; i++) {
+        if (has_init_funcs(dyn->libs_inst[queue[i]]))
+            dyn->init_order[li++] = queue[i];
+    }
+    kbelfi_free(mem);
+    return true;
+}
 
-    // Sort left.
-    sort_init_order_recursive(dyn, arr, midpoint, tmp);
+// Make the arrays of initialisation and finalisation functions of an instance present if it is lazily loaded.
+static bool fault_funcs(kbelf_inst inst) {
+    if (!inst->lazy)
+        return true;
+    return kbelf_inst_fault_range(inst, inst->preinit_array, inst->preinit_array_len * sizeof(kbelf_addr))
+           && kbelf_inst_fault_range(inst, inst->init_array, inst->init_array_len * sizeof(kbelf_addr))
+           && kbelf_inst_fault_range(inst, inst->fini_array, inst->fini_array_len * sizeof(kbelf_addr));
+}
 
-    // Sort right.
-    sort_init_order_recursive(dyn, arr + midpoint, len - midpoint, tmp);
+// Resolve the pre-initialisation, initialisation and finalisation functions of a relocated process image into
+// one array in running order. Called again after the process image moved.
+// Returns success status.
+static bool resolve_funcs(kbelf_dyn dyn) {
+    size_t len = dyn->preinit_len + dyn->init_len + dyn->fini_len;
+    if (!len)
+        return true;
+    if (!dyn->funcs) {
+        dyn->funcs = kbelfi_arena_alloc(&dyn->arena, sizeof(kbelf_addr) * len);
+        if (!dyn->funcs)
+            KBELF_ERROR(abort, "Out of memory")
+    }
+    if (!fault_funcs(dyn->exec_inst))
+        KBELF_ERROR(abort, "I/O error")
+    for (size_t i = 0; i < dyn->init_order_len; i++) {
+        if (!fault_funcs(dyn->libs_inst[dyn->init_order[i]]))
+            KBELF_ERROR(abort, "I/O error")
+    }
 
-    // Merge.
-    for (size_t i = 0, l = 0, r = 0; i < len; i++) {
-        if (r < len - midpoint && comparator(dyn, arr[l], arr[r]) < 0) {
-            // Take from the right.
-            tmp[i] = arr[r++];
-        } else {
-            // Take from the left.
-            tmp[i] = arr[l++];
-        }
+    // Pre-initialisation functions only come from the executable.
+    kbelf_addr *func = dyn->funcs;
+    for (size_t i = 0; i < dyn->preinit_len; i++) {
+        *func++ = kbelf_inst_preinit_get(dyn->exec_inst, i);
     }
-    kbelfq_memcpy(arr, tmp, sizeof(size_t) * len);
-}
 
-// Sort the initialisation order.
-static inline bool sort_init_order(kbelf_dyn dyn) {
-    if (dyn->init_order_len) {
-        size_t *tmp = kbelfx_malloc(sizeof(size_t) * dyn->init_order_len);
-        if (!tmp)
-            return false;
-        sort_init_order_recursive(dyn, dyn->init_order, dyn->init_order_len, tmp);
-        kbelfx_free(tmp);
+    // Initialisation functions of the executable first, then the libraries in initialisation order.
+    // Finalisers are run in the opposite order.
+    kbelf_addr *fini = dyn->funcs + len;
+    for (size_t i = 0; i < kbelf_inst_init_len(dyn->exec_inst); i++) {
+        *func++ = kbelf_inst_init_get(dyn->exec_inst, i);
+    }
+    for (size_t i = 0; i < kbelf_inst_fini_len(dyn->exec_inst); i++) {
+        *--fini = kbelf_inst_fini_get(dyn->exec_inst, i);
+    }
+    for (size_t x = 0; x < dyn->init_order_len; x++) {
+        kbelf_inst inst = dyn->libs_inst[dyn->init_order[x]];
+        for (size_t i = 0; i < kbelf_inst_init_len(inst); i++) {
+            *func++ = kbelf_inst_init_get(inst, i);
+        }
+        for (size_t i = 0; i < kbelf_inst_fini_len(inst); i++) {
+            *--fini = kbelf_inst_fini_get(inst, i);
+        }
     }
     return true;
+
+abort:
+    return false;
 }
 
 
@@ -334,32 +695,40 @@ static inline bool sort_init_order(kbelf_dyn dyn) {
 // Returns success status.
 bool kbelf_dyn_load(kbelf_dyn dyn) {
     kbelf_reloc reloc = NULL;
-    if (!dyn)
+    if (!dyn || dyn->finalized)
         return false;
+    kbelf_stats *prev = kbelfi_stats_swap(dyn_stats(dyn));
     if (!dyn->exec_file)
         KBELF_ERROR(abort, "No executable file")
 
     // Load the executable.
-    dyn->exec_inst = kbelf_inst_load(dyn->exec_file, dyn->pid);
+    dyn->exec_inst = dyn->lazy ? kbelf_inst_load_lazy(dyn->exec_file, dyn->pid)
+                               : kbelf_inst_load(dyn->exec_file, dyn->pid);
     if (!dyn->exec_inst)
         KBELF_ERROR(abort, "Unable to load " KBELF_FMT_CSTR, dyn->exec_file->path)
 
     // Load libraries for the executable.
-    if (!check_deps(dyn, dyn->exec_file, dyn->exec_inst))
+    if (!check_deps(dyn, dyn->exec_file, dyn->exec_inst, SIZE_MAX))
         KBELF_ERROR(abort, "Unable to satisfy library requirements")
 
-    // Check dependencies for the libraries.
-    for (size_t i = 0; i < dyn->libs_len; i++) {
-        if (!dyn->libs_inst[i]) {
-            dyn->libs_inst[i] = kbelf_inst_load(dyn->libs_file[i], dyn->pid);
-            if (!dyn->libs_inst[i])
-                KBELF_ERROR(abort, "Unable to load " KBELF_FMT_CSTR, dyn->libs_file[i]->path)
+    // Load the libraries and check their dependencies.
+    // In parallel mode, all libraries found at one dependency level are loaded at once.
+    for (size_t i = 0; i < dyn->libs_len;) {
+        size_t end = dyn->parallel ? dyn->libs_len : i + 1;
+        if (!load_libs(dyn, i, end))
+            goto abort;
+        for (; i < end; i++) {
+            if (!add_soname(dyn, i))
+                goto abort;
+            if (!check_deps(dyn, dyn->libs_file[i], dyn->libs_inst[i], i))
+                KBELF_ERROR(abort, "Unable to satisfy library requirements")
         }
-        if (!check_deps(dyn, dyn->libs_file[i], dyn->libs_inst[i]))
-            KBELF_ERROR(abort, "Unable to satisfy library requirements")
     }
 
     // Count the number of libs with init and/or fini functions.
+    dyn->preinit_len = kbelf_inst_preinit_len(dyn->exec_inst);
+    dyn->init_len    = kbelf_inst_init_len(dyn->exec_inst);
+    dyn->fini_len    = kbelf_inst_fini_len(dyn->exec_inst);
     for (size_t i = 0; i < dyn->libs_len; i++) {
         dyn->init_order_len += has_init_funcs(dyn->libs_inst[i]);
         dyn->init_len       += kbelf_inst_init_len(dyn->libs_inst[i]);
@@ -368,132 +737,453 @@ bool kbelf_dyn_load(kbelf_dyn dyn) {
 
     // Allocate memory.
     if (dyn->init_order_len) {
-        dyn->init_order = kbelfx_malloc(sizeof(size_t) * dyn->init_order_len);
+        dyn->init_order = kbelfi_arena_alloc(&dyn->arena, sizeof(size_t) * dyn->init_order_len);
         if (!dyn->init_order)
             KBELF_ERROR(abort, "Out of memory")
     }
 
-    // Compute initialisation order.
-    for (size_t i = 0, li = 0; i < dyn->libs_len; i++) {
-        if (has_init_funcs(dyn->libs_inst[i])) {
-            dyn->init_order[li] = i;
-            li++;
+    // Restore a previously relocated image if the exact same one is cached.
+    bool     use_imgcache = dyn->imgcache && !dyn->lazy && !dyn->keep_fixups;
+    uint64_t imgcache_key = use_imgcache ? kbelfi_imgcache_key(dyn) : 0;
+    if (!use_imgcache || !kbelfi_imgcache_restore(dyn, imgcache_key)) {
+        // Compute initialisation order.
+        KBELF_TRACE_BEGIN(KBELF_PHASE_INIT_ORDER, dyn->exec_file->name)
+        bool sorted = sort_init_order(dyn);
+        KBELF_TRACE_END(KBELF_PHASE_INIT_ORDER, dyn->exec_file->name, sorted ? dyn->libs_len : 0)
+        if (!sorted)
+            KBELF_ERROR(abort, "Out of memory")
+
+        // Perform relocation.
+        reloc = kbelf_reloc_create();
+        if (!reloc)
+            KBELF_ERROR(abort, "Out of memory")
+        kbelf_reloc_set_keep_fixups(reloc, dyn->keep_fixups);
+        for (size_t i = 0; i < dyn->builtins_len; i++) {
+            if (!kbelf_reloc_add_builtin(reloc, dyn->builtins[i]))
+                KBELF_ERROR(abort, "Out of memory")
         }
+        if (!kbelf_reloc_add(reloc, dyn->exec_file, dyn->exec_inst))
+            KBELF_ERROR(abort, "Out of memory")
+        for (size_t i = 0; i < dyn->libs_len; i++) {
+            if (!kbelf_reloc_add(reloc, dyn->libs_file[i], dyn->libs_inst[i]))
+                KBELF_ERROR(abort, "Out of memory")
+        }
+        if (!kbelf_reloc_perform(reloc))
+            KBELF_ERROR(abort, "Relocation failed")
+        kbelf_reloc_destroy(reloc);
+        reloc = NULL;
+
+        // Cache the relocated image for the next time.
+        if (use_imgcache)
+            kbelfi_imgcache_save(dyn, imgcache_key);
     }
-    if (!sort_init_order(dyn))
-        KBELF_ERROR(abort, "Out of memory");
 
-    // Perform relocation.
-    reloc = kbelf_reloc_create();
-    for (size_t i = 0; i < dyn->builtins_len; i++) {
-        if (!kbelf_reloc_add_builtin(reloc, dyn->builtins[i]))
-            KBELF_ERROR(abort, "Out of memory")
+    // Synchronize caches for all loaded segments.
+    // Lazily loaded pages are synchronized by `kbelf_inst_fault` instead.
+    if (!dyn->lazy)
+        kbelfi_cache_sync_insts(dyn->exec_inst, dyn->libs_len, dyn->libs_inst);
+
+    // Share read-only library segments with future processes.
+    for (size_t i = 0; dyn->libcache && !dyn->lazy && i < dyn->libs_len; i++) {
+        if (!kbelf_libcache_add(dyn->libcache, dyn->libs_inst[i]))
+            KBELF_LOGW("Unable to share segments of " KBELF_FMT_CSTR, dyn->libs_file[i]->path)
     }
-    if (!kbelf_reloc_add(reloc, dyn->exec_file, dyn->exec_inst))
-        KBELF_ERROR(abort, "Out of memory")
+
+    // Resolve the initialisation and finalisation functions.
+    if (!resolve_funcs(dyn))
+        goto abort;
+
+    // Success.
+    dyn->entrypoint = dyn->exec_inst->entry;
+    kbelfi_stats_swap(prev);
+    return true;
+
+// Error.
+abort:
+    kbelf_reloc_destroy(reloc);
+    kbelf_dyn_unload(dyn);
+    kbelfi_stats_swap(prev);
+    return false;
+}
+
+// Find the copy of an instance in a cloned process image.
+static kbelf_inst clone_find_inst(kbelf_dyn dyn, kbelf_dyn clone, kbelf_inst inst) {
+    if (inst == dyn->exec_inst)
+        return clone->exec_inst;
     for (size_t i = 0; i < dyn->libs_len; i++) {
-        if (!kbelf_reloc_add(reloc, dyn->libs_file[i], dyn->libs_inst[i]))
-            KBELF_ERROR(abort, "Out of memory")
+        if (inst == dyn->libs_inst[i])
+            return clone->libs_inst[i];
     }
-    if (!kbelf_reloc_perform(reloc))
-        KBELF_ERROR(abort, "Relocation failed")
-    kbelf_reloc_destroy(reloc);
+    return inst;
+}
 
-    // Synchronize caches for all loaded segments.
-    for (size_t i = 0; i < dyn->exec_inst->segments_len; i++) {
-        kbelf_segment *seg = &dyn->exec_inst->segments[i];
-        kbelfx_cache_sync(seg->laddr, seg->size);
+// Point the kept relocations of a copied instance at the copies of the instances that define their symbols.
+static void clone_remap_fixups(kbelf_dyn dyn, kbelf_dyn clone, kbelf_inst inst) {
+    for (size_t i = 0; i < inst->fixups_len; i++) {
+        if (inst->fixups[i].def)
+            inst->fixups[i].def = clone_find_inst(dyn, clone, inst->fixups[i].def);
+    }
+}
+
+// Copy a loaded process image into a new process without reading the files again.
+// Returns non-null on success, NULL on error.
+kbelf_dyn kbelf_dyn_clone(kbelf_dyn dyn, int pid) {
+    if (!dyn || !dyn->exec_inst)
+        return NULL;
+    if (dyn->lazy)
+        KBELF_ERROR(abort_early, "Unable to clone a lazily loaded process image")
+    if (dyn->finalized)
+        KBELF_ERROR(abort_early, "Unable to clone a finalized process image")
+
+    kbelf_dyn clone = kbelf_dyn_create(pid);
+    if (!clone)
+        KBELF_ERROR(abort_early, "Out of memory")
+    kbelf_stats *prev = kbelfi_stats_swap(dyn_stats(clone));
+    clone->keep_fixups = dyn->keep_fixups;
+    clone->libcache    = dyn->libcache;
+
+    // Copy the file references and library tables.
+    clone->exec_file = kbelf_file_ref(dyn->exec_file);
+    if (dyn->libs_len) {
+        clone->libs_file = kbelfi_arena_alloc(&clone->arena, dyn->libs_len * sizeof(kbelf_file));
+        clone->libs_inst = kbelfi_arena_alloc(&clone->arena, dyn->libs_len * sizeof(kbelf_inst));
+        if (!clone->libs_file || !clone->libs_inst)
+            KBELF_ERROR(abort, "Out of memory")
+        kbelfq_memset(clone->libs_inst, 0, dyn->libs_len * sizeof(kbelf_inst));
+        for (size_t i = 0; i < dyn->libs_len; i++) {
+            clone->libs_file[i] = kbelf_file_ref(dyn->libs_file[i]);
+        }
+        clone->libs_len = dyn->libs_len;
+        clone->libs_cap = dyn->libs_len;
     }
+    if (dyn->builtins_len) {
+        clone->builtins = kbelfi_arena_alloc(&clone->arena, dyn->builtins_len * sizeof(kbelf_builtin_lib *));
+        if (!clone->builtins)
+            KBELF_ERROR(abort, "Out of memory")
+        kbelfq_memcpy(clone->builtins, dyn->builtins, dyn->builtins_len * sizeof(kbelf_builtin_lib *));
+        clone->builtins_len = dyn->builtins_len;
+    }
+    if (dyn->init_order_len) {
+        clone->init_order = kbelfi_arena_alloc(&clone->arena, dyn->init_order_len * sizeof(size_t));
+        if (!clone->init_order)
+            KBELF_ERROR(abort, "Out of memory")
+        kbelfq_memcpy(clone->init_order, dyn->init_order, dyn->init_order_len * sizeof(size_t));
+        clone->init_order_len = dyn->init_order_len;
+    }
+    clone->preinit_len = dyn->preinit_len;
+    clone->init_len    = dyn->init_len;
+    clone->fini_len    = dyn->fini_len;
+
+    // Copy the instances.
+    bool moved       = false;
+    clone->exec_inst = kbelfi_inst_clone(dyn->exec_inst, pid);
+    if (!clone->exec_inst)
+        KBELF_ERROR(abort, "Unable to clone " KBELF_FMT_CSTR, dyn->exec_file->path)
+    moved |= kbelfi_inst_moved(dyn->exec_inst, clone->exec_inst);
     for (size_t i = 0; i < dyn->libs_len; i++) {
-        for (size_t j = 0; j < dyn->libs_inst[i]->segments_len; j++) {
-            kbelf_segment *seg = &dyn->libs_inst[i]->segments[j];
-            kbelfx_cache_sync(seg->laddr, seg->size);
+        clone->libs_inst[i] = kbelfi_inst_clone(dyn->libs_inst[i], pid);
+        if (!clone->libs_inst[i])
+            KBELF_ERROR(abort, "Unable to clone " KBELF_FMT_CSTR, dyn->libs_file[i]->path)
+        moved |= kbelfi_inst_moved(dyn->libs_inst[i], clone->libs_inst[i]);
+    }
+
+    // Relocate again if anything moved.
+    clone_remap_fixups(dyn, clone, clone->exec_inst);
+    for (size_t i = 0; i < clone->libs_len; i++) {
+        clone_remap_fixups(dyn, clone, clone->libs_inst[i]);
+    }
+    if (moved) {
+        if (!kbelfi_inst_reapply(clone->exec_inst))
+            KBELF_ERROR(abort, "Relocation failed")
+        for (size_t i = 0; i < clone->libs_len; i++) {
+            if (!kbelfi_inst_reapply(clone->libs_inst[i]))
+                KBELF_ERROR(abort, "Relocation failed")
         }
     }
+    if (!resolve_funcs(clone))
+        goto abort;
+
+    // Synchronize caches for all copied segments.
+    kbelfi_cache_sync_insts(clone->exec_inst, clone->libs_len, clone->libs_inst);
 
     // Success.
+    clone->entrypoint = clone->exec_inst->entry;
+    kbelfi_stats_swap(prev);
+    return clone;
+
+// Error.
+abort:
+    kbelf_dyn_unload(clone);
+    kbelfi_stats_swap(prev);
+    kbelf_dyn_destroy(clone);
+abort_early:
+    return NULL;
+}
+
+// Move the segments of one instance in a loaded process image to new addresses.
+// Returns success status.
+bool kbelf_dyn_rebase(kbelf_dyn dyn, kbelf_inst inst, kbelf_segment const *new_segments) {
+    if (!dyn || !dyn->exec_inst || !inst || !new_segments)
+        return false;
+    kbelf_stats *prev = kbelfi_stats_swap(dyn_stats(dyn));
+    if (dyn->finalized)
+        KBELF_ERROR(abort, "Unable to rebase a finalized process image")
+    bool found = inst == dyn->exec_inst;
+    for (size_t i = 0; i < dyn->libs_len; i++) {
+        found |= dyn->libs_inst[i] == inst;
+    }
+    if (!found)
+        KBELF_ERROR(abort, "Instance is not part of this process image")
+
+    // Move the instance itself; the function addresses in the symbol index move with it.
+    kbelfi_symidx_free(dyn);
+    if (!kbelfi_inst_move(inst, new_segments) || !kbelfi_inst_reapply(inst))
+        goto abort;
+
+    // Fix up references from the other instances.
+    if (inst != dyn->exec_inst && !kbelfi_inst_reapply_from(dyn->exec_inst, inst))
+        goto abort;
+    for (size_t i = 0; i < dyn->libs_len; i++) {
+        if (dyn->libs_inst[i] != inst && !kbelfi_inst_reapply_from(dyn->libs_inst[i], inst))
+            goto abort;
+    }
+    if (!resolve_funcs(dyn))
+        goto abort;
+
+    // Synchronize caches for all segments that may have been written.
+    kbelfi_cache_sync_insts(dyn->exec_inst, dyn->libs_len, dyn->libs_inst);
+
     dyn->entrypoint = dyn->exec_inst->entry;
+    kbelfi_stats_swap(prev);
     return true;
 
-// Error.
 abort:
-    kbelf_reloc_destroy(reloc);
-    kbelf_dyn_unload(dyn);
+    kbelfi_stats_swap(prev);
     return false;
 }
 
+// Load and relocate the page containing a virtual address in a lazily loaded process image.
+// Returns true if the page is present afterwards, false if the address is not in the process image or on error.
+bool kbelf_dyn_fault(kbelf_dyn dyn, kbelf_addr vaddr) {
+    if (!dyn || !dyn->exec_inst)
+        return false;
+    kbelf_stats *prev    = kbelfi_stats_swap(dyn_stats(dyn));
+    bool         present = kbelf_inst_fault(dyn->exec_inst, vaddr);
+    for (size_t i = 0; !present && i < dyn->libs_len; i++) {
+        present = kbelf_inst_fault(dyn->libs_inst[i], vaddr);
+    }
+    kbelfi_stats_swap(prev);
+    return present;
+}
 
+// Get an instance of a loaded process image by index; the executable is first, followed by the libraries.
+static inline kbelf_inst get_inst(kbelf_dyn dyn, size_t i) {
+    return i ? dyn->libs_inst[i - 1] : dyn->exec_inst;
+}
+
+// Round the size of a part of the block made by `kbelf_dyn_finalize` up to keep the next part aligned.
+static inline size_t final_align(size_t size) {
+    size_t align = sizeof(kbelf_addr) > sizeof(void *) ? sizeof(kbelf_addr) : sizeof(void *);
+    return (size + align - 1) / align * align;
+}
+
+// Move the metadata that a loaded process image still needs into a single allocation and free everything else.
+// Returns success status.
+bool kbelf_dyn_finalize(kbelf_dyn dyn) {
+    if (!dyn || !dyn->exec_inst)
+        return false;
+    if (dyn->finalized)
+        return true;
+    kbelf_stats *prev = kbelfi_stats_swap(dyn_stats(dyn));
+    if (dyn->lazy)
+        KBELF_ERROR(abort, "Unable to finalize a lazily loaded process image")
+
+    // Measure the compacted metadata.
+    size_t insts_len    = dyn->libs_len + 1;
+    size_t segments_len = 0;
+    size_t funcs_len    = dyn->preinit_len + dyn->init_len + dyn->fini_len;
+    for (size_t i = 0; i < insts_len; i++) {
+        segments_len += get_inst(dyn, i)->segments_len;
+    }
+
+    // Allocate the block.
+    size_t segments_off = final_align(sizeof(struct struct_kbelf_inst) * insts_len);
+    size_t index_off    = segments_off + final_align(sizeof(kbelf_segment) * segments_len);
+    size_t funcs_off    = index_off + final_align(sizeof(size_t) * KBELF_SPACE_COUNT * segments_len);
+    size_t ptrs_off     = funcs_off + final_align(sizeof(kbelf_addr) * funcs_len);
+    char  *block        = kbelfi_malloc(ptrs_off + sizeof(kbelf_inst) * insts_len);
+    if (!block)
+        KBELF_ERROR(abort, "Out of memory")
+    struct struct_kbelf_inst *insts    = (struct struct_kbelf_inst *)block;
+    kbelf_segment            *segments = (kbelf_segment *)(block + segments_off);
+    size_t                   *index    = (size_t *)(block + index_off);
+    kbelf_addr               *funcs    = (kbelf_addr *)(block + funcs_off);
+    kbelf_inst               *ptrs     = (kbelf_inst *)(block + ptrs_off);
+
+    // Copy the functions.
+    if (funcs_len)
+        kbelfq_memcpy(funcs, dyn->funcs, sizeof(kbelf_addr) * funcs_len);
+
+    // Copy the instances and their segments, then free the originals.
+    for (size_t i = 0; i < insts_len; i++) {
+        kbelf_inst inst = get_inst(dyn, i);
+        kbelfq_memcpy(segments, inst->segments, sizeof(kbelf_segment) * inst->segments_len);
+        insts[i]                    = *inst;
+        insts[i].file               = NULL;
+        insts[i].compact            = true;
+        insts[i].segments           = segments;
+        insts[i].seg_index          = NULL;
+        insts[i].lazy_present       = NULL;
+        insts[i].fixups_kept        = false;
+        insts[i].fixups_len         = 0;
+        insts[i].fixups             = NULL;
+        insts[i].dyninfo.needed_len = 0;
+        insts[i].dyninfo.needed     = NULL;
+        ptrs[i]                     = &insts[i];
+        segments                   += inst->segments_len;
+        if (inst->seg_index) {
+            kbelfq_memcpy(index, inst->seg_index, sizeof(size_t) * KBELF_SPACE_COUNT * inst->segments_len);
+            insts[i].seg_index  = index;
+            index              += KBELF_SPACE_COUNT * inst->segments_len;
+        }
+        kbelf_inst_destroy(inst);
+    }
+
+    // Release the files and the loading metadata.
+    kbelf_file_close(dyn->exec_file);
+    for (size_t i = 0; i < dyn->libs_len; i++) {
+        kbelf_file_close(dyn->libs_file[i]);
+    }
+    kbelfi_arena_free(&dyn->arena);
+    dyn->exec_file      = NULL;
+    dyn->exec_inst      = ptrs[0];
+    dyn->libs_cap       = 0;
+    dyn->libs_file      = NULL;
+    dyn->libs_inst      = ptrs + 1;
+    dyn->libs_needed    = NULL;
+    dyn->builtins_len   = 0;
+    dyn->builtins_cap   = 0;
+    dyn->builtins       = NULL;
+    dyn->init_order_len = 0;
+    dyn->init_order     = NULL;
+    dyn->deps_len       = 0;
+    dyn->deps_cap       = 0;
+    dyn->deps           = NULL;
+    dyn->names_cap      = 0;
+    dyn->names_len      = 0;
+    dyn->names          = NULL;
+
+    dyn->builtin_names     = NULL;
+    dyn->builtin_names_cap = 0;
+
+    dyn->finalized   = true;
+    dyn->final_block = block;
+    dyn->funcs       = funcs;
+    kbelfi_stats_swap(prev);
+    return true;
+
+abort:
+    kbelfi_stats_swap(prev);
+    return false;
+}
+
+// Pass the memory of a loaded process image that only holds relocation and symbol tables to `kbelfx_seg_discard`.
+// Returns the number of bytes discarded.
+kbelf_addr kbelf_dyn_reclaim(kbelf_dyn dyn) {
+    if (!dyn || !dyn->exec_inst || dyn->lazy)
+        return 0;
+    kbelf_stats *prev  = kbelfi_stats_swap(dyn_stats(dyn));
+    kbelf_addr   total = kbelf_inst_reclaim(dyn->exec_inst, dyn->keep_symbols);
+    for (size_t i = 0; i < dyn->libs_len; i++) {
+        total += kbelf_inst_reclaim(dyn->libs_inst[i], dyn->keep_symbols);
+    }
+    kbelfi_stats_swap(prev);
+    return total;
+}
+
+
+
+// Copy the statistics counted while loading a process image.
+// Returns false if statistics are not counted, in which case `stats` is cleared.
+bool kbelf_dyn_get_stats(kbelf_dyn dyn, kbelf_stats *stats) {
+    if (!stats)
+        return false;
+#if KBELF_STATS
+    if (dyn) {
+        *stats = dyn->stats;
+        return true;
+    }
+#else
+    (void)dyn;
+#endif
+    kbelfq_memset(stats, 0, sizeof(kbelf_stats));
+    return false;
+}
 
 // Get the number of pre-initialisation functions for the process.
 size_t kbelf_dyn_preinit_len(kbelf_dyn dyn) {
-    return dyn && dyn->exec_inst ? kbelf_inst_preinit_len(dyn->exec_inst) : 0;
+    return dyn && dyn->funcs ? dyn->preinit_len : 0;
 }
 
 // Get the virtual address of an initialisation function by index.
 // Functions are sorted; the first index is the first in the running order.
 kbelf_addr kbelf_dyn_preinit_get(kbelf_dyn dyn, size_t i) {
-    return dyn && dyn->exec_inst ? kbelf_inst_preinit_get(dyn->exec_inst, i) : 0;
+    return i < kbelf_dyn_preinit_len(dyn) ? dyn->funcs[i] : 0;
+}
+
+// Copy the virtual addresses of up to `cap` pre-initialisation functions in running order.
+// Returns the number of addresses copied.
+size_t kbelf_dyn_preinit_copy(kbelf_dyn dyn, kbelf_addr *out, size_t cap) {
+    size_t len = kbelf_dyn_preinit_len(dyn);
+    if (len > cap)
+        len = cap;
+    if (len)
+        kbelfq_memcpy(out, dyn->funcs, sizeof(kbelf_addr) * len);
+    return len;
 }
 
 // Get the number of initialisation functions for the process.
 size_t kbelf_dyn_init_len(kbelf_dyn dyn) {
-    return dyn ? dyn->init_len : 0;
+    return dyn && dyn->funcs ? dyn->init_len : 0;
 }
 
 // Get the virtual address of an initialisation function by index.
 // Functions are sorted; the first index is the first in the running order.
 kbelf_addr kbelf_dyn_init_get(kbelf_dyn dyn, size_t i) {
-    if (!dyn || i >= dyn->init_len)
-        return 0;
-
-    // Executable first.
-    size_t len = kbelf_inst_init_len(dyn->exec_inst);
-    if (i < len) {
-        return kbelf_inst_init_get(dyn->exec_inst, i);
-    }
-    i -= len;
-
-    // Libraries second.
-    for (size_t x = 0; x < dyn->init_order_len; x++) {
-        len = kbelf_inst_init_len(dyn->libs_inst[dyn->init_order[x]]);
-        if (i < len)
-            return kbelf_inst_init_get(dyn->libs_inst[dyn->init_order[x]], i);
-        i -= len;
-    }
+    return i < kbelf_dyn_init_len(dyn) ? dyn->funcs[dyn->preinit_len + i] : 0;
+}
 
-    return 0;
+// Copy the virtual addresses of up to `cap` initialisation functions in running order.
+// Returns the number of addresses copied.
+size_t kbelf_dyn_init_copy(kbelf_dyn dyn, kbelf_addr *out, size_t cap) {
+    size_t len = kbelf_dyn_init_len(dyn);
+    if (len > cap)
+        len = cap;
+    if (len)
+        kbelfq_memcpy(out, dyn->funcs + dyn->preinit_len, sizeof(kbelf_addr) * len);
+    return len;
 }
 
 // Get the number of finalisation functions for the process.
 size_t kbelf_dyn_fini_len(kbelf_dyn dyn) {
-    return dyn ? dyn->fini_len : 0;
+    return dyn && dyn->funcs ? dyn->fini_len : 0;
 }
 
 // Get the virtual address of an finalisation function by index.
 // Functions are sorted; the first index is the first in the running order.
 kbelf_addr kbelf_dyn_fini_get(kbelf_dyn dyn, size_t i) {
-    if (!dyn || i >= dyn->fini_len)
-        return 0;
-
-    // Finaliser order is to opposite of initialiser order.
-    i = dyn->fini_len - i - 1;
-
-    // Executable first.
-    size_t len = kbelf_inst_fini_len(dyn->exec_inst);
-    if (i < len) {
-        return kbelf_inst_fini_get(dyn->exec_inst, i);
-    }
-    i -= len;
-
-    // Libraries second.
-    for (size_t x = 0; x < dyn->init_order_len; x++) {
-        len = kbelf_inst_fini_len(dyn->libs_inst[dyn->init_order[x]]);
-        if (i < len)
-            return kbelf_inst_fini_get(dyn->libs_inst[dyn->init_order[x]], i);
-        i -= len;
-    }
+    return i < kbelf_dyn_fini_len(dyn) ? dyn->funcs[dyn->preinit_len + dyn->init_len + i] : 0;
+}
 
-    return 0;
+// Copy the virtual addresses of up to `cap` finalisation functions in running order.
+// Returns the number of addresses copied.
+size_t kbelf_dyn_fini_copy(kbelf_dyn dyn, kbelf_addr *out, size_t cap) {
+    size_t len = kbelf_dyn_fini_len(dyn);
+    if (len > cap)
+        len = cap;
+    if (len)
+        kbelfq_memcpy(out, dyn->funcs + dyn->preinit_len + dyn->init_len, sizeof(kbelf_addr) * len);
+    return len;
 }
 
 // Get the entrypoint address of the process.
@@ -24,6 +24,7 @@
 
 #define KBELF_REVEAL_PRIVATE
 #include <kbelf.h>
+#include <kbelf/internal.h>
 #include <kbelf/port.h>
 
 // Create a context for interpreting an ELF file.
@@ -32,26 +33,29 @@
 // KBELF calls `kbelfx_close` on `fd` when `kbelf_file_close` is called on an `kbelf_file` or when `kbelf_file_open`
 // fails. Returns non-null on success, NULL on error.
 kbelf_file kbelf_file_open(char const *path, void *fd) {
+    KBELF_TRACE_BEGIN(KBELF_PHASE_OPEN, path)
+
     // Allocate memories.
-    kbelf_file file = kbelfx_malloc(sizeof(struct struct_kbelf_file));
+    kbelf_file file = kbelfi_malloc(sizeof(struct struct_kbelf_file));
     if (!file)
-        KBELF_ERROR(abort, "Out of memory")
+        KBELF_ERROR(abort_open, "Out of memory")
     kbelfq_memset(file, 0, sizeof(struct struct_kbelf_file));
+    file->refcount = 1;
 
     // Try to open file handle.
     if (!fd) {
         fd = kbelfx_open(path);
         if (!fd)
-            KBELF_ERROR(abort, "File not found: " KBELF_FMT_CSTR, path)
+            KBELF_ERROR(abort_open, "File not found: " KBELF_FMT_CSTR, path)
     }
     file->fd = fd;
 
 
     // Create a copy of path.
     size_t path_len = kbelfq_strlen(path);
-    file->path      = kbelfx_malloc(path_len + 1);
+    file->path      = kbelfi_malloc(path_len + 1);
     if (!file->path)
-        KBELF_ERROR(abort, "Out of memory")
+        KBELF_ERROR(abort_open, "Out of memory")
     kbelfq_strcpy(file->path, path);
 
     // Find filename.
@@ -62,13 +66,15 @@ kbelf_file kbelf_file_open(char const *path, void *fd) {
         c0 = c1;
 #endif
     file->name = c0 ? c0 + 1 : file->path;
+    KBELF_TRACE_END(KBELF_PHASE_OPEN, path, 0)
 
 
     // Load header.
-    long len = kbelfx_read(file->fd, &file->header, sizeof(file->header));
+    KBELF_TRACE_BEGIN(KBELF_PHASE_HEADER, file->name)
+    long len = kbelfi_read(file->fd, &file->header, sizeof(file->header));
     if (len != sizeof(file->header))
         KBELF_ERROR(
-            abort,
+            abort_header,
             "I/O error: expected " KBELF_FMT_SIZE " bytes, got " KBELF_FMT_SIZE " bytes",
             sizeof(file->header),
             (size_t)len
@@ -77,41 +83,78 @@ kbelf_file kbelf_file_open(char const *path, void *fd) {
 
     // Validate header.
     if (!kbelfq_memeq(file->header.magic, kbelf_magic, 4))
-        KBELF_ERROR(abort, "Invalid magic")
+        KBELF_ERROR(abort_header, "Invalid magic")
     if (file->header.word_size != KBELF_CLASS)
-        KBELF_ERROR(abort, "Invalid or unsupported class")
+        KBELF_ERROR(abort_header, "Invalid or unsupported class")
     if (file->header.endianness != KBELF_ENDIANNESS)
-        KBELF_ERROR(abort, "Invalid or unsupported endianness")
+        KBELF_ERROR(abort_header, "Invalid or unsupported endianness")
     if (file->header.version != 1)
-        KBELF_ERROR(abort, "Invalid or unsupported version")
+        KBELF_ERROR(abort_header, "Invalid or unsupported version")
 
     if (file->header.type != ET_DYN && file->header.type != ET_EXEC)
-        KBELF_ERROR(abort, "Unsupported type")
+        KBELF_ERROR(abort_header, "Unsupported type")
     if (file->header.machine != kbelf_machine_type)
-        KBELF_ERROR(abort, "Unsupported machine")
+        KBELF_ERROR(abort_header, "Unsupported machine")
     if (file->header.version2 != 1)
-        KBELF_ERROR(abort, "Invalid or unsupported version2")
+        KBELF_ERROR(abort_header, "Invalid or unsupported version2")
 
     if (file->header.size != sizeof(file->header))
-        KBELF_ERROR(abort, "Invalid header size")
+        KBELF_ERROR(abort_header, "Invalid header size")
     if (file->header.ph_ent_size != sizeof(kbelf_progheader))
-        KBELF_ERROR(abort, "Invalid program header entry size")
+        KBELF_ERROR(abort_header, "Invalid program header entry size")
     if (file->header.sh_ent_size != sizeof(kbelf_sectheader))
-        KBELF_ERROR(abort, "Invalid section header entry size")
+        KBELF_ERROR(abort_header, "Invalid section header entry size")
 
     // Architecture-specific verification.
     if (!kbelfp_file_verify(file))
-        goto abort;
+        goto abort_header;
+    KBELF_TRACE_END(KBELF_PHASE_HEADER, file->name, sizeof(file->header))
+
+    // Load program headers.
+    KBELF_TRACE_BEGIN(KBELF_PHASE_PROGHEADERS, file->name)
+    if (file->header.ph_ent_num) {
+        size_t prog_sz = sizeof(kbelf_progheader) * file->header.ph_ent_num;
+        file->prog     = kbelfi_malloc(prog_sz);
+        if (!file->prog)
+            KBELF_ERROR(abort_progheaders, "Out of memory")
+        if (kbelfi_seek(file->fd, (long)file->header.ph_offset) < 0)
+            KBELF_ERROR(abort_progheaders, "I/O error")
+        len = kbelfi_read(file->fd, file->prog, (long)prog_sz);
+        if (len != (long)prog_sz)
+            KBELF_ERROR(
+                abort_progheaders,
+                "I/O error: expected " KBELF_FMT_SIZE " bytes, got " KBELF_FMT_SIZE " bytes",
+                prog_sz,
+                (size_t)len
+            )
+    }
+    KBELF_TRACE_END(KBELF_PHASE_PROGHEADERS, file->name, file->header.ph_ent_num)
 
     // Successfully opened.
     return file;
 
 // Some sort of error occurred.
+abort_progheaders:
+    KBELF_TRACE_END(KBELF_PHASE_PROGHEADERS, file->name, 0)
+    goto abort;
+abort_header:
+    KBELF_TRACE_END(KBELF_PHASE_HEADER, file->name, 0)
+    goto abort;
+abort_open:
+    KBELF_TRACE_END(KBELF_PHASE_OPEN, path, 0)
 abort:
     kbelf_file_close(file);
     return NULL;
 }
 
+// Take another reference to a `kbelf_file` context.
+// Each reference is dropped with `kbelf_file_close`.
+kbelf_file kbelf_file_ref(kbelf_file file) {
+    if (file)
+        file->refcount++;
+    return file;
+}
+
 // Get the file descriptor in use by the `kbelf_file`.
 void *kbelf_file_getfd(kbelf_file file) {
     return file->fd;
@@ -122,13 +165,19 @@ void *kbelf_file_getfd(kbelf_file file) {
 void kbelf_file_close(kbelf_file file) {
     if (!file)
         return;
+    if (--file->refcount)
+        return;
+    if (file->prog)
+        kbelfi_free(file->prog);
     if (file->strtab)
-        kbelfx_free(file->strtab);
+        kbelfi_free(file->strtab);
+    if (file->shstr)
+        kbelfi_free(file->shstr);
     if (file->path)
-        kbelfx_free(file->path);
+        kbelfi_free(file->path);
     if (file->fd)
         kbelfx_close(file->fd);
-    kbelfx_free(file);
+    kbelfi_free(file);
 }
 
 
@@ -148,13 +197,8 @@ size_t kbelf_file_prog_len(kbelf_file file) {
 bool kbelf_file_prog_get(kbelf_file file, kbelf_progheader *prog, size_t index) {
     if (!file)
         return false;
-    if (index > file->header.ph_ent_num)
-        return false;
-    long res = kbelfx_seek(file->fd, (long)file->header.ph_offset + (long)sizeof(kbelf_progheader) * (long)index);
-    if (res < 0)
-        return false;
-    res = kbelfx_read(file->fd, prog, sizeof(kbelf_progheader));
-    if (res < (long)sizeof(kbelf_progheader))
+    if (index >= file->header.ph_ent_num)
         return false;
+    *prog = file->prog[index];
     return true;
 }
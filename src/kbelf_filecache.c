@@ -0,0 +1,100 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#define KBELF_REVEAL_PRIVATE
+#include <kbelf.h>
+#include <kbelf/internal.h>
+
+// Create an empty cache of opened and validated ELF files.
+// Returns non-null on success, NULL on error.
+kbelf_filecache kbelf_filecache_create() {
+    kbelf_filecache cache = kbelfi_malloc(sizeof(struct struct_kbelf_filecache));
+    if (!cache)
+        return NULL;
+    kbelfq_memset(cache, 0, sizeof(struct struct_kbelf_filecache));
+    return cache;
+}
+
+// Clean up a `kbelf_filecache` context.
+// Files still referenced elsewhere stay open until they are closed.
+void kbelf_filecache_destroy(kbelf_filecache cache) {
+    if (!cache)
+        return;
+    kbelf_filecache_invalidate(cache, NULL);
+    kbelfi_free(cache);
+}
+
+// Get a reference to the cached ELF file for `path`, opening it with `kbelf_file_open` if it is not cached.
+// Returns non-null on success, NULL on error.
+kbelf_file kbelf_filecache_open(kbelf_filecache cache, char const *path, uint64_t generation) {
+    if (!cache)
+        return kbelf_file_open(path, NULL);
+
+    // Look for a cached copy that is still up-to-date.
+    for (size_t i = 0; i < cache->entries_len; i++) {
+        if (!kbelfq_streq(cache->entries[i].file->path, path))
+            continue;
+        if (cache->entries[i].generation == generation)
+            return kbelf_file_ref(cache->entries[i].file);
+        kbelf_file_close(cache->entries[i].file);
+        cache->entries[i] = cache->entries[--cache->entries_len];
+        break;
+    }
+
+    // Open and add to the cache.
+    kbelf_file file = kbelf_file_open(path, NULL);
+    if (!file)
+        return NULL;
+    void *mem = kbelfi_realloc(cache->entries, sizeof(kbelf_fileent) * (cache->entries_len + 1));
+    if (!mem) {
+        // Still usable without caching it.
+        KBELF_LOGW("Out of memory")
+        return file;
+    }
+    cache->entries                    = mem;
+    cache->entries[cache->entries_len] = (kbelf_fileent){
+        .file       = kbelf_file_ref(file),
+        .generation = generation,
+    };
+    cache->entries_len++;
+    return file;
+}
+
+// Remove the file for `path` from the cache, or all files if `path` is NULL.
+void kbelf_filecache_invalidate(kbelf_filecache cache, char const *path) {
+    if (!cache)
+        return;
+    for (size_t i = 0; i < cache->entries_len;) {
+        if (path && !kbelfq_streq(cache->entries[i].file->path, path)) {
+            i++;
+            continue;
+        }
+        kbelf_file_close(cache->entries[i].file);
+        cache->entries[i] = cache->entries[--cache->entries_len];
+    }
+    if (!cache->entries_len && cache->entries) {
+        kbelfi_free(cache->entries);
+        cache->entries = NULL;
+    }
+}
@@ -0,0 +1,227 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#define KBELF_REVEAL_PRIVATE
+#include <kbelf.h>
+#include <kbelf/internal.h>
+
+// FNV-1a offset basis.
+#define FNV_OFFSET 0xcbf29ce484222325ull
+// FNV-1a prime.
+#define FNV_PRIME  0x00000100000001b3ull
+
+// Default image cache lookup that caches nothing.
+__attribute__((weak)) long kbelfx_imgcache_load(uint64_t key, void *buf, long len) {
+    (void)key;
+    (void)buf;
+    (void)len;
+    return 0;
+}
+
+// Default image cache store that discards the image.
+__attribute__((weak)) void kbelfx_imgcache_store(uint64_t key, void const *buf, long len) {
+    (void)key;
+    (void)buf;
+    (void)len;
+}
+
+// Add bytes to an FNV-1a digest.
+static uint64_t digest(uint64_t hash, void const *data, size_t len) {
+    uint8_t const *ptr = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= ptr[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Get an instance of a process image by index; the executable comes first.
+static inline kbelf_inst get_inst(kbelf_dyn dyn, size_t index) {
+    return index ? dyn->libs_inst[index - 1] : dyn->exec_inst;
+}
+
+// Determine which segments of an instance are stored in the image cache.
+static bool select_segments(kbelf_inst inst, bool *stored) {
+    if (!kbelfi_reloc_targets(inst, stored))
+        return false;
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        stored[i] = !inst->segments[i].shared && (stored[i] || inst->segments[i].w);
+    }
+    return true;
+}
+
+// Compute the image cache key of a loaded process image that has not been relocated yet.
+uint64_t kbelfi_imgcache_key(kbelf_dyn dyn) {
+    uint64_t hash = FNV_OFFSET;
+
+    // Contents and addresses of the loaded files.
+    for (size_t x = 0; x < dyn->libs_len + 1; x++) {
+        kbelf_inst inst = get_inst(dyn, x);
+        hash            = digest(hash, &inst->segments_len, sizeof(size_t));
+        for (size_t y = 0; y < inst->segments_len; y++) {
+            kbelf_segment const *seg = &inst->segments[y];
+            hash                     = digest(hash, &seg->vaddr_req, sizeof(kbelf_addr));
+            hash                     = digest(hash, &seg->vaddr_real, sizeof(kbelf_addr));
+            hash                     = digest(hash, &seg->paddr, sizeof(kbelf_addr));
+            hash                     = digest(hash, &seg->laddr, sizeof(kbelf_laddr));
+            hash                     = digest(hash, &seg->size, sizeof(kbelf_addr));
+            hash                     = digest(hash, (void const *)seg->laddr, seg->size);
+        }
+    }
+
+    // Symbols provided by the built-in libraries.
+    for (size_t x = 0; x < dyn->builtins_len; x++) {
+        kbelf_builtin_lib const *lib = dyn->builtins[x];
+        hash                         = digest(hash, lib->path, kbelfq_strlen(lib->path) + 1);
+        for (size_t y = 0; y < lib->symbols_len; y++) {
+            hash = digest(hash, lib->symbols[y].name, kbelfq_strlen(lib->symbols[y].name) + 1);
+            hash = digest(hash, &lib->symbols[y].vaddr, sizeof(size_t));
+        }
+    }
+
+    return hash;
+}
+
+// Compute the size of the cached image of a process image.
+// Returns success status.
+static bool image_size(kbelf_dyn dyn, bool **stored, size_t *out_size) {
+    size_t size = dyn->init_order_len * sizeof(size_t);
+    for (size_t x = 0; x < dyn->libs_len + 1; x++) {
+        kbelf_inst inst = get_inst(dyn, x);
+        stored[x]       = kbelfi_malloc(sizeof(bool) * inst->segments_len + 1);
+        if (!stored[x] || !select_segments(inst, stored[x]))
+            return false;
+        for (size_t y = 0; y < inst->segments_len; y++) {
+            if (stored[x][y])
+                size += inst->segments[y].size;
+        }
+    }
+    *out_size = size;
+    return true;
+}
+
+// Free the segment selection made by `image_size`.
+static void free_stored(kbelf_dyn dyn, bool **stored) {
+    for (size_t x = 0; x < dyn->libs_len + 1; x++) {
+        if (stored[x])
+            kbelfi_free(stored[x]);
+    }
+    kbelfi_free(stored);
+}
+
+// Check that a cached initialisation order names each library at most once.
+// Returns success status.
+static bool valid_init_order(kbelf_dyn dyn, size_t const *order) {
+    bool *seen = kbelfi_malloc(sizeof(bool) * dyn->libs_len + 1);
+    if (!seen)
+        return false;
+    kbelfq_memset(seen, 0, sizeof(bool) * dyn->libs_len);
+    bool valid = true;
+    for (size_t i = 0; valid && i < dyn->init_order_len; i++) {
+        valid = order[i] < dyn->libs_len && !seen[order[i]];
+        if (valid)
+            seen[order[i]] = true;
+    }
+    kbelfi_free(seen);
+    return valid;
+}
+
+// Restore the relocated segments and initialisation order of a process image from the image cache.
+// Returns true if the image was cached, false otherwise.
+bool kbelfi_imgcache_restore(kbelf_dyn dyn, uint64_t key) {
+    uint8_t *buf    = NULL;
+    size_t   size   = 0;
+    bool     cached = false;
+    bool   **stored = kbelfi_malloc(sizeof(bool *) * (dyn->libs_len + 1));
+    if (!stored)
+        return false;
+    kbelfq_memset(stored, 0, sizeof(bool *) * (dyn->libs_len + 1));
+    if (!image_size(dyn, stored, &size))
+        goto exit;
+    buf = kbelfi_malloc(size + 1);
+    if (!buf)
+        goto exit;
+    if (kbelfx_imgcache_load(key, buf, (long)size) != (long)size)
+        goto exit;
+
+    // Copy the image into the segments.
+    uint8_t *ptr = buf;
+    if (!valid_init_order(dyn, (size_t const *)ptr)) {
+        KBELF_LOGW("Ignoring cached image with an invalid initialisation order")
+        goto exit;
+    }
+    kbelfq_memcpy(dyn->init_order, ptr, dyn->init_order_len * sizeof(size_t));
+    ptr += dyn->init_order_len * sizeof(size_t);
+    for (size_t x = 0; x < dyn->libs_len + 1; x++) {
+        kbelf_inst inst = get_inst(dyn, x);
+        for (size_t y = 0; y < inst->segments_len; y++) {
+            if (!stored[x][y])
+                continue;
+            kbelfq_memcpy((void *)inst->segments[y].laddr, ptr, inst->segments[y].size);
+            ptr += inst->segments[y].size;
+        }
+    }
+    cached = true;
+
+exit:
+    if (buf)
+        kbelfi_free(buf);
+    free_stored(dyn, stored);
+    return cached;
+}
+
+// Store the relocated segments and initialisation order of a process image in the image cache.
+void kbelfi_imgcache_save(kbelf_dyn dyn, uint64_t key) {
+    uint8_t *buf    = NULL;
+    size_t   size   = 0;
+    bool   **stored = kbelfi_malloc(sizeof(bool *) * (dyn->libs_len + 1));
+    if (!stored)
+        return;
+    kbelfq_memset(stored, 0, sizeof(bool *) * (dyn->libs_len + 1));
+    if (!image_size(dyn, stored, &size))
+        goto exit;
+    buf = kbelfi_malloc(size + 1);
+    if (!buf)
+        goto exit;
+
+    // Copy the segments into the image.
+    uint8_t *ptr = buf;
+    kbelfq_memcpy(ptr, dyn->init_order, dyn->init_order_len * sizeof(size_t));
+    ptr += dyn->init_order_len * sizeof(size_t);
+    for (size_t x = 0; x < dyn->libs_len + 1; x++) {
+        kbelf_inst inst = get_inst(dyn, x);
+        for (size_t y = 0; y < inst->segments_len; y++) {
+            if (!stored[x][y])
+                continue;
+            kbelfq_memcpy(ptr, (void const *)inst->segments[y].laddr, inst->segments[y].size);
+            ptr += inst->segments[y].size;
+        }
+    }
+    kbelfx_imgcache_store(key, buf, (long)size);
+
+exit:
+    if (buf)
+        kbelfi_free(buf);
+    free_stored(dyn, stored);
+}
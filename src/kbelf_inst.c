@@ -24,6 +24,8 @@
 
 #define KBELF_REVEAL_PRIVATE
 #include <kbelf.h>
+#include <kbelf/internal.h>
+#include <kbelf/port.h>
 
 
 
@@ -32,11 +34,245 @@ static bool kbelf_prog_loadable(kbelf_progheader const *prog) {
     return prog->type == PT_LOAD && prog->mem_size;
 }
 
+// Number of pages overlapping a segment.
+static inline size_t kbelf_seg_pages(kbelf_segment const *seg) {
+    if (!seg->size)
+        return 0;
+    return (seg->vaddr_real + seg->size - 1) / KBELF_PAGE_SIZE - seg->vaddr_real / KBELF_PAGE_SIZE + 1;
+}
+
+// Get the start address of a segment in one of the address spaces of a loaded instance.
+static inline kbelf_laddr seg_start(kbelf_segment const *seg, kbelf_addrspace space) {
+    switch (space) {
+        case KBELF_SPACE_REQ: return seg->vaddr_req;
+        case KBELF_SPACE_REAL: return seg->vaddr_real;
+        case KBELF_SPACE_PHYS: return seg->paddr;
+        default: return seg->laddr;
+    }
+}
+
+// Test whether a segment contains an address in one of the address spaces of a loaded instance.
+static inline bool seg_contains(kbelf_segment const *seg, kbelf_addrspace space, kbelf_laddr addr) {
+    kbelf_laddr start = seg_start(seg, space);
+    return addr >= start && addr < start + seg->size;
+}
+
+// Sort the segments of a loaded instance by start address in each address space.
+// Address translation falls back to a linear search if this runs out of memory.
+static void seg_index_build(kbelf_inst inst) {
+    if (!inst->segments_len)
+        return;
+    if (!inst->seg_index)
+        inst->seg_index = kbelfi_malloc(sizeof(size_t) * KBELF_SPACE_COUNT * inst->segments_len);
+    if (!inst->seg_index)
+        return;
+    for (int space = 0; space < KBELF_SPACE_COUNT; space++) {
+        size_t *order = inst->seg_index + space * inst->segments_len;
+        for (size_t i = 0; i < inst->segments_len; i++) {
+            kbelf_laddr start = seg_start(&inst->segments[i], space);
+            size_t      j     = i;
+            for (; j > 0 && seg_start(&inst->segments[order[j - 1]], space) > start; j--) {
+                order[j] = order[j - 1];
+            }
+            order[j] = i;
+        }
+    }
+}
+
+// Find the segment containing an address in one of the address spaces of a loaded instance.
+// Returns the segment index, or `inst->segments_len` if no segment contains it.
+static size_t seg_find(kbelf_inst inst, kbelf_addrspace space, kbelf_laddr addr) {
+    KBELF_STAT(translations, 1)
+    // Consecutive translations tend to hit the same segment.
+    size_t found = inst->seg_mru[space];
+    if (found < inst->segments_len && seg_contains(&inst->segments[found], space, addr))
+        return found;
+
+    found = inst->segments_len;
+    if (inst->seg_index) {
+        // Find the last segment that starts at or before the address.
+        size_t const *order = inst->seg_index + space * inst->segments_len;
+        size_t        lo = 0, hi = inst->segments_len;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (seg_start(&inst->segments[order[mid]], space) <= addr)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo && seg_contains(&inst->segments[order[lo - 1]], space, addr))
+            found = order[lo - 1];
+    } else {
+        for (size_t i = 0; i < inst->segments_len; i++) {
+            if (seg_contains(&inst->segments[i], space, addr)) {
+                found = i;
+                break;
+            }
+        }
+    }
+
+    if (found < inst->segments_len)
+        inst->seg_mru[space] = found;
+    return found;
+}
+
+// Find the segment and present bit index of a virtual address in a loaded instance.
+static bool lazy_locate(kbelf_inst inst, kbelf_addr vaddr, size_t *seg_out, size_t *bit_out) {
+    size_t bit = 0;
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        kbelf_segment const *seg = &inst->segments[i];
+        if (vaddr >= seg->vaddr_real && vaddr < seg->vaddr_real + seg->size) {
+            *seg_out = i;
+            *bit_out = bit + vaddr / KBELF_PAGE_SIZE - seg->vaddr_real / KBELF_PAGE_SIZE;
+            return true;
+        }
+        bit += kbelf_seg_pages(seg);
+    }
+    return false;
+}
+
+// Make a range of requested virtual addresses present while loading a lazy instance.
+static inline bool lazy_prefault(kbelf_inst inst, kbelf_addr vaddr_req, kbelf_addr len) {
+    return !inst->lazy || kbelf_inst_fault_range(inst, kbelf_inst_getvaddr(inst, vaddr_req), len);
+}
+
+// Decode the dynamic table of a loaded instance into `inst->dyninfo`.
+// Returns success status.
+static bool parse_dynamic(kbelf_inst inst) {
+    kbelf_dyninfo  *info   = &inst->dyninfo;
+    kbelf_dynentry *dyntab = NULL;
+    if (!inst->dynamic_len)
+        return true;
+
+    // Read the whole table at once.
+    dyntab = kbelfi_malloc(inst->dynamic_len * sizeof(kbelf_dynentry));
+    if (!dyntab)
+        KBELF_ERROR(abort, "Out of memory")
+    if (!kbelfi_copy_from_user(inst, dyntab, inst->dynamic, inst->dynamic_len * sizeof(kbelf_dynentry)))
+        KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
+
+    // Find the end of the table and the number of needed libraries.
+    size_t needed_len = 0;
+    for (size_t i = 0; i < inst->dynamic_len; i++) {
+        if (dyntab[i].tag == DT_NULL) {
+            inst->dynamic_len = i;
+            break;
+        }
+        needed_len += dyntab[i].tag == DT_NEEDED;
+    }
+    if (needed_len) {
+        info->needed = kbelfi_malloc(needed_len * sizeof(kbelf_addr));
+        if (!info->needed)
+            KBELF_ERROR(abort, "Out of memory")
+    }
+
+    kbelf_addr pltrel = DT_RELA;
+    for (size_t i = 0; i < inst->dynamic_len; i++) {
+        kbelf_dynentry dt = dyntab[i];
+        if (dt.tag == DT_NEEDED) {
+            info->needed[info->needed_len++] = dt.value;
+        } else if (dt.tag == DT_SONAME) {
+            info->soname = dt.value;
+        } else if (dt.tag == DT_SYMTAB) {
+            inst->dynsym = kbelf_inst_getladdr(inst, dt.value);
+        } else if (dt.tag == DT_STRTAB) {
+            inst->dynstr = kbelf_inst_getladdr(inst, dt.value);
+        } else if (dt.tag == DT_STRSZ) {
+            inst->dynstr_len = dt.value;
+        } else if (dt.tag == DT_INIT) {
+            inst->init_func = kbelf_inst_getvaddr(inst, dt.value);
+        } else if (dt.tag == DT_FINI) {
+            inst->fini_func = kbelf_inst_getvaddr(inst, dt.value);
+        } else if (dt.tag == DT_HASH) {
+            info->hash = dt.value;
+        } else if (dt.tag == DT_GNU_HASH) {
+            info->gnu_hash = dt.value;
+        } else if (dt.tag == DT_INIT_ARRAY) {
+            inst->init_array = kbelf_inst_getvaddr(inst, dt.value);
+        } else if (dt.tag == DT_INIT_ARRAYSZ) {
+            inst->init_array_len = dt.value / sizeof(kbelf_addr);
+        } else if (dt.tag == DT_FINI_ARRAY) {
+            inst->fini_array = kbelf_inst_getvaddr(inst, dt.value);
+        } else if (dt.tag == DT_FINI_ARRAYSZ) {
+            inst->fini_array_len = dt.value / sizeof(kbelf_addr);
+        } else if (dt.tag == DT_PREINIT_ARRAY) {
+            inst->preinit_array = kbelf_inst_getvaddr(inst, dt.value);
+        } else if (dt.tag == DT_PREINIT_ARRAYSZ) {
+            inst->preinit_array_len = dt.value / sizeof(kbelf_addr);
+        } else if (dt.tag == DT_REL) {
+            info->rel.vaddr = dt.value;
+        } else if (dt.tag == DT_RELSZ) {
+            info->rel.size = dt.value;
+        } else if (dt.tag == DT_RELENT) {
+            info->rel.ent = dt.value;
+        } else if (dt.tag == DT_RELA) {
+            info->rela.vaddr = dt.value;
+        } else if (dt.tag == DT_RELASZ) {
+            info->rela.size = dt.value;
+        } else if (dt.tag == DT_RELAENT) {
+            info->rela.ent = dt.value;
+        } else if (dt.tag == DT_JMPREL) {
+            info->jmprel.vaddr = dt.value;
+        } else if (dt.tag == DT_PLTRELSZ) {
+            info->jmprel.size = dt.value;
+        } else if (dt.tag == DT_PLTREL) {
+            pltrel = dt.value;
+        } else if (dt.tag == DT_RELR) {
+            info->relr.vaddr = dt.value;
+        } else if (dt.tag == DT_RELRSZ) {
+            info->relr.size = dt.value;
+        } else if (dt.tag == DT_RELRENT) {
+            info->relr.ent = dt.value;
+        } else if (dt.tag == DT_FLAGS) {
+            info->flags = dt.value;
+        } else if (dt.tag == DT_FLAGS_1) {
+            info->flags_1 = dt.value;
+        }
+    }
+    info->jmprel.ent = pltrel == DT_REL ? sizeof(kbelf_relentry) : sizeof(kbelf_relaentry);
+
+    kbelfi_free(dyntab);
+    return true;
+
+abort:
+    if (dyntab)
+        kbelfi_free(dyntab);
+    return false;
+}
+
+// Check whether all segments of an instance are at the same offset from their requested addresses.
+static bool seg_single_delta(kbelf_inst inst) {
+    kbelf_addr delta = inst->segments[0].vaddr_real - inst->segments[0].vaddr_req;
+    for (size_t i = 1; i < inst->segments_len; i++) {
+        if (inst->segments[i].vaddr_real - inst->segments[i].vaddr_req != delta)
+            return false;
+    }
+    return true;
+}
+
+// Replace shared segments with private ones if they were not mapped at the same load offset as the other segments.
+// Returns success status.
+static bool seg_unshare(kbelf_inst inst) {
+    if (!inst->libent || seg_single_delta(inst))
+        return true;
+    KBELF_LOGW("Unable to share segments of " KBELF_FMT_CSTR " at the same load offset", inst->file->path)
+    kbelfx_seg_free(inst, inst->segments_len, inst->segments);
+    kbelfi_libcache_release(inst);
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        inst->segments[i].alloc_cookie = NULL;
+        inst->segments[i].laddr        = 0;
+        inst->segments[i].paddr        = 0;
+        inst->segments[i].vaddr_real   = 0;
+        inst->segments[i].shared       = false;
+    }
+    return kbelfx_seg_alloc(inst, inst->segments_len, inst->segments);
+}
+
 // Load all loadable segments from an ELF file.
 // Returns non-null on success, NULL on error.
-kbelf_inst kbelf_inst_load(kbelf_file file, int pid) {
+static kbelf_inst inst_load(kbelf_file file, int pid, bool lazy, kbelf_libcache cache) {
     // Allocate memory.
-    kbelf_inst inst = kbelfx_malloc(sizeof(struct struct_kbelf_inst));
+    kbelf_inst inst = kbelfi_malloc(sizeof(struct struct_kbelf_inst));
     if (!inst)
         KBELF_ERROR(abort, "Out of memory")
     kbelfq_memset(inst, 0, sizeof(struct struct_kbelf_inst));
@@ -54,10 +290,14 @@ kbelf_inst kbelf_inst_load(kbelf_file file, int pid) {
             KBELF_ERROR(abort, "Unable to read program header " KBELF_FMT_SIZE, i)
         loadable_len += kbelf_prog_loadable(&prog);
     }
+#if KBELF_MAX_SEGMENTS
+    if (loadable_len > KBELF_MAX_SEGMENTS)
+        KBELF_ERROR(abort, "More than " KBELF_FMT_DEC " loadable segments", KBELF_MAX_SEGMENTS)
+#endif
 
     // Allocate memory.
     inst->segments_len = loadable_len;
-    inst->segments     = kbelfx_malloc(loadable_len * sizeof(kbelf_segment));
+    inst->segments     = kbelfi_malloc(loadable_len * sizeof(kbelf_segment));
     if (!inst->segments)
         KBELF_ERROR(abort, "Out of memory");
     kbelfq_memset(inst->segments, 0, loadable_len * sizeof(kbelf_segment));
@@ -86,26 +326,73 @@ kbelf_inst kbelf_inst_load(kbelf_file file, int pid) {
         li++;
     }
 
+    // Reuse segments shared by other processes.
+    kbelf_libent *ent = lazy ? NULL : kbelfi_libcache_find(cache, file->path);
+    if (ent && ent->segments_len == inst->segments_len) {
+        for (size_t i = 0; ent && i < inst->segments_len; i++) {
+            if (ent->segments[i].vaddr_req != inst->segments[i].vaddr_req
+                || ent->segments[i].size != inst->segments[i].size)
+                ent = NULL;
+        }
+        for (size_t i = 0; ent && i < inst->segments_len; i++) {
+            if (ent->segments[i].shared) {
+                inst->segments[i].shared = true;
+                inst->segments[i].laddr  = ent->segments[i].laddr;
+                inst->segments[i].paddr  = ent->segments[i].paddr;
+            }
+        }
+        if (ent) {
+            inst->libent = ent;
+            ent->refcount++;
+        }
+    }
+
     // Allocate memory.
+    KBELF_TRACE_BEGIN(KBELF_PHASE_SEG_ALLOC, file->name)
     if (!kbelfx_seg_alloc(inst, inst->segments_len, inst->segments))
-        KBELF_ERROR(abort, "Out of virtual memory")
+        KBELF_ERROR(abort_seg_alloc, "Out of virtual memory")
+
+    // Shared segments stay where the first process loaded them; load a private copy instead if the other segments
+    // could not be placed at the same distance from them, as code that refers to its data relative to itself needs.
+    if (!seg_unshare(inst))
+        KBELF_ERROR(abort_seg_alloc, "Out of virtual memory")
+    KBELF_TRACE_END(KBELF_PHASE_SEG_ALLOC, file->name, inst->segments_len)
+    seg_index_build(inst);
+
+    // Lazily loaded segments are filled in by `kbelf_inst_fault`.
+    if (lazy) {
+        size_t pages = 0;
+        for (size_t i = 0; i < inst->segments_len; i++) {
+            pages += kbelf_seg_pages(&inst->segments[i]);
+        }
+        inst->lazy_present = kbelfi_malloc((pages + 7) / 8);
+        if (!inst->lazy_present)
+            KBELF_ERROR(abort, "Out of memory")
+        kbelfq_memset(inst->lazy_present, 0, (pages + 7) / 8);
+        inst->lazy = true;
+    }
 
     // Load segments.
-    for (size_t i = 0, li = 0; li < loadable_len; i++) {
+    size_t loaded = 0;
+    KBELF_TRACE_BEGIN(KBELF_PHASE_SEG_LOAD, file->name)
+    for (size_t i = 0, li = 0; !inst->lazy && li < loadable_len; i++) {
         kbelf_progheader prog = {.type = PT_UNUSED, .mem_size = 0};
         if (!kbelf_file_prog_get(file, &prog, i))
-            KBELF_ERROR(abort, "Unable to read program header " KBELF_FMT_SIZE, i)
+            KBELF_ERROR(abort_seg_load, "Unable to read program header " KBELF_FMT_SIZE, i)
         if (!kbelf_prog_loadable(&prog))
             continue;
 
         // Initialised data.
-        if (prog.file_size) {
-            long res = kbelfx_seek(file->fd, (long)prog.offset);
+        if (inst->segments[li].shared) {
+            // Already loaded by another process.
+        } else if (prog.file_size) {
+            long res = kbelfi_seek(file->fd, (long)prog.offset);
             if (res < 0)
-                KBELF_ERROR(abort, "I/O error");
-            res = kbelfx_load(inst, file->fd, inst->segments[li].laddr, prog.file_size, prog.mem_size);
+                KBELF_ERROR(abort_seg_load, "I/O error");
+            res = kbelfi_load(inst, file->fd, inst->segments[li].laddr, prog.file_size, prog.mem_size);
             if (res < (long)prog.file_size)
-                KBELF_ERROR(abort, "I/O error");
+                KBELF_ERROR(abort_seg_load, "I/O error");
+            loaded += prog.file_size;
         } else if (prog.mem_size) {
             // Pure BSS segment — zero the memory.
             kbelfq_memset((void *)inst->segments[li].laddr, 0, prog.mem_size);
@@ -113,6 +400,7 @@ kbelf_inst kbelf_inst_load(kbelf_file file, int pid) {
 
         li++;
     }
+    KBELF_TRACE_END(KBELF_PHASE_SEG_LOAD, file->name, loaded)
 
     // Compute entrypoint address.
     if (file->header.entry) {
@@ -125,6 +413,8 @@ kbelf_inst kbelf_inst_load(kbelf_file file, int pid) {
         if (!kbelf_file_prog_get(file, &prog, i))
             KBELF_ERROR(abort, "Unable to read program header " KBELF_FMT_SIZE, i)
         if (prog.type == PT_DYNAMIC) {
+            if (!lazy_prefault(inst, prog.vaddr, prog.mem_size))
+                KBELF_ERROR(abort, "I/O error")
             inst->dynamic     = kbelf_inst_getladdr(inst, prog.vaddr);
             inst->dynamic_len = prog.mem_size / sizeof(kbelf_dynentry);
             break;
@@ -132,42 +422,21 @@ kbelf_inst kbelf_inst_load(kbelf_file file, int pid) {
     }
 
     // Parse dynamic table.
-    if (!inst->dynamic && inst->dynamic_len)
-        __builtin_unreachable();
-    for (size_t i = 0; i < inst->dynamic_len; i++) {
-        kbelf_dynentry dt = {0};
-        if (!kbelfx_copy_from_user(inst, &dt, inst->dynamic + i * sizeof(kbelf_dynentry), sizeof(kbelf_dynentry))) {
-            KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
-        }
-        if (dt.tag == DT_NULL) {
-            inst->dynamic_len = i;
-            break;
-        } else if (dt.tag == DT_SYMTAB) {
-            inst->dynsym = kbelf_inst_getladdr(inst, dt.value);
-        } else if (dt.tag == DT_STRTAB) {
-            inst->dynstr = kbelf_inst_getladdr(inst, dt.value);
-        } else if (dt.tag == DT_STRSZ) {
-            inst->dynstr_len = dt.value;
-        } else if (dt.tag == DT_INIT) {
-            inst->init_func = kbelf_inst_getvaddr(inst, dt.value);
-        } else if (dt.tag == DT_FINI) {
-            inst->fini_func = kbelf_inst_getvaddr(inst, dt.value);
-        } else if (dt.tag == DT_HASH) {
-            kbelf_laddr laddr = kbelf_inst_getladdr(inst, dt.value);
-            kbelfx_copy_from_user(inst, &inst->dynsym_len, laddr + 4 * KBELF_CLASS, sizeof(kbelf_addr));
-        } else if (dt.tag == DT_INIT_ARRAY) {
-            inst->init_array = kbelf_inst_getvaddr(inst, dt.value);
-        } else if (dt.tag == DT_INIT_ARRAYSZ) {
-            inst->init_array_len = dt.value / sizeof(kbelf_addr);
-        } else if (dt.tag == DT_FINI_ARRAY) {
-            inst->fini_array = kbelf_inst_getvaddr(inst, dt.value);
-        } else if (dt.tag == DT_FINI_ARRAYSZ) {
-            inst->fini_array_len = dt.value / sizeof(kbelf_addr);
-        } else if (dt.tag == DT_PREINIT_ARRAY) {
-            inst->preinit_array = kbelf_inst_getvaddr(inst, dt.value);
-        } else if (dt.tag == DT_PREINIT_ARRAYSZ) {
-            inst->preinit_array_len = dt.value / sizeof(kbelf_addr);
-        }
+    KBELF_TRACE_BEGIN(KBELF_PHASE_DYNAMIC, file->name)
+    if (!parse_dynamic(inst))
+        goto abort_dynamic;
+    KBELF_TRACE_END(KBELF_PHASE_DYNAMIC, file->name, inst->dynamic_len)
+
+    // Get the number of dynamic symbols from the hash table.
+    if (inst->dyninfo.hash) {
+        if (!lazy_prefault(inst, inst->dyninfo.hash, 2 * sizeof(uint32_t)))
+            KBELF_ERROR(abort, "I/O error")
+        // The hash table consists of 32-bit words in both ELF classes; the second is the number of symbols.
+        kbelf_laddr laddr  = kbelf_inst_getladdr(inst, inst->dyninfo.hash);
+        uint32_t    nchain = 0;
+        if (!kbelfi_copy_from_user(inst, &nchain, laddr + sizeof(uint32_t), sizeof(uint32_t)))
+            KBELF_ERROR(abort, "Invalid hash table (index out of bounds)")
+        inst->dynsym_len = nchain;
     }
 
     // Assert presence of both length and pointer fields.
@@ -206,13 +475,663 @@ kbelf_inst kbelf_inst_load(kbelf_file file, int pid) {
             "preinit_array",
             inst->preinit_array_len
         )
+
+    // Tables read while linking must be present before relocation.
+    if (inst->lazy) {
+        bool ok = kbelf_inst_fault_range(inst, kbelf_inst_laddr_to_vaddr(inst, inst->dynsym),
+                                         inst->dynsym_len * sizeof(kbelf_symentry));
+        ok &= kbelf_inst_fault_range(inst, kbelf_inst_laddr_to_vaddr(inst, inst->dynstr), inst->dynstr_len);
+        ok &= kbelf_inst_fault_range(inst, inst->preinit_array, inst->preinit_array_len * sizeof(kbelf_addr));
+        ok &= kbelf_inst_fault_range(inst, inst->init_array, inst->init_array_len * sizeof(kbelf_addr));
+        ok &= kbelf_inst_fault_range(inst, inst->fini_array, inst->fini_array_len * sizeof(kbelf_addr));
+        if (!ok)
+            KBELF_ERROR(abort, "I/O error")
+    }
     return inst;
 
+abort_dynamic:
+    KBELF_TRACE_END(KBELF_PHASE_DYNAMIC, file->name, 0)
+    goto abort;
+abort_seg_load:
+    KBELF_TRACE_END(KBELF_PHASE_SEG_LOAD, file->name, 0)
+    goto abort;
+abort_seg_alloc:
+    KBELF_TRACE_END(KBELF_PHASE_SEG_ALLOC, file->name, 0)
 abort:
     kbelf_inst_unload(inst);
     return NULL;
 }
 
+// Load all loadable segments from an ELF file.
+// Returns non-null on success, NULL on error.
+kbelf_inst kbelf_inst_load(kbelf_file file, int pid) {
+    return inst_load(file, pid, false, NULL);
+}
+
+// Load all loadable segments from an ELF file, mapping the segments shared through a `kbelf_libcache` instead of
+// loading another copy. Returns non-null on success, NULL on error.
+kbelf_inst kbelf_inst_load_cached(kbelf_file file, int pid, kbelf_libcache cache) {
+    return inst_load(file, pid, false, cache);
+}
+
+// Allocate all loadable segments from an ELF file but only load the pages needed for dynamic linking.
+// The other pages are loaded and relocated on demand by `kbelf_inst_fault`.
+// Returns non-null on success, NULL on error.
+kbelf_inst kbelf_inst_load_lazy(kbelf_file file, int pid) {
+    return inst_load(file, pid, true, NULL);
+}
+
+// Translate a virtual address in a set of segments to the same address in a moved copy of them.
+static kbelf_addr move_vaddr(size_t len, kbelf_segment const *from, kbelf_segment const *to, kbelf_addr vaddr) {
+    for (size_t i = 0; vaddr && i < len; i++) {
+        if (vaddr >= from[i].vaddr_real && vaddr < from[i].vaddr_real + from[i].size) {
+            return vaddr - from[i].vaddr_real + to[i].vaddr_real;
+        }
+    }
+    return 0;
+}
+
+// Translate a load address in a set of segments to the same address in a moved copy of them.
+static kbelf_laddr move_laddr(size_t len, kbelf_segment const *from, kbelf_segment const *to, kbelf_laddr laddr) {
+    for (size_t i = 0; laddr && i < len; i++) {
+        if (laddr >= from[i].laddr && laddr < from[i].laddr + from[i].size) {
+            return laddr - from[i].laddr + to[i].laddr;
+        }
+    }
+    return 0;
+}
+
+// Translate the addresses cached in an instance after its segments have moved.
+static void move_addrs(kbelf_inst inst, kbelf_segment const *from, kbelf_segment const *to) {
+    size_t len          = inst->segments_len;
+    inst->entry         = move_vaddr(len, from, to, inst->entry);
+    inst->init_func     = move_vaddr(len, from, to, inst->init_func);
+    inst->fini_func     = move_vaddr(len, from, to, inst->fini_func);
+    inst->preinit_array = move_vaddr(len, from, to, inst->preinit_array);
+    inst->init_array    = move_vaddr(len, from, to, inst->init_array);
+    inst->fini_array    = move_vaddr(len, from, to, inst->fini_array);
+    inst->dynamic       = move_laddr(len, from, to, inst->dynamic);
+    inst->dynstr        = move_laddr(len, from, to, inst->dynstr);
+    inst->dynsym        = move_laddr(len, from, to, inst->dynsym);
+}
+
+// Copy memory that may overlap.
+static void move_bytes(kbelf_laddr dst, kbelf_laddr src, size_t len) {
+    if (dst + len <= src || src + len <= dst) {
+        kbelfq_memcpy((void *)dst, (void const *)src, len);
+    } else if (dst < src) {
+        for (size_t i = 0; i < len; i++) {
+            ((uint8_t *)dst)[i] = ((uint8_t const *)src)[i];
+        }
+    } else if (dst > src) {
+        for (size_t i = len; i-- > 0;) {
+            ((uint8_t *)dst)[i] = ((uint8_t const *)src)[i];
+        }
+    }
+}
+
+// Check whether two address ranges overlap.
+static inline bool ranges_overlap(kbelf_laddr a, kbelf_addr a_size, kbelf_laddr b, kbelf_addr b_size) {
+    return a_size && b_size && a < b + b_size && b < a + a_size;
+}
+
+// Segment still has to be moved by `kbelfi_inst_move`.
+#define MOVE_LEFT   1
+// Old memory of the segment still holds its data.
+#define MOVE_SOURCE 2
+// Segment is copied to a temporary buffer before anything is moved.
+#define MOVE_STAGED 4
+
+// Check whether moving a segment would overwrite data that has yet to be moved out of another segment.
+static bool move_blocked(kbelf_inst inst, kbelf_segment const *new_segments, uint8_t const *flags, size_t index) {
+    kbelf_laddr dst  = new_segments[index].laddr;
+    kbelf_addr  size = inst->segments[index].size;
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        kbelf_segment const *seg = &inst->segments[i];
+        if (i != index && (flags[i] & MOVE_SOURCE) && ranges_overlap(dst, size, seg->laddr, seg->size))
+            return true;
+    }
+    return false;
+}
+
+// Determine an order to move the segments of an instance in so that no data is overwritten before it is moved.
+// Segments that wait on each other are marked `MOVE_STAGED`. Returns the number of segments to move.
+static size_t move_plan(kbelf_inst inst, kbelf_segment const *new_segments, uint8_t *flags, size_t *order) {
+    size_t left = 0;
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        flags[i]  = new_segments[i].laddr != inst->segments[i].laddr ? MOVE_LEFT | MOVE_SOURCE : 0;
+        left     += flags[i] != 0;
+    }
+    size_t order_len = 0;
+    while (order_len < left) {
+        size_t next = inst->segments_len;
+        for (size_t i = 0; next == inst->segments_len && i < inst->segments_len; i++) {
+            if ((flags[i] & MOVE_LEFT) && !move_blocked(inst, new_segments, flags, i))
+                next = i;
+        }
+        if (next == inst->segments_len) {
+            // Every segment left is blocked by the old memory of another one, so staging one frees its old memory.
+            for (size_t i = 0; next == inst->segments_len; i++) {
+                if (flags[i] & MOVE_SOURCE)
+                    next = i;
+            }
+            flags[next] = (flags[next] & ~MOVE_SOURCE) | MOVE_STAGED;
+            continue;
+        }
+        flags[next]         &= ~(MOVE_LEFT | MOVE_SOURCE);
+        order[order_len++]   = next;
+    }
+    return order_len;
+}
+
+// Copy the segments of a relocated instance into a new process without applying the kept relocations.
+// Returns non-null on success, NULL on error.
+kbelf_inst kbelfi_inst_clone(kbelf_inst inst, int pid) {
+    if (inst->lazy)
+        KBELF_ERROR(abort_early, "Unable to clone lazily loaded " KBELF_FMT_CSTR, inst->file->path)
+    if (inst->reclaimed)
+        KBELF_ERROR(abort_early, "Unable to clone reclaimed " KBELF_FMT_CSTR, inst->file->path)
+
+    // Allocate memory.
+    kbelf_inst clone = kbelfi_malloc(sizeof(struct struct_kbelf_inst));
+    if (!clone)
+        KBELF_ERROR(abort_early, "Out of memory")
+    kbelfq_memcpy(clone, inst, sizeof(struct struct_kbelf_inst));
+    clone->pid                = pid;
+    clone->segments_len       = 0;
+    clone->segments           = NULL;
+    clone->seg_index          = NULL;
+    clone->fixups_len         = 0;
+    clone->fixups             = NULL;
+    clone->libent             = NULL;
+    clone->dyninfo.needed_len = 0;
+    clone->dyninfo.needed     = NULL;
+
+    // Copy the segment descriptors; shared segments are mapped instead of copied.
+    clone->segments = kbelfi_malloc(inst->segments_len * sizeof(kbelf_segment));
+    if (!clone->segments)
+        KBELF_ERROR(abort, "Out of memory")
+    clone->segments_len = inst->segments_len;
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        kbelf_segment seg = inst->segments[i];
+        seg.pid           = pid;
+        seg.vaddr_real    = 0;
+        if (!seg.shared) {
+            seg.laddr = 0;
+            seg.paddr = 0;
+        }
+        clone->segments[i] = seg;
+    }
+    if (inst->libent) {
+        clone->libent = inst->libent;
+        clone->libent->refcount++;
+    }
+
+    // Allocate memory.
+    KBELF_TRACE_BEGIN(KBELF_PHASE_SEG_ALLOC, inst->file->name)
+    if (!kbelfx_seg_alloc(clone, clone->segments_len, clone->segments) || !seg_unshare(clone))
+        KBELF_ERROR(abort_seg_alloc, "Out of virtual memory")
+    KBELF_TRACE_END(KBELF_PHASE_SEG_ALLOC, inst->file->name, clone->segments_len)
+    seg_index_build(clone);
+
+    // Copy segment contents, including shared segments that could not be mapped.
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        if (!clone->segments[i].shared) {
+            kbelfq_memcpy(
+                (void *)clone->segments[i].laddr,
+                (void const *)inst->segments[i].laddr,
+                inst->segments[i].size
+            );
+        }
+    }
+
+    // Copy the needed library names.
+    if (inst->dyninfo.needed_len) {
+        clone->dyninfo.needed = kbelfi_malloc(inst->dyninfo.needed_len * sizeof(kbelf_addr));
+        if (!clone->dyninfo.needed)
+            KBELF_ERROR(abort, "Out of memory")
+        kbelfq_memcpy(clone->dyninfo.needed, inst->dyninfo.needed, inst->dyninfo.needed_len * sizeof(kbelf_addr));
+        clone->dyninfo.needed_len = inst->dyninfo.needed_len;
+    }
+
+    // Copy kept relocations.
+    if (inst->fixups_len) {
+        clone->fixups = kbelfi_malloc(inst->fixups_len * sizeof(kbelf_fixup));
+        if (!clone->fixups)
+            KBELF_ERROR(abort, "Out of memory")
+        kbelfq_memcpy(clone->fixups, inst->fixups, inst->fixups_len * sizeof(kbelf_fixup));
+        clone->fixups_len = inst->fixups_len;
+    }
+
+    // Translate addresses.
+    move_addrs(clone, inst->segments, clone->segments);
+
+    return clone;
+
+abort_seg_alloc:
+    KBELF_TRACE_END(KBELF_PHASE_SEG_ALLOC, inst->file->name, 0)
+abort:
+    kbelf_inst_unload(clone);
+abort_early:
+    return NULL;
+}
+
+// Check whether any segment of a copy of an instance is at a different virtual address.
+bool kbelfi_inst_moved(kbelf_inst inst, kbelf_inst clone) {
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        if (inst->segments[i].vaddr_real != clone->segments[i].vaddr_real)
+            return true;
+    }
+    return false;
+}
+
+// Apply all kept relocations of an instance again.
+// Returns success status.
+bool kbelfi_inst_reapply(kbelf_inst inst) {
+    if (!inst->fixups_kept)
+        KBELF_ERROR(abort, "Relocations of " KBELF_FMT_CSTR " were not kept", inst->file->path)
+    for (size_t i = 0; i < inst->fixups_len; i++) {
+        if (!kbelfi_fixup_apply(inst, &inst->fixups[i]))
+            KBELF_ERROR(abort, "Applying relocation 0x" KBELF_FMT_BYTE " failed", inst->fixups[i].type)
+    }
+    return true;
+
+abort:
+    return false;
+}
+
+// Apply the kept relocations of an instance that refer to symbols defined by another instance again.
+// Returns success status.
+bool kbelfi_inst_reapply_from(kbelf_inst inst, kbelf_inst def) {
+    if (!inst->fixups_kept)
+        KBELF_ERROR(abort, "Relocations of " KBELF_FMT_CSTR " were not kept", inst->file->path)
+    for (size_t i = 0; i < inst->fixups_len; i++) {
+        if (inst->fixups[i].def == def && !kbelfi_fixup_apply(inst, &inst->fixups[i]))
+            KBELF_ERROR(abort, "Applying relocation 0x" KBELF_FMT_BYTE " failed", inst->fixups[i].type)
+    }
+    return true;
+
+abort:
+    return false;
+}
+
+// Copy a relocated instance into a new process.
+// Returns non-null on success, NULL on error.
+kbelf_inst kbelf_inst_clone(kbelf_inst inst, int pid) {
+    if (!inst)
+        return NULL;
+    kbelf_inst clone = kbelfi_inst_clone(inst, pid);
+    if (!clone)
+        return NULL;
+    for (size_t i = 0; i < clone->fixups_len; i++) {
+        if (clone->fixups[i].def == inst)
+            clone->fixups[i].def = clone;
+    }
+    if (kbelfi_inst_moved(inst, clone) && !kbelfi_inst_reapply(clone)) {
+        kbelf_inst_unload(clone);
+        return NULL;
+    }
+    kbelfi_cache_sync_insts(clone, 0, NULL);
+    return clone;
+}
+
+// Move the segments of a relocated instance to new addresses without relocating it from scratch.
+// Returns success status.
+bool kbelfi_inst_move(kbelf_inst inst, kbelf_segment const *new_segments) {
+    if (inst->lazy)
+        KBELF_ERROR(abort, "Unable to rebase lazily loaded " KBELF_FMT_CSTR, inst->file->path)
+    if (inst->reclaimed)
+        KBELF_ERROR(abort, "Unable to rebase reclaimed " KBELF_FMT_CSTR, inst->file->path)
+    if (!inst->fixups_kept)
+        KBELF_ERROR(abort, "Relocations of " KBELF_FMT_CSTR " were not kept", inst->file->path)
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        if (inst->segments[i].shared && (new_segments[i].laddr != inst->segments[i].laddr
+                                         || new_segments[i].vaddr_real != inst->segments[i].vaddr_real))
+            KBELF_ERROR(abort, "Unable to move shared segment of " KBELF_FMT_CSTR, inst->file->path)
+        for (size_t j = i + 1; j < inst->segments_len; j++) {
+            kbelf_segment const *a = &new_segments[i], *b = &new_segments[j];
+            if (ranges_overlap(a->laddr, inst->segments[i].size, b->laddr, inst->segments[j].size))
+                KBELF_ERROR(abort, "New segments of " KBELF_FMT_CSTR " overlap", inst->file->path)
+        }
+    }
+
+    kbelf_segment *old   = kbelfi_malloc(inst->segments_len * sizeof(kbelf_segment));
+    uint8_t       *flags = kbelfi_malloc(inst->segments_len * sizeof(uint8_t));
+    size_t        *order = kbelfi_malloc(inst->segments_len * sizeof(size_t));
+    if (!old || !flags || !order)
+        KBELF_ERROR(abort_alloc, "Out of memory")
+    kbelfq_memcpy(old, inst->segments, inst->segments_len * sizeof(kbelf_segment));
+    size_t order_len = move_plan(inst, new_segments, flags, order);
+
+    // Copy the segments that wait on each other out of the way before anything is overwritten.
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        if (!(flags[i] & MOVE_STAGED))
+            continue;
+        void *staged = kbelfi_malloc(old[i].size);
+        if (!staged)
+            KBELF_ERROR(abort_staged, "Out of memory")
+        kbelfq_memcpy(staged, (void const *)old[i].laddr, old[i].size);
+        inst->segments[i].laddr = (kbelf_laddr)staged;
+    }
+
+    // Move the segment contents.
+    for (size_t i = 0; i < order_len; i++) {
+        kbelf_segment *seg = &inst->segments[order[i]];
+        move_bytes(new_segments[order[i]].laddr, seg->laddr, seg->size);
+        if (flags[order[i]] & MOVE_STAGED)
+            kbelfi_free((void *)seg->laddr);
+        seg->laddr = new_segments[order[i]].laddr;
+    }
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        inst->segments[i].laddr      = new_segments[i].laddr;
+        inst->segments[i].paddr      = new_segments[i].paddr;
+        inst->segments[i].vaddr_real = new_segments[i].vaddr_real;
+    }
+    seg_index_build(inst);
+    move_addrs(inst, old, inst->segments);
+    kbelfi_free(old);
+    kbelfi_free(flags);
+    kbelfi_free(order);
+    return true;
+
+abort_staged:
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        if (inst->segments[i].laddr != old[i].laddr)
+            kbelfi_free((void *)inst->segments[i].laddr);
+    }
+    kbelfq_memcpy(inst->segments, old, inst->segments_len * sizeof(kbelf_segment));
+abort_alloc:
+    if (old)
+        kbelfi_free(old);
+    if (flags)
+        kbelfi_free(flags);
+    if (order)
+        kbelfi_free(order);
+abort:
+    return false;
+}
+
+// Test whether a loaded segment needs its caches synchronized by the process that loaded it.
+static inline bool seg_needs_sync(kbelf_segment const *seg) {
+    return !seg->shared && seg->size && (KBELF_CACHE_SYNC_DATA || seg->x);
+}
+
+// Synchronize caches for an instance and `more_len` other instances in one `kbelfx_cache_sync_ranges` call.
+// Overlapping and adjacent segments are merged into one range.
+void kbelfi_cache_sync_insts(kbelf_inst inst, size_t more_len, kbelf_inst const *more) {
+    size_t count = 0;
+    for (size_t i = 0; i <= more_len; i++) {
+        count += (i ? more[i - 1] : inst)->segments_len;
+    }
+    if (!count)
+        return;
+    kbelf_range *ranges = kbelfi_malloc(sizeof(kbelf_range) * count);
+    if (!ranges) {
+        // Synchronize the segments one by one instead.
+        for (size_t i = 0; i <= more_len; i++) {
+            kbelf_inst cur = i ? more[i - 1] : inst;
+            for (size_t j = 0; j < cur->segments_len; j++) {
+                if (seg_needs_sync(&cur->segments[j]))
+                    kbelfx_cache_sync(cur->segments[j].laddr, cur->segments[j].size);
+            }
+        }
+        return;
+    }
+
+    // Collect the segments sorted by address.
+    size_t len = 0;
+    for (size_t i = 0; i <= more_len; i++) {
+        kbelf_inst cur = i ? more[i - 1] : inst;
+        for (size_t j = 0; j < cur->segments_len; j++) {
+            kbelf_segment const *seg = &cur->segments[j];
+            if (!seg_needs_sync(seg))
+                continue;
+            size_t k = len++;
+            for (; k > 0 && ranges[k - 1].laddr > seg->laddr; k--) {
+                ranges[k] = ranges[k - 1];
+            }
+            ranges[k] = (kbelf_range){seg->laddr, seg->size};
+        }
+    }
+
+    // Merge overlapping and adjacent ranges.
+    size_t merged = 0;
+    for (size_t i = 0; i < len; i++) {
+        kbelf_range *last = merged ? &ranges[merged - 1] : NULL;
+        if (last && ranges[i].laddr <= last->laddr + last->size) {
+            if (ranges[i].laddr + ranges[i].size > last->laddr + last->size)
+                last->size = ranges[i].laddr + ranges[i].size - last->laddr;
+        } else {
+            ranges[merged++] = ranges[i];
+        }
+    }
+
+    if (merged) {
+        kbelf_addr bytes = 0;
+        for (size_t i = 0; i < merged; i++) {
+            bytes += ranges[i].size;
+        }
+        KBELF_TRACE_BEGIN(KBELF_PHASE_CACHE_SYNC, inst->file ? inst->file->name : NULL)
+        kbelfx_cache_sync_ranges(ranges, merged);
+        KBELF_TRACE_END(KBELF_PHASE_CACHE_SYNC, inst->file ? inst->file->name : NULL, bytes)
+    }
+    kbelfi_free(ranges);
+}
+
+// Move the segments of a relocated instance to new addresses and fix up the words that depend on them.
+// Returns success status.
+bool kbelf_inst_rebase(kbelf_inst inst, kbelf_segment const *new_segments) {
+    if (!inst || !new_segments)
+        return false;
+    if (!kbelfi_inst_move(inst, new_segments) || !kbelfi_inst_reapply(inst))
+        return false;
+    kbelfi_cache_sync_insts(inst, 0, NULL);
+    return true;
+}
+
+// Load and relocate the page containing a virtual address in a loaded instance.
+// Returns true if the page is present afterwards, false if the address is not in this instance or on error.
+bool kbelf_inst_fault(kbelf_inst inst, kbelf_addr vaddr) {
+    size_t seg_idx, bit;
+    if (!inst || !lazy_locate(inst, vaddr, &seg_idx, &bit))
+        return false;
+    if (!inst->lazy || (inst->lazy_present[bit / 8] & (1 << (bit % 8))))
+        return true;
+    kbelf_segment const *seg = &inst->segments[seg_idx];
+
+    // Clip the page to the segment.
+    kbelf_addr start = vaddr - vaddr % KBELF_PAGE_SIZE;
+    kbelf_addr end   = start + KBELF_PAGE_SIZE;
+    if (start < seg->vaddr_real)
+        start = seg->vaddr_real;
+    if (end > seg->vaddr_real + seg->size)
+        end = seg->vaddr_real + seg->size;
+    kbelf_addr  off   = start - seg->vaddr_real;
+    kbelf_laddr laddr = seg->laddr + off;
+
+    // Initialised data.
+    kbelf_addr file_size = 0;
+    if (off < (kbelf_addr)seg->file_size) {
+        file_size = (kbelf_addr)seg->file_size - off;
+        if (file_size > end - start)
+            file_size = end - start;
+    }
+    if (file_size) {
+        KBELF_TRACE_BEGIN(KBELF_PHASE_SEG_LOAD, inst->file->name)
+        long res = kbelfi_seek(inst->file->fd, seg->file_off + (long)off);
+        if (res < 0)
+            KBELF_ERROR(abort_seg_load, "I/O error");
+        res = kbelfi_load(inst, inst->file->fd, laddr, file_size, end - start);
+        if (res < (long)file_size)
+            KBELF_ERROR(abort_seg_load, "I/O error");
+        KBELF_TRACE_END(KBELF_PHASE_SEG_LOAD, inst->file->name, file_size)
+    } else {
+        kbelfq_memset((void *)laddr, 0, end - start);
+    }
+
+    // Apply pending relocations for this page; relocated words never straddle a page boundary.
+    kbelf_addr req_start = start - seg->vaddr_real + seg->vaddr_req;
+    kbelf_addr req_end   = end - seg->vaddr_real + seg->vaddr_req;
+    size_t     lo = 0, hi = inst->fixups_len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (inst->fixups[mid].offset < req_start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < inst->fixups_len && inst->fixups[lo].offset < req_end; lo++) {
+        kbelf_fixup const *fix = &inst->fixups[lo];
+        if (!kbelfi_fixup_apply(inst, fix))
+            KBELF_ERROR(abort, "Applying relocation 0x" KBELF_FMT_BYTE " failed", fix->type)
+    }
+
+    inst->lazy_present[bit / 8] |= 1 << (bit % 8);
+    if (KBELF_CACHE_SYNC_DATA || seg->x)
+        kbelfx_cache_sync(laddr, end - start);
+    return true;
+
+abort_seg_load:
+    KBELF_TRACE_END(KBELF_PHASE_SEG_LOAD, inst->file->name, 0)
+abort:
+    return false;
+}
+
+// Load and relocate all pages overlapping a range of virtual addresses in a loaded instance.
+// Returns success status.
+bool kbelf_inst_fault_range(kbelf_inst inst, kbelf_addr vaddr, kbelf_addr len) {
+    if (!inst)
+        return false;
+    if (!len)
+        return true;
+    kbelf_addr end = vaddr + len;
+    while (vaddr < end) {
+        if (!kbelf_inst_fault(inst, vaddr))
+            return false;
+        vaddr = vaddr - vaddr % KBELF_PAGE_SIZE + KBELF_PAGE_SIZE;
+    }
+    return true;
+}
+
+// Check whether the page containing a virtual address in a loaded instance is present.
+bool kbelf_inst_is_present(kbelf_inst inst, kbelf_addr vaddr) {
+    size_t seg_idx, bit;
+    if (!inst || !lazy_locate(inst, vaddr, &seg_idx, &bit))
+        return false;
+    return !inst->lazy || (inst->lazy_present[bit / 8] & (1 << (bit % 8)));
+}
+
+// Default discard hook that keeps the memory.
+__attribute__((weak)) void kbelfx_seg_discard(kbelf_inst inst, kbelf_range range) {
+    (void)inst;
+    (void)range;
+}
+
+// Add the part of a table that lies in one non-shared segment to the reclaimable ranges.
+static void reclaim_add(kbelf_inst inst, kbelf_range *ranges, size_t *len, kbelf_laddr laddr, kbelf_addr size) {
+    if (!laddr || !size)
+        return;
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        kbelf_segment const *seg = &inst->segments[i];
+        if (laddr < seg->laddr || laddr >= seg->laddr + seg->size)
+            continue;
+        if (seg->shared)
+            return;
+        if (size > seg->laddr + seg->size - laddr)
+            size = seg->laddr + seg->size - laddr;
+        ranges[(*len)++] = (kbelf_range){laddr, size};
+        return;
+    }
+}
+
+// Get the page-aligned ranges of a relocated instance that only hold relocation tables and, unless `keep_symbols`
+// is set, the dynamic symbol, string and hash tables. Writes at most `cap` ranges to `ranges`.
+// Returns the number of ranges.
+size_t kbelf_inst_reclaimable(kbelf_inst inst, bool keep_symbols, kbelf_range *ranges, size_t cap) {
+    if (!inst || inst->lazy || inst->reclaimed)
+        return 0;
+
+    // Find the tables.
+    kbelf_range          tabs[KBELF_RECLAIM_MAX];
+    size_t               tabs_len = 0;
+    kbelf_dyninfo const *info     = &inst->dyninfo;
+    kbelf_dyntab const  *rels[]   = {&info->rel, &info->rela, &info->jmprel, &info->relr};
+    for (size_t i = 0; i < sizeof(rels) / sizeof(rels[0]); i++) {
+        if (rels[i]->vaddr)
+            reclaim_add(inst, tabs, &tabs_len, kbelf_inst_getladdr(inst, rels[i]->vaddr), rels[i]->size);
+    }
+    if (!keep_symbols) {
+        reclaim_add(inst, tabs, &tabs_len, inst->dynsym, inst->dynsym_len * sizeof(kbelf_symentry));
+        reclaim_add(inst, tabs, &tabs_len, inst->dynstr, inst->dynstr_len);
+        if (info->hash) {
+            kbelf_laddr laddr     = kbelf_inst_getladdr(inst, info->hash);
+            uint32_t    counts[2] = {0, 0};
+            if (laddr && kbelfi_copy_from_user(inst, counts, laddr, sizeof(counts)))
+                reclaim_add(inst, tabs, &tabs_len, laddr, (2 + (kbelf_addr)counts[0] + counts[1]) * sizeof(uint32_t));
+        }
+    }
+
+    // Sort the tables by address.
+    for (size_t i = 1; i < tabs_len; i++) {
+        kbelf_range tmp = tabs[i];
+        size_t      j   = i;
+        for (; j > 0 && tabs[j - 1].laddr > tmp.laddr; j--) {
+            tabs[j] = tabs[j - 1];
+        }
+        tabs[j] = tmp;
+    }
+
+    // Merge adjacent tables and keep only the whole pages they cover.
+    size_t len = 0;
+    for (size_t i = 0; i < tabs_len;) {
+        kbelf_laddr start = tabs[i].laddr;
+        kbelf_laddr end   = start + tabs[i].size;
+        for (i++; i < tabs_len && tabs[i].laddr <= end; i++) {
+            if (tabs[i].laddr + tabs[i].size > end)
+                end = tabs[i].laddr + tabs[i].size;
+        }
+        start = (start + KBELF_PAGE_SIZE - 1) / KBELF_PAGE_SIZE * KBELF_PAGE_SIZE;
+        end   = end / KBELF_PAGE_SIZE * KBELF_PAGE_SIZE;
+        if (end <= start)
+            continue;
+        if (len < cap)
+            ranges[len] = (kbelf_range){start, end - start};
+        len++;
+    }
+    return len;
+}
+
+// Pass the ranges from `kbelf_inst_reclaimable` to `kbelfx_seg_discard`.
+// Symbol lookups in this instance are no longer possible unless `keep_symbols` is set.
+// Returns the number of bytes discarded.
+kbelf_addr kbelf_inst_reclaim(kbelf_inst inst, bool keep_symbols) {
+    if (!inst || inst->lazy || inst->reclaimed)
+        return 0;
+    kbelf_range ranges[KBELF_RECLAIM_MAX];
+    size_t      len   = kbelf_inst_reclaimable(inst, keep_symbols, ranges, KBELF_RECLAIM_MAX);
+    kbelf_addr  total = 0;
+    for (size_t i = 0; i < len; i++) {
+        kbelfx_seg_discard(inst, ranges[i]);
+        total += ranges[i].size;
+    }
+
+    // Forget the tables that may lie in discarded memory.
+    inst->reclaimed      = true;
+    inst->dyninfo.rel    = (kbelf_dyntab){0, 0, 0};
+    inst->dyninfo.rela   = (kbelf_dyntab){0, 0, 0};
+    inst->dyninfo.jmprel = (kbelf_dyntab){0, 0, 0};
+    inst->dyninfo.relr   = (kbelf_dyntab){0, 0, 0};
+    if (!keep_symbols) {
+        inst->dyninfo.hash = 0;
+        inst->dynsym_len   = 0;
+        inst->dynsym       = 0;
+        inst->dynstr_len   = 0;
+        inst->dynstr       = 0;
+    }
+    return total;
+}
+
 // Get a pointer to the file from which this was created.
 kbelf_file kbelf_inst_getfile(kbelf_inst inst) {
     return inst->file;
@@ -222,21 +1141,44 @@ kbelf_file kbelf_inst_getfile(kbelf_inst inst) {
 void kbelf_inst_unload(kbelf_inst inst) {
     if (!inst)
         return;
+    if (inst->compact) {
+        // Freed together with the finalized `kbelf_dyn`.
+        kbelfx_seg_free(inst, inst->segments_len, inst->segments);
+        kbelfi_libcache_release(inst);
+        return;
+    }
     if (inst->segments_len) {
         kbelfx_seg_free(inst, inst->segments_len, inst->segments);
-        kbelfx_free(inst->segments);
+        kbelfi_libcache_release(inst);
+        kbelfi_free(inst->segments);
     }
-    kbelfx_free(inst);
+    if (inst->seg_index)
+        kbelfi_free(inst->seg_index);
+    if (inst->lazy_present)
+        kbelfi_free(inst->lazy_present);
+    if (inst->fixups)
+        kbelfi_free(inst->fixups);
+    if (inst->dyninfo.needed)
+        kbelfi_free(inst->dyninfo.needed);
+    kbelfi_free(inst);
 }
 
 // Clean up the instance handle but not the loaded segments.
 void kbelf_inst_destroy(kbelf_inst inst) {
-    if (!inst)
+    if (!inst || inst->compact)
         return;
     if (inst->segments_len) {
-        kbelfx_free(inst->segments);
+        kbelfi_free(inst->segments);
     }
-    kbelfx_free(inst);
+    if (inst->seg_index)
+        kbelfi_free(inst->seg_index);
+    if (inst->lazy_present)
+        kbelfi_free(inst->lazy_present);
+    if (inst->fixups)
+        kbelfi_free(inst->fixups);
+    if (inst->dyninfo.needed)
+        kbelfi_free(inst->dyninfo.needed);
+    kbelfi_free(inst);
 }
 
 
@@ -254,12 +1196,11 @@ int kbelf_inst_getpid(kbelf_inst inst) {
 long kbelf_inst_getoff(kbelf_inst inst, kbelf_addr vaddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (vaddr >= inst->segments[i].vaddr_req && vaddr < inst->segments[i].vaddr_req + inst->segments[i].size) {
-            return (long)vaddr - (long)inst->segments[i].vaddr_req + (long)inst->segments[i].file_off;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_REQ, vaddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return (long)vaddr - (long)seg->vaddr_req + (long)seg->file_off;
 }
 
 // Translate a virtual address to a load address in a loaded instance.
@@ -267,108 +1208,99 @@ long kbelf_inst_getoff(kbelf_inst inst, kbelf_addr vaddr) {
 kbelf_laddr kbelf_inst_getladdr(kbelf_inst inst, kbelf_addr vaddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (vaddr >= inst->segments[i].vaddr_req && vaddr < inst->segments[i].vaddr_req + inst->segments[i].size) {
-            return (kbelf_laddr)vaddr - (kbelf_laddr)inst->segments[i].vaddr_req + inst->segments[i].laddr;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_REQ, vaddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return (kbelf_laddr)vaddr - (kbelf_laddr)seg->vaddr_req + seg->laddr;
 }
 
 // Translate a virtual address to a physical address in a loaded instance.
 kbelf_addr kbelf_inst_getpaddr(kbelf_inst inst, kbelf_addr vaddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (vaddr >= inst->segments[i].vaddr_req && vaddr < inst->segments[i].vaddr_req + inst->segments[i].size) {
-            return vaddr - inst->segments[i].vaddr_req + inst->segments[i].paddr;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_REQ, vaddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return vaddr - seg->vaddr_req + seg->paddr;
 }
 
 // Translate a virtual address to a virtual address in a loaded instance.
 kbelf_addr kbelf_inst_getvaddr(kbelf_inst inst, kbelf_addr vaddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (vaddr >= inst->segments[i].vaddr_req && vaddr < inst->segments[i].vaddr_req + inst->segments[i].size) {
-            return vaddr - inst->segments[i].vaddr_req + inst->segments[i].vaddr_real;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_REQ, vaddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return vaddr - seg->vaddr_req + seg->vaddr_real;
 }
 
 // Translate a virtual address in a loaded instance to a physical address in a loaded instance.
 kbelf_addr kbelf_inst_vaddr_to_paddr(kbelf_inst inst, kbelf_addr vaddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (vaddr >= inst->segments[i].vaddr_real && vaddr < inst->segments[i].vaddr_real + inst->segments[i].size) {
-            return vaddr - inst->segments[i].vaddr_real + inst->segments[i].paddr;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_REAL, vaddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return vaddr - seg->vaddr_real + seg->paddr;
 }
 
 // Translate a virtual address in a loaded instance to a load address in a loaded instance.
 kbelf_laddr kbelf_inst_vaddr_to_laddr(kbelf_inst inst, kbelf_addr vaddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (vaddr >= inst->segments[i].vaddr_real && vaddr < inst->segments[i].vaddr_real + inst->segments[i].size) {
-            return (kbelf_laddr)vaddr - (kbelf_laddr)inst->segments[i].vaddr_real + inst->segments[i].laddr;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_REAL, vaddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return (kbelf_laddr)vaddr - (kbelf_laddr)seg->vaddr_real + seg->laddr;
 }
 
 // Translate a physical address in a loaded instance to a virtual address in a loaded instance.
 kbelf_addr kbelf_inst_paddr_to_vaddr(kbelf_inst inst, kbelf_addr vaddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (vaddr >= inst->segments[i].paddr && vaddr < inst->segments[i].paddr + inst->segments[i].size) {
-            return vaddr - inst->segments[i].paddr + inst->segments[i].vaddr_real;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_PHYS, vaddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return vaddr - seg->paddr + seg->vaddr_real;
 }
 
 // Translate a physical address in a loaded instance to a load address in a loaded instance.
 kbelf_laddr kbelf_inst_paddr_to_laddr(kbelf_inst inst, kbelf_addr vaddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (vaddr >= inst->segments[i].paddr && vaddr < inst->segments[i].paddr + inst->segments[i].size) {
-            return (kbelf_laddr)vaddr - (kbelf_laddr)inst->segments[i].paddr + inst->segments[i].laddr;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_PHYS, vaddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return (kbelf_laddr)vaddr - (kbelf_laddr)seg->paddr + seg->laddr;
 }
 
 // Translate a load address in a loaded instance to a virtual address in a loaded instance.
 kbelf_addr kbelf_inst_laddr_to_vaddr(kbelf_inst inst, kbelf_laddr laddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (laddr >= inst->segments[i].laddr && laddr < inst->segments[i].laddr + inst->segments[i].size) {
-            return (kbelf_addr)laddr - (kbelf_addr)inst->segments[i].laddr + inst->segments[i].vaddr_real;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_LOAD, laddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return (kbelf_addr)laddr - (kbelf_addr)seg->laddr + seg->vaddr_real;
 }
 
 // Translate a load address in a loaded instance to a physical address in a loaded instance.
 kbelf_addr kbelf_inst_laddr_to_paddr(kbelf_inst inst, kbelf_laddr laddr) {
     if (!inst)
         return 0;
-    for (size_t i = 0; i < inst->segments_len; i++) {
-        if (laddr >= inst->segments[i].laddr && laddr < inst->segments[i].laddr + inst->segments[i].size) {
-            return (kbelf_addr)laddr - (kbelf_addr)inst->segments[i].laddr + inst->segments[i].paddr;
-        }
-    }
-    return 0;
+    size_t i = seg_find(inst, KBELF_SPACE_LOAD, laddr);
+    if (i == inst->segments_len)
+        return 0;
+    kbelf_segment const *seg = &inst->segments[i];
+    return (kbelf_addr)laddr - (kbelf_addr)seg->laddr + seg->paddr;
 }
 
 
@@ -410,7 +1342,7 @@ kbelf_addr kbelf_inst_init_get(kbelf_inst inst, size_t index) {
 
 // Get the number of finalisation functions.
 size_t kbelf_inst_fini_len(kbelf_inst inst) {
-    return inst ? inst->fini_array_len + !!inst->init_func : 0;
+    return inst ? inst->fini_array_len + !!inst->fini_func : 0;
 }
 
 // Get virtual finalisation function address of a loaded instance.
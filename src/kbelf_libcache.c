@@ -0,0 +1,195 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#define KBELF_REVEAL_PRIVATE
+#include <kbelf.h>
+#include <kbelf/internal.h>
+
+// Create an empty cache of library segments shared between processes.
+// Returns non-null on success, NULL on error.
+kbelf_libcache kbelf_libcache_create() {
+    kbelf_libcache cache = kbelfi_malloc(sizeof(struct struct_kbelf_libcache));
+    if (!cache)
+        return NULL;
+    kbelfq_memset(cache, 0, sizeof(struct struct_kbelf_libcache));
+    return cache;
+}
+
+// Clean up a `kbelf_libcache` context.
+// Shared segments stay loaded until the last process using them is unloaded.
+void kbelf_libcache_destroy(kbelf_libcache cache) {
+    if (!cache)
+        return;
+    for (size_t i = 0; i < cache->entries_len; i++) {
+        cache->entries[i]->cache = NULL;
+    }
+    if (cache->entries)
+        kbelfi_free(cache->entries);
+    kbelfi_free(cache);
+}
+
+// Stop sharing the segments of `path` with future loads, or of all files if `path` is NULL.
+// Instances already using them keep them until they are unloaded.
+void kbelf_libcache_invalidate(kbelf_libcache cache, char const *path) {
+    if (!cache)
+        return;
+    for (size_t i = 0; i < cache->entries_len;) {
+        if (path && !kbelfq_streq(cache->entries[i]->path, path)) {
+            i++;
+            continue;
+        }
+        cache->entries[i]->cache = NULL;
+        cache->entries[i]        = cache->entries[--cache->entries_len];
+    }
+    if (!cache->entries_len && cache->entries) {
+        kbelfi_free(cache->entries);
+        cache->entries = NULL;
+    }
+}
+
+// Find the cache entry for a file path.
+kbelf_libent *kbelfi_libcache_find(kbelf_libcache cache, char const *path) {
+    if (!cache)
+        return NULL;
+    for (size_t i = 0; i < cache->entries_len; i++) {
+        if (kbelfq_streq(cache->entries[i]->path, path))
+            return cache->entries[i];
+    }
+    return NULL;
+}
+
+// Share the read-only segments of a relocated instance that contain no relocations with future loads of the same
+// file. Marks those segments as `shared`. Returns success status.
+bool kbelf_libcache_add(kbelf_libcache cache, kbelf_inst inst) {
+    bool         *shareable = NULL;
+    bool         *relocated = NULL;
+    kbelf_libent *ent       = NULL;
+    if (!cache || !inst || inst->lazy)
+        return false;
+    if (inst->libent || kbelfi_libcache_find(cache, inst->file->path))
+        return true;
+
+    // Read-only segments are candidates for sharing.
+    shareable = kbelfi_malloc(sizeof(bool) * inst->segments_len);
+    relocated = kbelfi_malloc(sizeof(bool) * inst->segments_len);
+    if (!shareable || !relocated)
+        KBELF_ERROR(abort, "Out of memory")
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        shareable[i] = !inst->segments[i].w;
+    }
+
+    // Segments that were relocated differ between processes.
+    if (!kbelfi_reloc_targets(inst, relocated))
+        goto abort;
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        shareable[i] &= !relocated[i];
+    }
+
+    size_t shared_len = 0;
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        shared_len += shareable[i];
+    }
+    if (!shared_len) {
+        kbelfi_free(shareable);
+        kbelfi_free(relocated);
+        return true;
+    }
+
+    // Create the cache entry.
+    ent = kbelfi_malloc(sizeof(kbelf_libent));
+    if (!ent)
+        KBELF_ERROR(abort, "Out of memory")
+    kbelfq_memset(ent, 0, sizeof(kbelf_libent));
+    ent->path     = kbelfi_malloc(kbelfq_strlen(inst->file->path) + 1);
+    ent->segments = kbelfi_malloc(sizeof(kbelf_segment) * inst->segments_len);
+    if (!ent->path || !ent->segments)
+        KBELF_ERROR(abort, "Out of memory")
+    kbelfq_strcpy(ent->path, inst->file->path);
+    void *mem = kbelfi_realloc(cache->entries, sizeof(kbelf_libent *) * (cache->entries_len + 1));
+    if (!mem)
+        KBELF_ERROR(abort, "Out of memory")
+    cache->entries                       = mem;
+    cache->entries[cache->entries_len++] = ent;
+    ent->cache                           = cache;
+    ent->refcount                        = 1;
+    ent->segments_len                    = inst->segments_len;
+
+    // Hand the shareable segments over to the cache entry.
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        inst->segments[i].shared = shareable[i];
+        ent->segments[i]         = inst->segments[i];
+    }
+    inst->libent = ent;
+    kbelfi_free(shareable);
+    kbelfi_free(relocated);
+    return true;
+
+abort:
+    if (ent) {
+        if (ent->path)
+            kbelfi_free(ent->path);
+        if (ent->segments)
+            kbelfi_free(ent->segments);
+        kbelfi_free(ent);
+    }
+    if (shareable)
+        kbelfi_free(shareable);
+    if (relocated)
+        kbelfi_free(relocated);
+    return false;
+}
+
+// Drop an instance's reference to its shared library segments.
+// Releases the segments with `kbelfx_seg_free` when the last reference is dropped.
+void kbelfi_libcache_release(kbelf_inst inst) {
+    kbelf_libent *ent = inst->libent;
+    if (!ent)
+        return;
+    inst->libent = NULL;
+    if (--ent->refcount)
+        return;
+
+    // Remove from the cache.
+    kbelf_libcache cache = ent->cache;
+    for (size_t i = 0; cache && i < cache->entries_len; i++) {
+        if (cache->entries[i] == ent) {
+            cache->entries[i] = cache->entries[--cache->entries_len];
+            break;
+        }
+    }
+
+    // Release the shared segments.
+    size_t shared_len = 0;
+    for (size_t i = 0; i < ent->segments_len; i++) {
+        if (ent->segments[i].shared) {
+            ent->segments[shared_len]        = ent->segments[i];
+            ent->segments[shared_len].shared = false;
+            shared_len++;
+        }
+    }
+    kbelfx_seg_free(inst, shared_len, ent->segments);
+    kbelfi_free(ent->path);
+    kbelfi_free(ent->segments);
+    kbelfi_free(ent);
+}
@@ -24,11 +24,12 @@
 
 #define KBELF_REVEAL_PRIVATE
 #include <kbelf.h>
+#include <kbelf/internal.h>
 #include <kbelf/port.h>
 
 // Create an empty relocation context.
 kbelf_reloc kbelf_reloc_create() {
-    kbelf_reloc reloc = kbelfx_malloc(sizeof(struct struct_kbelf_reloc));
+    kbelf_reloc reloc = kbelfi_malloc(sizeof(struct struct_kbelf_reloc));
     if (!reloc)
         return NULL;
     kbelfq_memset(reloc, 0, sizeof(struct struct_kbelf_reloc));
@@ -39,38 +40,67 @@ kbelf_reloc kbelf_reloc_create() {
 void kbelf_reloc_destroy(kbelf_reloc reloc) {
     if (!reloc)
         return;
-    if (reloc->libs_file)
-        kbelfx_free(reloc->libs_file);
-    if (reloc->libs_inst)
-        kbelfx_free(reloc->libs_inst);
-    if (reloc->builtins)
-        kbelfx_free(reloc->builtins);
-    kbelfx_free(reloc);
+    kbelfi_arena_free(&reloc->arena);
+    kbelfi_free(reloc);
+}
+
+// Set whether to keep the applied relocations in the instances so they can be applied again.
+void kbelf_reloc_set_keep_fixups(kbelf_reloc reloc, bool keep) {
+    if (reloc)
+        reloc->keep_fixups = keep;
 }
 
 // Compute the value of a symbol.
-static inline kbelf_addr get_sym_value(kbelf_file file, kbelf_inst inst, kbelf_symentry sym) {
+// The value is relative to the defining instance, which is NULL for absolute symbols.
+static inline kbelf_addr get_sym_value(kbelf_file file, kbelf_inst inst, kbelf_symentry sym, kbelf_inst *out_def) {
     (void)file;
-    if (sym.section == SHN_ABS) {
-        return sym.value;
-    } else {
-        return kbelf_inst_getvaddr(inst, sym.value);
+    *out_def = sym.section == SHN_ABS ? NULL : inst;
+    return sym.value;
+}
+
+// Read a string from the dynamic string table of an instance into a buffer that grows as needed.
+// Returns non-null on success, NULL on error.
+static char *read_name(kbelf_reloc reloc, char **buf, size_t *cap, kbelf_inst inst, kbelf_addr offset) {
+    ptrdiff_t len = kbelfx_strlen_from_user(inst, inst->dynstr + offset);
+    if (len < 0)
+        return NULL;
+    if ((size_t)len >= *cap) {
+        // Double the capacity until the name fits.
+        size_t new_cap = *cap ? 2 * *cap : 32;
+        while (new_cap <= (size_t)len) {
+            new_cap *= 2;
+        }
+        char *mem = kbelfi_arena_alloc(&reloc->arena, new_cap);
+        if (!mem)
+            return NULL;
+        *buf = mem;
+        *cap = new_cap;
     }
+    if (!kbelfi_copy_from_user(inst, *buf, inst->dynstr + offset, len + 1) || (*buf)[len])
+        return NULL;
+    return *buf;
 }
 
 // Look up a symbol in a relocation context.
-static bool find_sym(kbelf_reloc reloc, char const *sym_name, kbelf_addr *out_val) {
+static bool find_sym(kbelf_reloc reloc, char const *sym_name, kbelf_addr *out_val, kbelf_inst *out_def) {
     // TODO: Proper handling of "symbolic" (own file first instead of default order) linking.
-    bool found = false;
+    bool   found    = false;
+    size_t compared = 0;
+    KBELF_TRACE_BEGIN(KBELF_PHASE_SYMBOL, sym_name)
+    KBELF_STAT(sym_lookups, 1)
 
     for (size_t x = 0; x < reloc->builtins_len; x++) {
         // Look up builtin library.
         kbelf_builtin_lib const *lib = reloc->builtins[x];
         for (size_t y = 0; y < lib->symbols_len; y++) {
             kbelf_builtin_sym sym = lib->symbols[y];
+            compared++;
+            KBELF_STAT(str_compares, 1)
             if (!kbelfq_streq(sym.name, sym_name))
                 continue;
             *out_val = sym.vaddr;
+            *out_def = NULL;
+            KBELF_TRACE_END(KBELF_PHASE_SYMBOL, sym_name, compared)
             return true;
         }
     }
@@ -81,7 +111,7 @@ static bool find_sym(kbelf_reloc reloc, char const *sym_name, kbelf_addr *out_va
         kbelf_inst inst = reloc->libs_inst[x];
         for (size_t y = 1; y < inst->dynsym_len; y++) {
             kbelf_symentry sym = {0};
-            if (!kbelfx_copy_from_user(inst, &sym, inst->dynsym + y * sizeof(kbelf_symentry), sizeof(kbelf_symentry)))
+            if (!kbelfi_copy_from_user(inst, &sym, inst->dynsym + y * sizeof(kbelf_symentry), sizeof(kbelf_symentry)))
                 KBELF_ERROR(abort, "Invalid rel section (index out of bounds)")
             // Compare the type.
             if (!sym.section)
@@ -90,29 +120,27 @@ static bool find_sym(kbelf_reloc reloc, char const *sym_name, kbelf_addr *out_va
             if (KBELF_ST_BIND(sym.info) == STB_LOCAL)
                 continue;
             // Compare the name.
-            ptrdiff_t len = kbelfx_strlen_from_user(inst, inst->dynstr + sym.name_index);
-            if (len < 0)
-                KBELF_ERROR(abort, "Invalid rel section (index out of bounds)")
-            char *name = kbelfx_malloc(len + 1);
+            char const *name = read_name(reloc, &reloc->candname, &reloc->candname_cap, inst, sym.name_index);
             if (!name)
-                KBELF_ERROR(abort, "Out of memory")
-            if (!kbelfx_copy_from_user(inst, name, inst->dynstr + sym.name_index, len + 1) || name[len])
                 KBELF_ERROR(abort, "Invalid rel section (index out of bounds)")
-            if (!kbelfq_streq(name, sym_name)) {
-                kbelfx_free(name);
+            compared++;
+            KBELF_STAT(str_compares, 1)
+            if (!kbelfq_streq(name, sym_name))
                 continue;
-            }
-            kbelfx_free(name);
             // Eliminate the weak.
-            *out_val = get_sym_value(file, inst, sym);
-            if (KBELF_ST_BIND(sym.info) != STB_WEAK)
+            *out_val = get_sym_value(file, inst, sym, out_def);
+            if (KBELF_ST_BIND(sym.info) != STB_WEAK) {
+                KBELF_TRACE_END(KBELF_PHASE_SYMBOL, sym_name, compared)
                 return true;
+            }
             found = true;
         }
     }
 
+    KBELF_TRACE_END(KBELF_PHASE_SYMBOL, sym_name, compared)
     return found;
 abort:
+    KBELF_TRACE_END(KBELF_PHASE_SYMBOL, sym_name, 0)
     return false;
 }
 
@@ -131,34 +159,34 @@ static bool rel_perform(kbelf_reloc reloc, kbelf_file file, kbelf_inst inst, siz
 static bool rela_perform(kbelf_reloc reloc, kbelf_file file, kbelf_inst inst, size_t relatab_len, kbelf_laddr relatab) {
     for (size_t i = 0; i < relatab_len; i++) {
         kbelf_relaentry ent = {0};
-        if (!kbelfx_copy_from_user(inst, &ent, relatab + i * sizeof(kbelf_relaentry), sizeof(kbelf_relaentry)))
+        if (!kbelfi_copy_from_user(inst, &ent, relatab + i * sizeof(kbelf_relaentry), sizeof(kbelf_relaentry)))
             KBELF_ERROR(abort, "Invalid rela table (index out of bounds)")
         kbelf_laddr    laddr  = kbelf_inst_getladdr(inst, ent.offset);
         size_t         sym    = KBELF_R_SYM(ent.info);
         uint_fast8_t   type   = KBELF_R_TYPE(ent.info);
         kbelf_addrdiff addend = ent.addend;
-        kbelf_addr     symval;
-        if (sym == 0) {
-            symval = 0;
-        } else {
+        kbelf_addr     symval = 0;
+        kbelf_inst     def    = NULL;
+        KBELF_STAT_RELOC(type)
+        if (sym != 0) {
             kbelf_symentry st = {0};
-            if (!kbelfx_copy_from_user(inst, &st, inst->dynsym + sym * sizeof(kbelf_symentry), sizeof(kbelf_symentry)))
-                KBELF_ERROR(abort, "Unable to find anonymous symbol " KBELF_FMT_SIZE, (int)sym)
-            ptrdiff_t len = kbelfx_strlen_from_user(inst, inst->dynstr + st.name_index);
-            if (len < 0)
+            if (!kbelfi_copy_from_user(inst, &st, inst->dynsym + sym * sizeof(kbelf_symentry), sizeof(kbelf_symentry)))
                 KBELF_ERROR(abort, "Unable to find anonymous symbol " KBELF_FMT_SIZE, (int)sym)
-            char *symname = kbelfx_malloc(len + 1);
+            char const *symname = read_name(reloc, &reloc->symname, &reloc->symname_cap, inst, st.name_index);
             if (!symname)
-                KBELF_ERROR(abort, "Out of memory")
-            if (!kbelfx_copy_from_user(inst, symname, inst->dynstr + st.name_index, len + 1) || symname[len]) {
-                kbelfx_free(symname);
                 KBELF_ERROR(abort, "Unable to find anonymous symbol " KBELF_FMT_SIZE, (int)sym)
-            }
-            bool found = find_sym(reloc, symname, &symval);
-            if (!found)
+            if (!find_sym(reloc, symname, &symval, &def))
                 KBELF_ERROR(abort, "Unable to find symbol " KBELF_FMT_CSTR, symname)
-            kbelfx_free(symname);
         }
+        kbelf_fixup fixup = {
+            .offset = ent.offset,
+            .sym    = symval,
+            .addend = addend,
+            .def    = def,
+            .type   = type,
+        };
+        if (def)
+            symval = kbelf_inst_getvaddr(def, symval);
         KBELF_LOGD(
             "Applying relocation " KBELF_FMT_DEC " @ " KBELF_FMT_ADDR ": symval " KBELF_FMT_ADDR
             ", addend " KBELF_FMT_ADDR,
@@ -167,6 +195,15 @@ static bool rela_perform(kbelf_reloc reloc, kbelf_file file, kbelf_inst inst, si
             symval,
             (kbelf_addr)addend
         );
+        if (reloc->keep_fixups) {
+            inst->fixups[inst->fixups_len++] = fixup;
+        }
+        if (inst->lazy && !kbelf_inst_is_present(inst, kbelf_inst_getvaddr(inst, ent.offset))) {
+            // Defer until the page is loaded.
+            if (!reloc->keep_fixups)
+                inst->fixups[inst->fixups_len++] = fixup;
+            continue;
+        }
         bool success = kbelfp_reloc_apply(file, inst, type, symval, addend, laddr);
         if (!success)
             KBELF_ERROR(abort, "Applying relocation 0x" KBELF_FMT_BYTE " failed", type)
@@ -177,6 +214,227 @@ abort:
     return false;
 }
 
+// Decode a RELR table and visit the virtual address of every relocated word as requested by the ELF file.
+static bool relr_walk(
+    kbelf_inst inst, kbelf_dyntab const *tab, bool (*visit)(void *ctx, kbelf_inst inst, kbelf_addr offset), void *ctx
+) {
+    size_t const bits  = 8 * sizeof(kbelf_addr);
+    kbelf_laddr  laddr = kbelf_inst_getladdr(inst, tab->vaddr);
+    kbelf_addr   where = 0;
+    for (size_t i = 0; i < tab->size / sizeof(kbelf_addr); i++) {
+        kbelf_addr ent;
+        if (!kbelfi_copy_from_user(inst, &ent, laddr + i * sizeof(kbelf_addr), sizeof(kbelf_addr)))
+            KBELF_ERROR(abort, "Invalid relr table (index out of bounds)")
+        if (!(ent & 1)) {
+            // Address entry: relocate one word and continue after it.
+            if (!visit(ctx, inst, ent))
+                return false;
+            where = ent + sizeof(kbelf_addr);
+        } else {
+            // Bitmap entry: relocate the words selected by bits 1 and up.
+            for (size_t bit = 1; bit < bits; bit++) {
+                if (((ent >> bit) & 1) && !visit(ctx, inst, where + (bit - 1) * sizeof(kbelf_addr)))
+                    return false;
+            }
+            where += (bits - 1) * sizeof(kbelf_addr);
+        }
+    }
+    return true;
+
+abort:
+    return false;
+}
+
+// Count one relocation from a RELR table.
+static bool relr_count(void *ctx, kbelf_inst inst, kbelf_addr offset) {
+    (void)inst;
+    (void)offset;
+    (*(size_t *)ctx)++;
+    return true;
+}
+
+// Apply one relative relocation from a RELR table.
+static bool relr_apply(void *ctx, kbelf_inst inst, kbelf_addr offset) {
+    kbelf_reloc reloc = ctx;
+    KBELF_STAT(relr_relocs, 1)
+    // The implicit addend is needed, so the page must be present.
+    if (inst->lazy && !kbelf_inst_fault_range(inst, kbelf_inst_getvaddr(inst, offset), sizeof(kbelf_addr)))
+        KBELF_ERROR(abort, "I/O error")
+    kbelf_laddr laddr = kbelf_inst_getladdr(inst, offset);
+    kbelf_addr  addend;
+    if (!kbelfi_copy_from_user(inst, &addend, laddr, sizeof(kbelf_addr)))
+        KBELF_ERROR(abort, "Invalid relr table (index out of bounds)")
+    kbelf_fixup fixup = {
+        .offset = offset,
+        .sym    = 0,
+        .addend = (kbelf_addrdiff)addend,
+        .def    = inst,
+        .type   = KBELF_FIXUP_RELR,
+    };
+    if (reloc->keep_fixups) {
+        inst->fixups[inst->fixups_len++] = fixup;
+    }
+    return kbelfi_fixup_apply(inst, &fixup);
+
+abort:
+    return false;
+}
+
+// Perform all relocations from a RELR table.
+static bool relr_perform(kbelf_reloc reloc, kbelf_inst inst, kbelf_dyntab const *tab) {
+    return relr_walk(inst, tab, relr_apply, reloc);
+}
+
+// Sort deferred or kept relocations by offset.
+static void sort_fixups(kbelf_fixup *arr, size_t len, kbelf_fixup *tmp) {
+    for (size_t width = 1; width < len; width *= 2) {
+        for (size_t lo = 0; lo < len; lo += 2 * width) {
+            size_t mid = lo + width < len ? lo + width : len;
+            size_t hi  = lo + 2 * width < len ? lo + 2 * width : len;
+            for (size_t i = lo, l = lo, r = mid; i < hi; i++) {
+                if (r < hi && (l >= mid || arr[r].offset < arr[l].offset)) {
+                    tmp[i] = arr[r++];
+                } else {
+                    tmp[i] = arr[l++];
+                }
+            }
+        }
+        kbelfq_memcpy(arr, tmp, sizeof(kbelf_fixup) * len);
+    }
+}
+
+// Reserve space for relocations that may be deferred or kept.
+static bool reserve_fixups(kbelf_reloc reloc, kbelf_inst inst, size_t count) {
+    if ((!inst->lazy && !reloc->keep_fixups) || !count)
+        return true;
+    void *mem = kbelfi_realloc(inst->fixups, (inst->fixups_len + count) * sizeof(kbelf_fixup));
+    if (!mem)
+        return false;
+    inst->fixups = mem;
+    return true;
+}
+
+// Sort the deferred or kept relocations and release unused space.
+static bool finish_fixups(kbelf_reloc reloc, kbelf_inst inst) {
+    if (!inst->lazy && !reloc->keep_fixups)
+        return true;
+    inst->fixups_kept = reloc->keep_fixups;
+    if (!inst->fixups_len) {
+        kbelfi_free(inst->fixups);
+        inst->fixups = NULL;
+        return true;
+    }
+    kbelf_fixup *tmp = kbelfi_malloc(sizeof(kbelf_fixup) * inst->fixups_len);
+    if (!tmp)
+        return false;
+    sort_fixups(inst->fixups, inst->fixups_len, tmp);
+    kbelfi_free(tmp);
+    void *mem = kbelfi_realloc(inst->fixups, sizeof(kbelf_fixup) * inst->fixups_len);
+    if (mem)
+        inst->fixups = mem;
+    return true;
+}
+
+// Load the pages of a relocation table if the instance is loaded lazily.
+// Returns success status.
+static bool fault_table(kbelf_inst inst, kbelf_addr vaddr, kbelf_addr size) {
+    return !inst->lazy || kbelf_inst_fault_range(inst, kbelf_inst_getvaddr(inst, vaddr), size);
+}
+
+// Perform the relocations of one instance and count the relocations in its tables in `count`.
+// Returns success status.
+static bool perform_inst(kbelf_reloc reloc, kbelf_file file, kbelf_inst inst, size_t *count) {
+    kbelf_dyninfo const *info = &inst->dyninfo;
+
+    // Apply the RELR first; it is the only table that reads its target words.
+    if (info->relr.size && info->relr.vaddr) {
+        if (info->relr.ent && info->relr.ent != sizeof(kbelf_addr))
+            KBELF_ERROR(abort, "Invalid RELR entry size")
+        if (!fault_table(inst, info->relr.vaddr, info->relr.size))
+            KBELF_ERROR(abort, "I/O error")
+        // Only kept relocations are stored; count them to reserve space once.
+        size_t words = 0;
+        if (reloc->keep_fixups && !relr_walk(inst, &info->relr, relr_count, &words))
+            return false;
+        if (!reserve_fixups(reloc, inst, words))
+            KBELF_ERROR(abort, "Out of memory")
+        if (!relr_perform(reloc, inst, &info->relr))
+            return false;
+        *count += info->relr.size / sizeof(kbelf_addr);
+    }
+
+    // Apply the REL.
+    if (info->rel.size && info->rel.ent && info->rel.vaddr) {
+        if (info->rel.ent != sizeof(kbelf_relentry))
+            KBELF_ERROR(abort, "Invalid REL entry size")
+        if (!fault_table(inst, info->rel.vaddr, info->rel.size))
+            KBELF_ERROR(abort, "I/O error")
+        size_t      len   = info->rel.size / sizeof(kbelf_relentry);
+        kbelf_laddr laddr = kbelf_inst_getladdr(inst, info->rel.vaddr);
+        if (!rel_perform(reloc, file, inst, len, laddr))
+            return false;
+        *count += len;
+    } else if (info->rel.size || info->rel.ent || info->rel.vaddr) {
+        KBELF_LOGW("REL partially present")
+        if (info->rel.vaddr)
+            KBELF_LOGI("DT_REL: present")
+        if (info->rel.size)
+            KBELF_LOGI("DT_RELSZ: present")
+        if (info->rel.ent)
+            KBELF_LOGI("DT_RELENT: present")
+    }
+
+    // Apply the RELA.
+    if (info->rela.size && info->rela.ent && info->rela.vaddr) {
+        if (info->rela.ent != sizeof(kbelf_relaentry))
+            KBELF_ERROR(abort, "Invalid RELA entry size")
+        if (!fault_table(inst, info->rela.vaddr, info->rela.size))
+            KBELF_ERROR(abort, "I/O error")
+        size_t      len   = info->rela.size / sizeof(kbelf_relaentry);
+        kbelf_laddr laddr = kbelf_inst_getladdr(inst, info->rela.vaddr);
+        if (!reserve_fixups(reloc, inst, len))
+            KBELF_ERROR(abort, "Out of memory")
+        if (!rela_perform(reloc, file, inst, len, laddr))
+            return false;
+        *count += len;
+    } else if (info->rela.size || info->rela.ent || info->rela.vaddr) {
+        KBELF_LOGW("RELA partially present")
+        if (info->rela.vaddr)
+            KBELF_LOGI("DT_RELA: present")
+        if (info->rela.size)
+            KBELF_LOGI("DT_RELASZ: present")
+        if (info->rela.ent)
+            KBELF_LOGI("DT_RELAENT: present")
+    }
+
+    // Apply the JMPREL unless the linker already included it in the RELA.
+    bool jmprel_in_rela = info->jmprel.vaddr >= info->rela.vaddr
+                          && info->jmprel.vaddr + info->jmprel.size <= info->rela.vaddr + info->rela.size;
+    if (info->jmprel.size && info->jmprel.vaddr && !jmprel_in_rela) {
+        if (!fault_table(inst, info->jmprel.vaddr, info->jmprel.size))
+            KBELF_ERROR(abort, "I/O error")
+        kbelf_laddr laddr = kbelf_inst_getladdr(inst, info->jmprel.vaddr);
+        if (info->jmprel.ent == sizeof(kbelf_relentry)) {
+            if (!rel_perform(reloc, file, inst, info->jmprel.size / sizeof(kbelf_relentry), laddr))
+                return false;
+            *count += info->jmprel.size / sizeof(kbelf_relentry);
+        } else {
+            if (!reserve_fixups(reloc, inst, info->jmprel.size / sizeof(kbelf_relaentry)))
+                KBELF_ERROR(abort, "Out of memory")
+            if (!rela_perform(reloc, file, inst, info->jmprel.size / sizeof(kbelf_relaentry), laddr))
+                return false;
+            *count += info->jmprel.size / sizeof(kbelf_relaentry);
+        }
+    }
+
+    if (!finish_fixups(reloc, inst))
+        KBELF_ERROR(abort, "Out of memory")
+    return true;
+
+abort:
+    return false;
+}
+
 // Perform the relocation.
 // Returns success status.
 bool kbelf_reloc_perform(kbelf_reloc reloc) {
@@ -184,67 +442,75 @@ bool kbelf_reloc_perform(kbelf_reloc reloc) {
         return false;
     // Iterate objects.
     for (size_t x = 0; x < reloc->libs_len; x++) {
-        kbelf_inst inst = reloc->libs_inst[x];
-        kbelf_file file = reloc->libs_file[x];
+        kbelf_file file  = reloc->libs_file[x];
+        size_t     count = 0;
+        KBELF_TRACE_BEGIN(KBELF_PHASE_RELOC, file->name)
+        bool ok = perform_inst(reloc, file, reloc->libs_inst[x], &count);
+        KBELF_TRACE_END(KBELF_PHASE_RELOC, file->name, ok ? count : 0)
+        if (!ok)
+            return false;
+    }
+    return true;
+}
 
-        size_t     rel_sz = 0, rela_sz = 0;
-        size_t     rel_ent = 0, rela_ent = 0;
-        kbelf_addr rel = 0, rela = 0;
-
-        // Search for REL and RELA tables.
-        for (size_t y = 0; y < inst->dynamic_len; y++) {
-            kbelf_dynentry dyn;
-            if (!kbelfx_copy_from_user(inst, &dyn, inst->dynamic + y * sizeof(kbelf_dynentry), sizeof(kbelf_dynentry)))
-                KBELF_ERROR(abort, "Invalid dynamic section (index out of bounds)")
-            if (dyn.tag == DT_REL) {
-                rel = kbelf_inst_getladdr(inst, dyn.value);
-            } else if (dyn.tag == DT_RELSZ) {
-                rel_sz = dyn.value;
-            } else if (dyn.tag == DT_RELENT) {
-                rel_ent = dyn.value;
-            } else if (dyn.tag == DT_RELA) {
-                rela = kbelf_inst_getladdr(inst, dyn.value);
-            } else if (dyn.tag == DT_RELASZ) {
-                rela_sz = dyn.value;
-            } else if (dyn.tag == DT_RELAENT) {
-                rela_ent = dyn.value;
-            }
-        }
+// Apply a deferred or kept relocation to an instance.
+// Returns success status.
+bool kbelfi_fixup_apply(kbelf_inst inst, kbelf_fixup const *fixup) {
+    if (fixup->type == KBELF_FIXUP_RELR) {
+        kbelf_addr value = inst->segments[0].vaddr_real - inst->segments[0].vaddr_req + (kbelf_addr)fixup->addend;
+        return kbelfi_copy_to_user(inst, kbelf_inst_getladdr(inst, fixup->offset), &value, sizeof(kbelf_addr));
+    }
+    kbelf_addr symval = fixup->def ? kbelf_inst_getvaddr(fixup->def, fixup->sym) : fixup->sym;
+    kbelf_laddr laddr = kbelf_inst_getladdr(inst, fixup->offset);
+    return kbelfp_reloc_apply(inst->file, inst, fixup->type, symval, fixup->addend, laddr);
+}
 
-        // Apply the REL.
-        if (rel_sz && rel_ent && rel) {
-            if (rel_ent != sizeof(kbelf_relentry))
-                KBELF_ERROR(abort, "Invalid REL entry size")
-            if (!rel_perform(reloc, file, inst, rel_sz / sizeof(kbelf_relentry), rel))
-                return false;
-        } else if (rel_sz || rel_ent || rel) {
-            KBELF_LOGW("REL partially present")
-            if (rel)
-                KBELF_LOGI("DT_REL: present")
-            if (rel_sz)
-                KBELF_LOGI("DT_RELSZ: present")
-            if (rel_ent)
-                KBELF_LOGI("DT_RELENT: present")
+// Mark the segment containing a relocated word.
+static void mark_segment(kbelf_inst inst, bool *relocated, kbelf_addr offset) {
+    for (size_t x = 0; x < inst->segments_len; x++) {
+        kbelf_segment const *seg = &inst->segments[x];
+        if (offset >= seg->vaddr_req && offset < seg->vaddr_req + seg->size) {
+            relocated[x] = true;
+            return;
         }
+    }
+}
 
-        // Apply the RELA.
-        if (rela_sz && rela_ent && rela) {
-            if (rela_ent != sizeof(kbelf_relaentry))
-                KBELF_ERROR(abort, "Invalid RELA entry size")
-            if (!rela_perform(reloc, file, inst, rela_sz / sizeof(kbelf_relaentry), rela))
-                return false;
-        } else if (rela_sz || rela_ent || rela) {
-            KBELF_LOGW("RELA partially present")
-            if (rela)
-                KBELF_LOGI("DT_RELA: present")
-            if (rela_sz)
-                KBELF_LOGI("DT_RELASZ: present")
-            if (rela_ent)
-                KBELF_LOGI("DT_RELAENT: present")
-        }
+// Mark the segments targeted by a relocation table.
+static bool mark_reloc_targets(kbelf_inst inst, bool *relocated, kbelf_addr table, size_t table_sz, size_t ent_sz) {
+    if (!table || !ent_sz)
+        return true;
+    kbelf_laddr laddr = kbelf_inst_getladdr(inst, table);
+    for (size_t i = 0; i < table_sz / ent_sz; i++) {
+        kbelf_addr offset;
+        if (!kbelfi_copy_from_user(inst, &offset, laddr + i * ent_sz, sizeof(kbelf_addr)))
+            KBELF_ERROR(abort, "Invalid relocation table (index out of bounds)")
+        mark_segment(inst, relocated, offset);
     }
+    return true;
 
+abort:
+    return false;
+}
+
+// Mark the segment targeted by a relocation from a RELR table.
+static bool mark_relr_target(void *ctx, kbelf_inst inst, kbelf_addr offset) {
+    mark_segment(inst, ctx, offset);
     return true;
+}
+
+// Determine which segments of a loaded instance are written by relocations.
+// Returns success status.
+bool kbelfi_reloc_targets(kbelf_inst inst, bool *relocated) {
+    if (inst->reclaimed)
+        KBELF_ERROR(abort, "Relocation tables of " KBELF_FMT_CSTR " were reclaimed", inst->file->path)
+    kbelfq_memset(relocated, 0, sizeof(bool) * inst->segments_len);
+    kbelf_dyninfo const *info = &inst->dyninfo;
+    if (info->relr.size && info->relr.vaddr && !relr_walk(inst, &info->relr, mark_relr_target, relocated))
+        return false;
+    return mark_reloc_targets(inst, relocated, info->rel.vaddr, info->rel.size, sizeof(kbelf_relentry))
+           && mark_reloc_targets(inst, relocated, info->rela.vaddr, info->rela.size, sizeof(kbelf_relaentry))
+           && mark_reloc_targets(inst, relocated, info->jmprel.vaddr, info->jmprel.size, info->jmprel.ent);
 
 abort:
     return false;
@@ -255,16 +521,11 @@ abort:
 bool kbelf_reloc_add(kbelf_reloc reloc, kbelf_file file, kbelf_inst inst) {
     if (!reloc || !file || !inst)
         return false;
-    size_t file_sz  = (1 + reloc->libs_len) * sizeof(struct struct_kbelf_file);
-    size_t inst_sz  = (1 + reloc->libs_len) * sizeof(struct struct_kbelf_inst);
-    void  *file_mem = kbelfx_realloc(reloc->libs_file, file_sz);
-    void  *inst_mem = kbelfx_realloc(reloc->libs_inst, inst_sz);
-    if (file_mem)
-        reloc->libs_file = file_mem;
-    if (inst_mem)
-        reloc->libs_inst = inst_mem;
-    if (!file_mem || !inst_mem)
+    size_t file_cap = reloc->libs_cap, inst_cap = reloc->libs_cap;
+    if (!kbelfi_arena_grow(&reloc->arena, &reloc->libs_file, &file_cap, reloc->libs_len, sizeof(kbelf_file))
+        || !kbelfi_arena_grow(&reloc->arena, &reloc->libs_inst, &inst_cap, reloc->libs_len, sizeof(kbelf_inst)))
         return false;
+    reloc->libs_cap = file_cap;
     reloc->libs_file[reloc->libs_len] = file;
     reloc->libs_inst[reloc->libs_len] = inst;
     reloc->libs_len++;
@@ -276,11 +537,9 @@ bool kbelf_reloc_add(kbelf_reloc reloc, kbelf_file file, kbelf_inst inst) {
 bool kbelf_reloc_add_builtin(kbelf_reloc reloc, kbelf_builtin_lib const *lib) {
     if (!reloc || !lib)
         return false;
-    size_t cap = (1 + reloc->builtins_len) * sizeof(kbelf_builtin_lib *);
-    void  *mem = kbelfx_realloc(reloc->builtins, cap);
-    if (!mem)
+    size_t len = reloc->builtins_len;
+    if (!kbelfi_arena_grow(&reloc->arena, &reloc->builtins, &reloc->builtins_cap, len, sizeof(kbelf_builtin_lib *)))
         return false;
-    reloc->builtins                      = mem;
     reloc->builtins[reloc->builtins_len] = lib;
     reloc->builtins_len++;
     return true;
@@ -0,0 +1,446 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#define KBELF_REVEAL_PRIVATE
+#include <kbelf.h>
+#include <kbelf/internal.h>
+
+// Number of symbol table entries read from a file at once.
+#define SYMTAB_CHUNK 16
+
+// Growable text buffer.
+typedef struct {
+    // Buffer holding the text.
+    char  *buf;
+    // Capacity of `buf`.
+    size_t cap;
+    // Length of the text so far.
+    size_t len;
+} strbuf;
+
+// Receives a function found by `visit_funcs`; `name` is not null-terminated.
+// Returns false to stop visiting.
+typedef bool (*func_visitor)(void *ctx, kbelf_addr vaddr, kbelf_addr size, char const *name, size_t name_len);
+
+// State of `kbelf_dyn_export_map`.
+typedef struct {
+    // Line being formatted.
+    strbuf           line;
+    // Writer the lines are passed to.
+    kbelf_map_writer writer;
+    // Context for the writer.
+    void            *ctx;
+} map_export;
+
+// Address-to-symbol index being built.
+typedef struct {
+    // Functions found so far.
+    kbelf_symidx_ent *ents;
+    // Number of functions in `ents`.
+    size_t            len;
+    // Capacity of `ents`.
+    size_t            cap;
+    // Names of the functions, each null-terminated.
+    strbuf            names;
+} symidx_build;
+
+
+
+/* ==== Formatting ==== */
+
+// Make room for `more` characters and a terminator at the end of a text buffer.
+// Returns success status.
+static bool str_reserve(strbuf *str, size_t more) {
+    if (str->len + more < str->cap)
+        return true;
+    size_t cap = str->cap ? str->cap : 64;
+    while (cap <= str->len + more) {
+        cap *= 2;
+    }
+    char *mem = kbelfi_realloc(str->buf, cap);
+    if (!mem)
+        return false;
+    str->buf = mem;
+    str->cap = cap;
+    return true;
+}
+
+// Append characters to a text buffer.
+// Returns success status.
+static bool str_append(strbuf *str, char const *chars, size_t len) {
+    if (!str_reserve(str, len))
+        return false;
+    kbelfq_memcpy(str->buf + str->len, chars, len);
+    str->len += len;
+    return true;
+}
+
+// Append a number in hexadecimal without prefix and leading zeroes to a text buffer.
+// Returns success status.
+static bool str_hex(strbuf *str, kbelf_addr value) {
+    char   digits[2 * sizeof(kbelf_addr)];
+    size_t len = 0;
+    do {
+        len++;
+        digits[sizeof(digits) - len]   = "0123456789abcdef"[value & 15];
+        value                        >>= 4;
+    } while (value);
+    return str_append(str, digits + sizeof(digits) - len, len);
+}
+
+// Start a map record with its address and size.
+// Returns success status.
+static bool line_begin(strbuf *line, kbelf_addr vaddr, kbelf_addr size) {
+    line->len = 0;
+    return str_hex(line, vaddr) && str_append(line, " ", 1) && str_hex(line, size) && str_append(line, " ", 1);
+}
+
+// Finish a map record and pass it to the writer.
+// Returns false on error or if the writer stopped the export.
+static bool line_emit(map_export *exp, kbelf_map_kind kind) {
+    if (!str_append(&exp->line, "\n", 1))
+        KBELF_ERROR(abort, "Out of memory")
+    exp->line.buf[exp->line.len] = 0;
+    return exp->writer(exp->ctx, kind, exp->line.buf);
+abort:
+    return false;
+}
+
+
+
+/* ==== Function symbols ==== */
+
+// Get the virtual address of a function symbol in a loaded instance.
+// Returns false if the symbol is not a function defined in one of its segments.
+static bool sym_func_vaddr(kbelf_inst inst, kbelf_symentry const *sym, kbelf_addr *vaddr) {
+    if (KBELF_ST_TYPE(sym->info) != STT_FUNC || sym->section == SHN_UNDEF)
+        return false;
+    if (sym->section == SHN_ABS) {
+        *vaddr = sym->value;
+        return true;
+    }
+    *vaddr = kbelf_inst_getvaddr(inst, sym->value);
+    return *vaddr != 0;
+}
+
+// Read a section header from a file.
+// Returns success status.
+static bool read_sect(kbelf_file file, size_t index, kbelf_sectheader *sect) {
+    long off = (long)(file->header.sh_offset + index * sizeof(kbelf_sectheader));
+    return kbelfi_seek(file->fd, off) >= 0
+           && kbelfi_read(file->fd, sect, sizeof(kbelf_sectheader)) == sizeof(kbelf_sectheader);
+}
+
+// Find the symbol table in the section headers of a file and read its string table into `file->strtab`.
+// Returns false on error; `found` is set if the file has a symbol table, which is then copied to `symtab`.
+static bool find_symtab(kbelf_file file, kbelf_sectheader *symtab, bool *found) {
+    *found = false;
+    if (!file || !file->fd || !file->header.sh_offset)
+        return true;
+    size_t i;
+    for (i = 0; i < file->header.sh_ent_num; i++) {
+        if (!read_sect(file, i, symtab))
+            KBELF_ERROR(abort, "I/O error")
+        if (symtab->type == SHT_SYMTAB)
+            break;
+    }
+    if (i == file->header.sh_ent_num)
+        return true;
+    if (symtab->entry_size != sizeof(kbelf_symentry))
+        KBELF_ERROR(abort, "Invalid symbol table entry size")
+
+    // The string table is kept with the file for the next lookup.
+    if (!file->strtab) {
+        kbelf_sectheader strtab;
+        if (symtab->link >= file->header.sh_ent_num || !read_sect(file, symtab->link, &strtab))
+            KBELF_ERROR(abort, "I/O error")
+        if (strtab.type != SHT_STRTAB)
+            KBELF_ERROR(abort, "Invalid symbol table string table")
+        file->strtab = kbelfi_malloc(strtab.file_size + 1);
+        if (!file->strtab)
+            KBELF_ERROR(abort, "Out of memory")
+        file->strtab_len = strtab.file_size;
+        if (kbelfi_seek(file->fd, (long)strtab.offset) < 0
+            || kbelfi_read(file->fd, file->strtab, (long)strtab.file_size) != (long)strtab.file_size)
+            KBELF_ERROR(abort, "I/O error")
+        file->strtab[strtab.file_size] = 0;
+    }
+    *found = true;
+    return true;
+
+abort:
+    if (file->strtab) {
+        kbelfi_free(file->strtab);
+        file->strtab     = NULL;
+        file->strtab_len = 0;
+    }
+    return false;
+}
+
+// Visit the functions in a symbol table read from the file of an instance.
+// Returns false on error or if the visitor stopped.
+static bool visit_symtab(kbelf_inst inst, kbelf_sectheader const *symtab, func_visitor visitor, void *ctx) {
+    kbelf_file     file = inst->file;
+    size_t         len  = symtab->file_size / sizeof(kbelf_symentry);
+    kbelf_symentry chunk[SYMTAB_CHUNK];
+    for (size_t i = 0; i < len; i += SYMTAB_CHUNK) {
+        size_t count = len - i < SYMTAB_CHUNK ? len - i : SYMTAB_CHUNK;
+        long   size  = (long)(count * sizeof(kbelf_symentry));
+        if (kbelfi_seek(file->fd, (long)(symtab->offset + i * sizeof(kbelf_symentry))) < 0
+            || kbelfi_read(file->fd, chunk, size) != size)
+            KBELF_ERROR(abort, "I/O error")
+        for (size_t y = 0; y < count; y++) {
+            kbelf_addr vaddr;
+            if (!sym_func_vaddr(inst, &chunk[y], &vaddr))
+                continue;
+            if (chunk[y].name_index >= file->strtab_len)
+                KBELF_ERROR(abort, "Invalid symbol table string table (index out of bounds)")
+            char const *name = file->strtab + chunk[y].name_index;
+            if (!visitor(ctx, vaddr, chunk[y].size, name, kbelfq_strlen(name)))
+                return false;
+        }
+    }
+    return true;
+abort:
+    return false;
+}
+
+// Visit the functions in the dynamic symbol table of an instance; `name` holds each name while it is visited.
+// Returns false on error or if the visitor stopped.
+static bool visit_dynsym(kbelf_inst inst, strbuf *name, func_visitor visitor, void *ctx) {
+    for (size_t i = 1; i < inst->dynsym_len; i++) {
+        kbelf_symentry sym;
+        kbelf_addr     vaddr;
+        if (!kbelfi_copy_from_user(inst, &sym, inst->dynsym + i * sizeof(kbelf_symentry), sizeof(kbelf_symentry)))
+            KBELF_ERROR(abort, "Invalid dynamic symbol table (index out of bounds)")
+        if (!sym_func_vaddr(inst, &sym, &vaddr))
+            continue;
+        ptrdiff_t len = kbelfx_strlen_from_user(inst, inst->dynstr + sym.name_index);
+        if (len < 0)
+            KBELF_ERROR(abort, "Invalid dynamic string table (index out of bounds)")
+        name->len = 0;
+        if (!str_reserve(name, len))
+            KBELF_ERROR(abort, "Out of memory")
+        if (!kbelfi_copy_from_user(inst, name->buf, inst->dynstr + sym.name_index, len))
+            KBELF_ERROR(abort, "Invalid dynamic string table (index out of bounds)")
+        if (!visitor(ctx, vaddr, sym.size, name->buf, len))
+            return false;
+    }
+    return true;
+abort:
+    return false;
+}
+
+// Visit the functions of an instance, from the symbol table in its file if there is one and from the dynamic symbol
+// table otherwise. Returns false on error or if the visitor stopped.
+static bool visit_funcs(kbelf_inst inst, func_visitor visitor, void *ctx) {
+    kbelf_sectheader symtab;
+    bool             has_symtab;
+    if (!find_symtab(inst->file, &symtab, &has_symtab))
+        return false;
+    if (has_symtab)
+        return visit_symtab(inst, &symtab, visitor, ctx);
+    strbuf name = {0};
+    bool   ok   = visit_dynsym(inst, &name, visitor, ctx);
+    if (name.buf)
+        kbelfi_free(name.buf);
+    return ok;
+}
+
+
+
+/* ==== Symbol map ==== */
+
+// Export the loaded segments of an instance.
+// Returns false on error or if the writer stopped the export.
+static bool export_segments(map_export *exp, kbelf_inst inst) {
+    char const *name     = inst->file ? inst->file->name : "?";
+    size_t      name_len = kbelfq_strlen(name);
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        kbelf_segment const *seg      = &inst->segments[i];
+        char                 perms[3] = {seg->r ? 'r' : '-', seg->w ? 'w' : '-', seg->x ? 'x' : '-'};
+        if (!line_begin(&exp->line, seg->vaddr_real, seg->size) || !str_append(&exp->line, name, name_len)
+            || !str_append(&exp->line, " ", 1) || !str_append(&exp->line, perms, 3))
+            KBELF_ERROR(abort, "Out of memory")
+        if (!line_emit(exp, KBELF_MAP_SEGMENT))
+            return false;
+    }
+    return true;
+abort:
+    return false;
+}
+
+// Export a function.
+// Returns false on error or if the writer stopped the export.
+static bool export_func(void *ctx, kbelf_addr vaddr, kbelf_addr size, char const *name, size_t name_len) {
+    map_export *exp = ctx;
+    if (!line_begin(&exp->line, vaddr, size) || !str_append(&exp->line, name, name_len))
+        KBELF_ERROR(abort, "Out of memory")
+    return line_emit(exp, KBELF_MAP_SYMBOL);
+abort:
+    return false;
+}
+
+// Pass a record of every loaded segment and function of the process image to `writer`.
+// Returns false on error or if `writer` stopped the export.
+bool kbelf_dyn_export_map(kbelf_dyn dyn, kbelf_map_writer writer, void *ctx) {
+    if (!dyn || !dyn->exec_inst || !writer)
+        return false;
+    map_export exp = {.writer = writer, .ctx = ctx};
+    bool       ok  = true;
+    for (size_t i = 0; ok && i <= dyn->libs_len; i++) {
+        kbelf_inst inst = i ? dyn->libs_inst[i - 1] : dyn->exec_inst;
+        ok              = export_segments(&exp, inst) && visit_funcs(inst, export_func, &exp);
+    }
+    if (exp.line.buf)
+        kbelfi_free(exp.line.buf);
+    return ok;
+}
+
+
+
+/* ==== Address-to-symbol index ==== */
+
+// Add a function to the index being built; functions without a size cannot contain an address and are skipped.
+// Returns success status.
+static bool index_func(void *ctx, kbelf_addr vaddr, kbelf_addr size, char const *name, size_t name_len) {
+    symidx_build *build = ctx;
+    if (!size)
+        return true;
+    if (build->len == build->cap) {
+        size_t            cap = build->cap ? 2 * build->cap : 64;
+        kbelf_symidx_ent *mem = kbelfi_realloc(build->ents, cap * sizeof(kbelf_symidx_ent));
+        if (!mem)
+            KBELF_ERROR(abort, "Out of memory")
+        build->ents = mem;
+        build->cap  = cap;
+    }
+    build->ents[build->len++] = (kbelf_symidx_ent){.vaddr = vaddr, .size = size, .name = build->names.len};
+    if (!str_append(&build->names, name, name_len) || !str_append(&build->names, "", 1))
+        KBELF_ERROR(abort, "Out of memory")
+    return true;
+abort:
+    return false;
+}
+
+// Sort index entries by address, larger functions first among those at the same address.
+static void sort_index(kbelf_symidx_ent *arr, size_t len, kbelf_symidx_ent *tmp) {
+    for (size_t width = 1; width < len; width *= 2) {
+        for (size_t lo = 0; lo < len; lo += 2 * width) {
+            size_t mid = lo + width < len ? lo + width : len;
+            size_t hi  = lo + 2 * width < len ? lo + 2 * width : len;
+            for (size_t i = lo, l = lo, r = mid; i < hi; i++) {
+                if (r < hi
+                    && (l >= mid || arr[r].vaddr < arr[l].vaddr
+                        || (arr[r].vaddr == arr[l].vaddr && arr[r].size > arr[l].size))) {
+                    tmp[i] = arr[r++];
+                } else {
+                    tmp[i] = arr[l++];
+                }
+            }
+        }
+        kbelfq_memcpy(arr, tmp, sizeof(kbelf_symidx_ent) * len);
+    }
+}
+
+// Free the address-to-symbol index of a process image so it is built again on next use.
+void kbelfi_symidx_free(kbelf_dyn dyn) {
+    if (dyn->symidx)
+        kbelfi_free(dyn->symidx);
+    if (dyn->symidx_names)
+        kbelfi_free(dyn->symidx_names);
+    dyn->symidx       = NULL;
+    dyn->symidx_len   = 0;
+    dyn->symidx_names = NULL;
+    dyn->symidx_built = false;
+}
+
+// Build the address-to-symbol index of a process image if it has not been built yet.
+// Returns success status.
+bool kbelf_dyn_index_symbols(kbelf_dyn dyn) {
+    if (!dyn || !dyn->exec_inst)
+        return false;
+    if (dyn->symidx_built)
+        return true;
+    symidx_build      build = {0};
+    kbelf_symidx_ent *tmp   = NULL;
+    for (size_t i = 0; i <= dyn->libs_len; i++) {
+        if (!visit_funcs(i ? dyn->libs_inst[i - 1] : dyn->exec_inst, index_func, &build))
+            goto abort;
+    }
+
+    // Sort by address and keep one name per address.
+    if (build.len) {
+        tmp = kbelfi_malloc(sizeof(kbelf_symidx_ent) * build.len);
+        if (!tmp)
+            KBELF_ERROR(abort, "Out of memory")
+        sort_index(build.ents, build.len, tmp);
+        kbelfi_free(tmp);
+        size_t len = 1;
+        for (size_t i = 1; i < build.len; i++) {
+            if (build.ents[i].vaddr != build.ents[len - 1].vaddr)
+                build.ents[len++] = build.ents[i];
+        }
+        build.len = len;
+    }
+
+    dyn->symidx       = build.ents;
+    dyn->symidx_len   = build.len;
+    dyn->symidx_names = build.names.buf;
+    dyn->symidx_built = true;
+    return true;
+
+abort:
+    if (build.ents)
+        kbelfi_free(build.ents);
+    if (build.names.buf)
+        kbelfi_free(build.names.buf);
+    return false;
+}
+
+// Find the function containing a virtual address in the process image; never allocates or reads files.
+// Returns false if no function contains the address or the index has not been built.
+bool kbelf_dyn_addr2sym(kbelf_dyn dyn, kbelf_addr vaddr, char const **name, kbelf_addr *offset) {
+    if (!dyn || !dyn->symidx_built)
+        return false;
+
+    // Find the last function that starts at or before the address.
+    size_t lo = 0, hi = dyn->symidx_len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (dyn->symidx[mid].vaddr <= vaddr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo)
+        return false;
+    kbelf_symidx_ent const *ent = &dyn->symidx[lo - 1];
+    if (vaddr - ent->vaddr >= ent->size)
+        return false;
+    *name   = dyn->symidx_names + ent->name;
+    *offset = vaddr - ent->vaddr;
+    return true;
+}
@@ -24,6 +24,7 @@
 
 #define KBELF_REVEAL_PRIVATE
 #include <kbelf.h>
+#include <kbelf/internal.h>
 #include <kbelf/port.h>
 
 
@@ -89,6 +90,21 @@
 
 // TODO: Detect RVTSO.
 #define KBELF_RISCV_HOST_RVTSO 0
+#else
+// When cross-linking, the target can be described by defining the macros above; anything left undefined is not
+// checked.
+#ifndef KBELF_RISCV_HOST_RVC
+#define KBELF_RISCV_HOST_RVC KBELF_RISCV_FLAG_RVC
+#endif
+#ifndef KBELF_RISCV_HOST_FABI
+#define KBELF_RISCV_HOST_FABI (-1)
+#endif
+#ifndef KBELF_RISCV_HOST_RVE
+#define KBELF_RISCV_HOST_RVE (-1)
+#endif
+#ifndef KBELF_RISCV_HOST_RVTSO
+#define KBELF_RISCV_HOST_RVTSO 0
+#endif
 #endif
 
 // Perform target-specific verification of `kbelf_file`.
@@ -96,6 +112,7 @@ bool kbelfp_file_verify(kbelf_file file) {
     if ((file->header.flags & KBELF_RISCV_FLAG_RVC) && !KBELF_RISCV_HOST_RVC) {
         KBELF_ERROR(abort, "Unsupported machine (RVC requested but not supported)")
     }
+#if KBELF_RISCV_HOST_FABI >= 0
     if ((file->header.flags & KBELF_RISCV_MASK_FABI) != KBELF_RISCV_HOST_FABI) {
         char const *fabi[] = {
             "soft-float",
@@ -110,12 +127,15 @@ bool kbelfp_file_verify(kbelf_file file) {
             fabi[(KBELF_RISCV_HOST_FABI) >> 1]
         )
     }
+#endif
+#if KBELF_RISCV_HOST_RVE >= 0
     if ((file->header.flags & KBELF_RISCV_FLAG_RVE) && !KBELF_RISCV_HOST_RVE) {
         KBELF_ERROR(abort, "Unsupported machine (RVE requested but not supported)")
     }
     if (!(file->header.flags & KBELF_RISCV_FLAG_RVE) && KBELF_RISCV_HOST_RVE) {
         KBELF_ERROR(abort, "Unsupported machine (RVI requested but not supported)")
     }
+#endif
 
     return true;
 
@@ -160,7 +180,7 @@ typedef enum {
 #define store(type, in)                                                                                                \
     do {                                                                                                               \
         type tmp = (in);                                                                                               \
-        kbelfx_copy_to_user(inst, laddr, &tmp, sizeof(type));                                                          \
+        kbelfi_copy_to_user(inst, laddr, &tmp, sizeof(type));                                                          \
     } while (0)
 
 // Obtain the value of an implicit addend.
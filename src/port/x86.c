@@ -24,6 +24,7 @@
 
 #define KBELF_REVEAL_PRIVATE
 #include <kbelf.h>
+#include <kbelf/internal.h>
 #include <kbelf/port.h>
 
 
@@ -81,7 +82,7 @@ typedef enum {
 #define store(type, in)                                                                                                \
     do {                                                                                                               \
         type tmp = (in);                                                                                               \
-        kbelfx_copy_to_user(inst, laddr, &tmp, sizeof(type));                                                          \
+        kbelfi_copy_to_user(inst, laddr, &tmp, sizeof(type));                                                          \
     } while (0)
 
 // Obtain the value of an implicit addend.
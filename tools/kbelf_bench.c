@@ -0,0 +1,583 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Host benchmark that loads real executables and libraries over and over and reports how long each phase takes.
+// Must be built for the host with `KBELF_TRACE` and `KBELF_STATS`, see `kbelf_bench` in CMakeLists.txt. Each fixture
+// is a directory with an executable called `main` and the libraries it needs.
+
+#define _GNU_SOURCE
+#include <kbelf.h>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !KBELF_TRACE || !KBELF_STATS
+#error "kbelf_bench must be built with KBELF_TRACE and KBELF_STATS"
+#endif
+
+// Default number of times each fixture is loaded.
+#define DEFAULT_ITERATIONS 100
+// Maximum number of files in a fixture.
+#define MAX_FILES          64
+// Maximum number of fixtures.
+#define MAX_FIXTURES       64
+
+// File read into memory for the in-RAM file backend.
+typedef struct {
+    // File name.
+    char    *name;
+    // File contents.
+    uint8_t *data;
+    // File size.
+    long     len;
+} memfile_t;
+
+// Open file of the in-RAM file backend.
+typedef struct {
+    // File that is read.
+    memfile_t const *file;
+    // Current position.
+    long             pos;
+} memfd_t;
+
+// Timings and counters of one load.
+typedef struct {
+    // Time from creating the context until the process image is loaded in nanoseconds.
+    uint64_t    total;
+    // Time spent in each phase in nanoseconds; nested phases are included in the outer phase too.
+    uint64_t    phases[KBELF_PHASE_COUNT];
+    // Statistics counted by KBELF.
+    kbelf_stats stats;
+} sample_t;
+
+// Whether files are read from memory instead of with stdio.
+static bool      ram_mode;
+// Whether the results are printed as one CSV row per fixture.
+static bool      csv_mode;
+// Number of files read into memory.
+static size_t    memfiles_len;
+// Files read into memory for the current fixture.
+static memfile_t memfiles[MAX_FILES];
+
+// Nesting depth of each phase.
+static size_t   phase_depth[KBELF_PHASE_COUNT];
+// Start time of the outermost instance of each phase.
+static uint64_t phase_start[KBELF_PHASE_COUNT];
+// Time spent in each phase during the current load.
+static uint64_t phase_time[KBELF_PHASE_COUNT];
+
+// Names of the phases.
+static char const *const phase_names[KBELF_PHASE_COUNT] = {
+    [KBELF_PHASE_OPEN]        = "open",
+    [KBELF_PHASE_HEADER]      = "header",
+    [KBELF_PHASE_PROGHEADERS] = "progheaders",
+    [KBELF_PHASE_SEG_ALLOC]   = "seg_alloc",
+    [KBELF_PHASE_SEG_LOAD]    = "seg_load",
+    [KBELF_PHASE_DYNAMIC]     = "dynamic",
+    [KBELF_PHASE_DEPS]        = "deps",
+    [KBELF_PHASE_INIT_ORDER]  = "init_order",
+    [KBELF_PHASE_SYMBOL]      = "symbol",
+    [KBELF_PHASE_RELOC]       = "reloc",
+    [KBELF_PHASE_CACHE_SYNC]  = "cache_sync",
+};
+
+// Get the current time in nanoseconds.
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+
+/* ==== KBELF hooks ==== */
+
+// Measure the length of `str`.
+size_t kbelfq_strlen(char const *str) {
+    return strlen(str);
+}
+
+// Copy string from `src` to `dst`.
+void kbelfq_strcpy(char *dst, char const *src) {
+    strcpy(dst, src);
+}
+
+// Find last occurrance of `c` in `str`.
+char const *kbelfq_strrchr(char const *str, char c) {
+    return strrchr(str, c);
+}
+
+// Compare string `a` to `b`.
+bool kbelfq_streq(char const *a, char const *b) {
+    return !strcmp(a, b);
+}
+
+// Copy memory from `src` to `dst`.
+void kbelfq_memcpy(void *dst, void const *src, size_t nmemb) {
+    memcpy(dst, src, nmemb);
+}
+
+// Fill memory `dst` with `c`.
+void kbelfq_memset(void *dst, uint8_t c, size_t nmemb) {
+    memset(dst, c, nmemb);
+}
+
+// Compare memory `a` to `b`.
+bool kbelfq_memeq(void const *a, void const *b, size_t nmemb) {
+    return !memcmp(a, b, nmemb);
+}
+
+// Memory allocator function to use for allocating metadata.
+void *kbelfx_malloc(size_t len) {
+    return malloc(len);
+}
+
+// Memory allocator function to use for allocating metadata.
+void *kbelfx_realloc(void *mem, size_t len) {
+    return realloc(mem, len);
+}
+
+// Memory allocator function to use for allocating metadata.
+void kbelfx_free(void *mem) {
+    free(mem);
+}
+
+// Allocate the segments of a file in one host buffer; the program is never run.
+bool kbelfx_seg_alloc(kbelf_inst inst, size_t segs_len, kbelf_segment *segs) {
+    (void)inst;
+    if (!segs_len)
+        return false;
+
+    // Determine required size.
+    kbelf_addr addr_min = -1;
+    kbelf_addr addr_max = 0;
+    for (size_t i = 0; i < segs_len; i++) {
+        if (segs[i].vaddr_req < addr_min)
+            addr_min = segs[i].vaddr_req;
+        if (segs[i].vaddr_req + segs[i].size > addr_max)
+            addr_max = segs[i].vaddr_req + segs[i].size;
+    }
+
+    // Allocate memory.
+    uint8_t *mem = malloc(addr_max - addr_min);
+    if (!mem)
+        return false;
+
+    // Compute segment addresses.
+    for (size_t i = 0; i < segs_len; i++) {
+        segs[i].alloc_cookie = NULL;
+        segs[i].laddr        = (kbelf_laddr)mem + segs[i].vaddr_req - addr_min;
+        segs[i].paddr        = segs[i].laddr;
+        segs[i].vaddr_real   = segs[i].laddr;
+    }
+    segs[0].alloc_cookie = mem;
+
+    return true;
+}
+
+// Release the host buffer of the segments of a file.
+void kbelfx_seg_free(kbelf_inst inst, size_t segs_len, kbelf_segment *segs) {
+    (void)inst;
+    if (segs_len)
+        free(segs[0].alloc_cookie);
+}
+
+// Open a binary file for reading with stdio or from memory.
+void *kbelfx_open(char const *path) {
+    if (!ram_mode)
+        return fopen(path, "rb");
+    for (size_t i = 0; i < memfiles_len; i++) {
+        if (!strcmp(memfiles[i].name, path)) {
+            memfd_t *fd = malloc(sizeof(memfd_t));
+            if (fd)
+                *fd = (memfd_t){&memfiles[i], 0};
+            return fd;
+        }
+    }
+    return NULL;
+}
+
+// Close a file.
+void kbelfx_close(void *fd) {
+    if (ram_mode)
+        free(fd);
+    else
+        fclose(fd);
+}
+
+// Copy bytes from an in-RAM file.
+static long memfd_read(memfd_t *fd, void *buf, long buf_len) {
+    long len = fd->file->len - fd->pos;
+    if (len > buf_len)
+        len = buf_len;
+    if (len <= 0)
+        return 0;
+    memcpy(buf, fd->file->data + fd->pos, len);
+    fd->pos += len;
+    return len;
+}
+
+// Reads a number of bytes from a file.
+long kbelfx_read(void *fd, void *buf, long buf_len) {
+    if (ram_mode)
+        return memfd_read(fd, buf, buf_len);
+    return (long)fread(buf, 1, buf_len, fd);
+}
+
+// Reads a number of bytes from a file to a load address in the program.
+long kbelfx_load(kbelf_inst inst, void *fd, kbelf_laddr laddr, kbelf_laddr file_size, kbelf_laddr mem_size) {
+    (void)inst;
+    long len = kbelfx_read(fd, (void *)laddr, (long)file_size);
+    memset((uint8_t *)laddr + file_size, 0, mem_size - file_size);
+    return len;
+}
+
+// Sets the absolute offset in the file.
+int kbelfx_seek(void *fd, long pos) {
+    if (!ram_mode)
+        return fseek(fd, pos, SEEK_SET) ? -1 : 0;
+    memfd_t *mfd = fd;
+    if (pos < 0 || pos > mfd->file->len)
+        return -1;
+    mfd->pos = pos;
+    return 0;
+}
+
+// Read bytes from a load address in the program.
+bool kbelfx_copy_from_user(kbelf_inst inst, void *buf, kbelf_laddr laddr, size_t len) {
+    (void)inst;
+    memcpy(buf, (void const *)laddr, len);
+    return true;
+}
+
+// Write bytes to a load address in the program.
+bool kbelfx_copy_to_user(kbelf_inst inst, kbelf_laddr laddr, void *buf, size_t len) {
+    (void)inst;
+    memcpy((void *)laddr, buf, len);
+    return true;
+}
+
+// Get string length from a load address in the program.
+ptrdiff_t kbelfx_strlen_from_user(kbelf_inst inst, kbelf_laddr laddr) {
+    (void)inst;
+    return (ptrdiff_t)strlen((char const *)laddr);
+}
+
+// Find and open a dynamic library file in the fixture directory.
+kbelf_file kbelfx_find_lib(char const *needed) {
+    return kbelf_file_open(needed, NULL);
+}
+
+// Start of a phase of loading.
+void kbelfx_trace_begin(kbelf_phase phase, char const *name) {
+    (void)name;
+    if (!phase_depth[phase]++)
+        phase_start[phase] = now_ns();
+}
+
+// End of a phase of loading.
+void kbelfx_trace_end(kbelf_phase phase, char const *name, size_t count) {
+    (void)name;
+    (void)count;
+    if (phase_depth[phase] && !--phase_depth[phase])
+        phase_time[phase] += now_ns() - phase_start[phase];
+}
+
+
+
+/* ==== Fixtures ==== */
+
+// Release the files read into memory.
+static void memfiles_free() {
+    for (size_t i = 0; i < memfiles_len; i++) {
+        free(memfiles[i].name);
+        free(memfiles[i].data);
+    }
+    memfiles_len = 0;
+}
+
+// Read all files in the current directory into memory.
+static bool memfiles_read() {
+    DIR *dir = opendir(".");
+    if (!dir)
+        return false;
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+        FILE *fd = ent->d_type == DT_REG ? fopen(ent->d_name, "rb") : NULL;
+        if (!fd)
+            continue;
+        if (memfiles_len == MAX_FILES) {
+            fclose(fd);
+            break;
+        }
+        fseek(fd, 0, SEEK_END);
+        memfile_t *file = &memfiles[memfiles_len++];
+        file->name      = strdup(ent->d_name);
+        file->len       = ftell(fd);
+        file->data      = malloc(file->len ? file->len : 1);
+        fseek(fd, 0, SEEK_SET);
+        if (fread(file->data, 1, file->len, fd) != (size_t)file->len)
+            file->len = 0;
+        fclose(fd);
+    }
+    closedir(dir);
+    return true;
+}
+
+#ifdef KBELF_BENCH_DIR
+// Find the fixture directories in a directory.
+static size_t find_fixtures(char const *path, char **fixtures, size_t cap) {
+    DIR *dir = opendir(path);
+    if (!dir)
+        return 0;
+    size_t         len = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) && len < cap) {
+        if (ent->d_type != DT_DIR || ent->d_name[0] == '.')
+            continue;
+        char *fixture = malloc(strlen(path) + strlen(ent->d_name) + 2);
+        sprintf(fixture, "%s/%s", path, ent->d_name);
+        fixtures[len++] = fixture;
+    }
+    closedir(dir);
+    return len;
+}
+
+// Compare two strings for `qsort`.
+static int cmp_str(void const *a, void const *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+#endif
+
+
+
+/* ==== Benchmark ==== */
+
+// Load the fixture in the current directory once.
+static bool load_once(sample_t *sample) {
+    memset(phase_depth, 0, sizeof(phase_depth));
+    memset(phase_time, 0, sizeof(phase_time));
+    uint64_t  start = now_ns();
+    kbelf_dyn dyn   = kbelf_dyn_create(0);
+    bool      ok    = dyn && kbelf_dyn_set_exec(dyn, "main", NULL) && kbelf_dyn_load(dyn);
+    sample->total   = now_ns() - start;
+    memcpy(sample->phases, phase_time, sizeof(phase_time));
+    kbelf_dyn_get_stats(dyn, &sample->stats);
+    kbelf_dyn_unload(dyn);
+    kbelf_dyn_destroy(dyn);
+    return ok;
+}
+
+// Compare two times for `qsort`.
+static int cmp_time(void const *a, void const *b) {
+    uint64_t x = *(uint64_t const *)a;
+    uint64_t y = *(uint64_t const *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Get a percentile of a sorted array of times in microseconds.
+static double percentile(uint64_t const *sorted, size_t len, unsigned pct) {
+    size_t i = (len * pct + 99) / 100;
+    return (double)sorted[i ? i - 1 : 0] / 1000.0;
+}
+
+// Print the median and 99th percentile of a series of times.
+static void report_times(char const *name, uint64_t *times, size_t len) {
+    qsort(times, len, sizeof(uint64_t), cmp_time);
+    if (csv_mode)
+        printf(",%.1f,%.1f", percentile(times, len, 50), percentile(times, len, 99));
+    else
+        printf("  %-12s %12.1f %12.1f\n", name, percentile(times, len, 50), percentile(times, len, 99));
+}
+
+// Print the header of the CSV output.
+static void report_csv_header() {
+    printf("fixture,total_p50,total_p99");
+    for (int p = 0; p < KBELF_PHASE_COUNT; p++) {
+        printf(",%s_p50,%s_p99", phase_names[p], phase_names[p]);
+    }
+    printf(",relocs,lookups,str_compares,reads,read_bytes,meta_peak,allocs\n");
+}
+
+// Load a fixture a number of times and report the results.
+static bool run_fixture(char const *path, size_t iterations) {
+    if (chdir(path)) {
+        fprintf(stderr, "Unable to enter %s\n", path);
+        return false;
+    }
+    if (ram_mode && !memfiles_read()) {
+        fprintf(stderr, "Unable to read %s\n", path);
+        return false;
+    }
+
+    // Warm up, then measure.
+    sample_t *samples = calloc(iterations + 1, sizeof(sample_t));
+    uint64_t *times   = calloc(iterations, sizeof(uint64_t));
+    bool      ok      = samples && times;
+    for (size_t i = 0; ok && i <= iterations; i++) {
+        ok = load_once(&samples[i]);
+    }
+    if (!ok) {
+        fprintf(stderr, "Unable to load %s/main\n", path);
+        goto done;
+    }
+    sample_t const *runs = samples + 1;
+
+    // Per-phase latency.
+    char const *name = strrchr(path, '/');
+    name             = name ? name + 1 : path;
+    if (csv_mode) {
+        printf("%s", name);
+    } else {
+        printf("%s (%zu loads, %s backend)\n", name, iterations, ram_mode ? "ram" : "file");
+        printf("  %-12s %12s %12s\n", "phase", "p50 us", "p99 us");
+    }
+    for (size_t i = 0; i < iterations; i++) {
+        times[i] = runs[i].total;
+    }
+    report_times("total", times, iterations);
+    for (int p = 0; p < KBELF_PHASE_COUNT; p++) {
+        for (size_t i = 0; i < iterations; i++) {
+            times[i] = runs[i].phases[p];
+        }
+        report_times(phase_names[p], times, iterations);
+    }
+
+    // Throughput.
+    uint64_t reloc_ns  = 0;
+    uint64_t symbol_ns = 0;
+    size_t   relocs    = 0;
+    size_t   lookups   = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        reloc_ns  += runs[i].phases[KBELF_PHASE_RELOC];
+        symbol_ns += runs[i].phases[KBELF_PHASE_SYMBOL];
+        relocs    += runs[i].stats.relr_relocs;
+        lookups   += runs[i].stats.sym_lookups;
+        for (size_t t = 0; t < KBELF_STATS_RELOC_TYPES; t++) {
+            relocs += runs[i].stats.relocs[t];
+        }
+    }
+    kbelf_stats const *st = &runs[0].stats;
+    if (csv_mode) {
+        printf(
+            ",%zu,%zu,%zu,%zu,%zu,%zu,%zu\n",
+            relocs / iterations,
+            lookups / iterations,
+            st->str_compares,
+            st->read_calls,
+            st->read_bytes,
+            st->meta_peak,
+            st->allocs
+        );
+        goto done;
+    }
+    printf("  relocations  %zu per load, %.0f per second\n", relocs / iterations, reloc_ns ? relocs * 1e9 / reloc_ns : 0);
+    printf(
+        "  lookups      %zu per load, %.0f per second, %zu string compares\n",
+        lookups / iterations,
+        symbol_ns ? lookups * 1e9 / symbol_ns : 0,
+        st->str_compares
+    );
+    printf(
+        "  io           %zu reads, %zu bytes, %zu seeks; metadata peak %zu bytes in %zu allocations\n\n",
+        st->read_calls,
+        st->read_bytes,
+        st->seek_calls,
+        st->meta_peak,
+        st->allocs
+    );
+
+done:
+    free(samples);
+    free(times);
+    memfiles_free();
+    return ok;
+}
+
+// Show the usage of the benchmark.
+static void show_help(char const *arg0) {
+    printf("Usage: %s [-n iterations] [-r] [-c] [fixture...]\n", arg0);
+    printf("  -n  Number of times each fixture is loaded, %d by default\n", DEFAULT_ITERATIONS);
+    printf("  -r  Read the files from memory to leave out the cost of file I/O\n");
+    printf("  -c  Print one CSV row per fixture with times in microseconds\n");
+#ifdef KBELF_BENCH_DIR
+    printf("Without fixtures, all fixtures in " KBELF_BENCH_DIR " are loaded.\n");
+#endif
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = DEFAULT_ITERATIONS;
+    char  *fixtures[MAX_FIXTURES];
+    size_t fixtures_len = 0;
+
+    // Parse arguments.
+    for (int i = 1; i < argc; i++) {
+        char const *arg = argv[i];
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            show_help(argv[0]);
+            return 0;
+        } else if (!strcmp(arg, "-n") && i + 1 < argc) {
+            iterations = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(arg, "-r")) {
+            ram_mode = true;
+        } else if (!strcmp(arg, "-c")) {
+            csv_mode = true;
+        } else if (arg[0] != '-' && fixtures_len < MAX_FIXTURES) {
+            char *path = realpath(arg, NULL);
+            if (!path) {
+                fprintf(stderr, "Fixture %s not found\n", arg);
+                return 1;
+            }
+            fixtures[fixtures_len++] = path;
+        } else {
+            fprintf(stderr, "Invalid argument %s\n", arg);
+            return 1;
+        }
+    }
+#ifdef KBELF_BENCH_DIR
+    if (!fixtures_len) {
+        fixtures_len = find_fixtures(KBELF_BENCH_DIR, fixtures, MAX_FIXTURES);
+        qsort(fixtures, fixtures_len, sizeof(char *), cmp_str);
+    }
+#endif
+    if (!fixtures_len || !iterations) {
+        show_help(argv[0]);
+        return 1;
+    }
+
+    // Run the benchmarks.
+    bool ok = true;
+    if (csv_mode)
+        report_csv_header();
+    for (size_t i = 0; i < fixtures_len; i++) {
+        ok &= run_fixture(fixtures[i], iterations);
+        free(fixtures[i]);
+    }
+    return !ok;
+}
@@ -0,0 +1,744 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Host tool that writes synthetic shared objects and an executable for measuring how loading scales.
+// The files are written directly, so no cross compiler or linker is needed. They can be loaded and relocated but their
+// functions only return; the number of libraries, the dependency graph, the number of exported symbols, the number and
+// types of relocations and the segment layout are chosen on the command line.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Maximum number of libraries.
+#define MAX_LIBS   1024
+// Maximum length of a path.
+#define MAX_PATH   1024
+// Size of each generated function.
+#define FUNC_SIZE  16
+// Alignment of the text in the generated files.
+#define TEXT_ALIGN 16
+
+// ELF constants used by the generated files.
+#define ET_DYN          3
+#define PT_LOAD         1
+#define PT_DYNAMIC      2
+#define PF_X            1
+#define PF_W            2
+#define PF_R            4
+#define DT_NULL         0
+#define DT_NEEDED       1
+#define DT_PLTRELSZ     2
+#define DT_HASH         4
+#define DT_STRTAB       5
+#define DT_SYMTAB       6
+#define DT_RELA         7
+#define DT_RELASZ       8
+#define DT_RELAENT      9
+#define DT_STRSZ        10
+#define DT_SYMENT       11
+#define DT_SONAME       14
+#define DT_PLTREL       20
+#define DT_JMPREL       23
+#define DT_INIT_ARRAY   25
+#define DT_INIT_ARRAYSZ 27
+#define STB_GLOBAL      1
+#define STT_FUNC        2
+
+// Kinds of relocations in the mix.
+typedef enum {
+    // Load bias plus addend.
+    KIND_RELATIVE,
+    // Absolute address of a symbol.
+    KIND_ABS,
+    // Absolute address of a symbol in the global offset table.
+    KIND_GOT,
+    // Address of a function in the procedure linkage table.
+    KIND_PLT,
+    // Number of kinds.
+    KIND_COUNT,
+} kind_t;
+
+// Shapes of the dependency graph.
+typedef enum {
+    // The executable needs the first library and each library needs the next one.
+    SHAPE_CHAIN,
+    // The executable needs the first library, which needs all libraries in between, which need the last one.
+    SHAPE_DIAMOND,
+    // The executable needs all libraries, which need nothing.
+    SHAPE_FAN,
+} shape_t;
+
+// Target machine of the generated files.
+typedef struct {
+    // Name on the command line.
+    char const *name;
+    // ELF machine type.
+    uint16_t    machine;
+    // Whether the files are 64-bit.
+    bool        is_elf64;
+    // ELF header flags.
+    uint32_t    flags;
+    // Relocation type of each kind.
+    uint32_t    types[KIND_COUNT];
+    // Return instruction that each function consists of.
+    uint8_t     ret[4];
+    // Size of the return instruction.
+    size_t      ret_len;
+} target_t;
+
+// Parameters of a generated set of files.
+typedef struct {
+    // Target machine.
+    target_t const *target;
+    // Number of libraries.
+    size_t          libs;
+    // Shape of the dependency graph.
+    shape_t         shape;
+    // Number of functions exported by each file.
+    size_t          exports;
+    // Number of relocations in each file.
+    size_t          relocs;
+    // Weight of each kind of relocation.
+    unsigned        mix[KIND_COUNT];
+    // Number of writable segments in each file.
+    size_t          data_segs;
+    // Number of zero-initialised bytes at the end of each writable segment.
+    size_t          bss;
+    // Alignment of the segments.
+    size_t          page;
+    // Whether each file has an initialisation function.
+    bool            init;
+} params_t;
+
+// Offsets of the parts of a generated file; the virtual addresses are the same as the file offsets.
+typedef struct {
+    // Size of an address.
+    size_t word;
+    // Number of program headers.
+    size_t phnum;
+    // Number of symbols including the null symbol.
+    size_t syms;
+    // Number of imported symbols.
+    size_t imports;
+    // Number of hash buckets.
+    size_t nbucket;
+    // Number of relocations of each kind.
+    size_t kinds[KIND_COUNT];
+    // Number of entries in the RELA table.
+    size_t rela_len;
+    // Number of dynamic table entries.
+    size_t dyn_len;
+    // Size of the dynamic string table.
+    size_t dynstr_len;
+
+    // Offset of the hash table.
+    size_t hash;
+    // Offset of the symbol table.
+    size_t dynsym;
+    // Offset of the string table.
+    size_t dynstr;
+    // Offset of the RELA table.
+    size_t rela;
+    // Offset of the JMPREL table.
+    size_t jmprel;
+    // Offset of the functions.
+    size_t text;
+    // End of the read-only segment.
+    size_t text_end;
+    // Offset of the dynamic table, at the start of the first writable segment.
+    size_t dynamic;
+    // Offset of the initialisation array.
+    size_t init_array;
+    // Offset of the jump slots.
+    size_t got_plt;
+    // Offset of the relocated words of each writable segment.
+    size_t words[64];
+    // Number of relocated words in each writable segment.
+    size_t words_len[64];
+    // Offset of each writable segment.
+    size_t data[64];
+    // End of each writable segment in the file.
+    size_t data_end[64];
+    // Size of the file.
+    size_t size;
+} layout_t;
+
+// Supported target machines.
+static target_t const targets[] = {
+    {"x86_64", 0x3E, true, 0, {8, 1, 6, 7}, {0xC3}, 1},
+    {"riscv32", 0xF3, false, 0, {3, 1, 1, 5}, {0x67, 0x80, 0x00, 0x00}, 4},
+    {"riscv64", 0xF3, true, 0, {3, 2, 2, 5}, {0x67, 0x80, 0x00, 0x00}, 4},
+};
+
+// Parameters of the files being generated.
+static params_t params = {
+    .target    = &targets[0],
+    .libs      = 4,
+    .shape     = SHAPE_CHAIN,
+    .exports   = 64,
+    .relocs    = 256,
+    .mix       = {50, 20, 20, 10},
+    .data_segs = 1,
+    .bss       = 0,
+    .page      = 4096,
+    .init      = true,
+};
+
+
+
+/* ==== Dependency graph ==== */
+
+// Get the dependencies of a file; file 0 is the executable and file `i` is library `i - 1`.
+// Returns the number of dependencies, which are stored as file indices.
+static size_t get_deps(size_t file, size_t *deps) {
+    size_t libs = params.libs;
+    size_t len  = 0;
+    if (!libs)
+        return 0;
+    shape_t shape = params.shape == SHAPE_DIAMOND && libs < 3 ? SHAPE_CHAIN : params.shape;
+    if (shape == SHAPE_CHAIN) {
+        if (file < libs)
+            deps[len++] = file + 1;
+    } else if (shape == SHAPE_DIAMOND) {
+        if (file == 0) {
+            deps[len++] = 1;
+        } else if (file == 1) {
+            for (size_t i = 2; i < libs; i++) {
+                deps[len++] = i;
+            }
+        } else if (file < libs) {
+            deps[len++] = libs;
+        }
+    } else if (file == 0) {
+        for (size_t i = 1; i <= libs; i++) {
+            deps[len++] = i;
+        }
+    }
+    return len;
+}
+
+// Write the name of a file.
+static void file_name(size_t file, char *buf, size_t cap) {
+    if (file)
+        snprintf(buf, cap, "libg%zu.so", file - 1);
+    else
+        snprintf(buf, cap, "main");
+}
+
+// Write the name of an exported function.
+static void export_name(size_t file, size_t index, char *buf, size_t cap) {
+    if (file)
+        snprintf(buf, cap, "g%zu_f%zu", file - 1, index);
+    else
+        snprintf(buf, cap, "main_f%zu", index);
+}
+
+
+
+/* ==== Writing ==== */
+
+// Round up to a multiple of `align`.
+static size_t align_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+// Write a 16-bit little-endian value.
+static void put16(uint8_t *buf, size_t off, uint16_t value) {
+    buf[off]     = value;
+    buf[off + 1] = value >> 8;
+}
+
+// Write a 32-bit little-endian value.
+static void put32(uint8_t *buf, size_t off, uint32_t value) {
+    put16(buf, off, value);
+    put16(buf, off + 2, value >> 16);
+}
+
+// Write a 64-bit little-endian value.
+static void put64(uint8_t *buf, size_t off, uint64_t value) {
+    put32(buf, off, value);
+    put32(buf, off + 4, value >> 32);
+}
+
+// Write an address-sized little-endian value.
+static void put_word(uint8_t *buf, size_t off, uint64_t value) {
+    if (params.target->is_elf64)
+        put64(buf, off, value);
+    else
+        put32(buf, off, value);
+}
+
+// Write the info field of a relocation.
+static void put_rinfo(uint8_t *buf, size_t off, size_t sym, uint32_t type) {
+    if (params.target->is_elf64)
+        put64(buf, off, ((uint64_t)sym << 32) | type);
+    else
+        put32(buf, off, ((uint32_t)sym << 8) | (type & 255));
+}
+
+// Compute the SysV hash of a symbol name.
+static uint32_t elf_hash(char const *name) {
+    uint32_t hash = 0;
+    for (; *name; name++) {
+        hash          = (hash << 4) + (uint8_t)*name;
+        uint32_t high = hash & 0xf0000000;
+        if (high)
+            hash ^= high >> 24;
+        hash &= ~high;
+    }
+    return hash;
+}
+
+// Split the relocations of a file into kinds by the mix; rounding leftovers are relative relocations.
+static void split_relocs(size_t *kinds, bool has_syms) {
+    unsigned total = 0;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        total += params.mix[k];
+    }
+    size_t left = params.relocs;
+    for (int k = KIND_RELATIVE + 1; k < KIND_COUNT; k++) {
+        kinds[k]  = has_syms && total ? params.relocs * params.mix[k] / total : 0;
+        left     -= kinds[k];
+    }
+    kinds[KIND_RELATIVE] = left;
+}
+
+// Compute the layout of a file.
+static void plan_layout(layout_t *lay, size_t deps_len, size_t imports, bool is_exec) {
+    bool   is64    = params.target->is_elf64;
+    size_t sym_sz  = is64 ? 24 : 16;
+    size_t rela_sz = is64 ? 24 : 12;
+    memset(lay, 0, sizeof(*lay));
+    lay->word    = is64 ? 8 : 4;
+    lay->phnum   = 2 + params.data_segs;
+    lay->imports = imports;
+    lay->syms    = 1 + params.exports + imports;
+    lay->nbucket = lay->syms / 2 ? lay->syms / 2 : 1;
+    split_relocs(lay->kinds, params.exports || imports);
+    lay->rela_len = lay->kinds[KIND_RELATIVE] + lay->kinds[KIND_ABS] + lay->kinds[KIND_GOT] + params.init;
+    lay->dyn_len  = deps_len + !is_exec + 5 + 3 * !!lay->rela_len + 3 * !!lay->kinds[KIND_PLT] + 2 * params.init + 1;
+
+    // String table: the null string, the needed libraries, the soname and the symbols.
+    char name[64];
+    lay->dynstr_len = 1 + deps_len * 16 + 16;
+    for (size_t i = 0; i < params.exports; i++) {
+        export_name(MAX_LIBS, i, name, sizeof(name));
+        lay->dynstr_len += strlen(name) + 1;
+    }
+    lay->dynstr_len += imports * (sizeof(name) / 2);
+
+    // Read-only segment with the headers, tables and functions.
+    size_t off      = (is64 ? 64 : 52) + lay->phnum * (is64 ? 56 : 32);
+    lay->hash       = align_up(off, 4);
+    lay->dynsym     = align_up(lay->hash + (2 + lay->nbucket + lay->syms) * 4, lay->word);
+    lay->dynstr     = lay->dynsym + lay->syms * sym_sz;
+    lay->rela       = align_up(lay->dynstr + lay->dynstr_len, lay->word);
+    lay->jmprel     = lay->rela + lay->rela_len * rela_sz;
+    lay->text       = align_up(lay->jmprel + lay->kinds[KIND_PLT] * rela_sz, TEXT_ALIGN);
+    lay->text_end   = lay->text + (params.exports ? params.exports : 1) * FUNC_SIZE;
+
+    // Writable segments; the first holds the dynamic table, the initialisation array and the jump slots.
+    size_t words = lay->kinds[KIND_RELATIVE] + lay->kinds[KIND_ABS] + lay->kinds[KIND_GOT];
+    off          = lay->text_end;
+    for (size_t s = 0; s < params.data_segs; s++) {
+        off          = align_up(off + params.bss, params.page);
+        lay->data[s] = off;
+        if (s == 0) {
+            lay->dynamic     = off;
+            off             += lay->dyn_len * 2 * lay->word;
+            lay->init_array  = off;
+            off             += params.init * lay->word;
+            lay->got_plt     = off;
+            off             += lay->kinds[KIND_PLT] * lay->word;
+        }
+        lay->words[s]      = off;
+        lay->words_len[s]  = words / params.data_segs + (s < words % params.data_segs);
+        off               += lay->words_len[s] * lay->word;
+        lay->data_end[s]   = off;
+    }
+    lay->size = off;
+}
+
+// Get the address of a relocated word by index, spread over the writable segments.
+static size_t word_addr(layout_t const *lay, size_t index) {
+    size_t seg = index % params.data_segs;
+    return lay->words[seg] + index / params.data_segs * lay->word;
+}
+
+// Generate one file.
+// Returns success status.
+static bool gen_file(char const *dir, size_t file) {
+    target_t const *tgt      = params.target;
+    bool            is64     = tgt->is_elf64;
+    size_t          deps[MAX_LIBS];
+    size_t          deps_len = get_deps(file, deps);
+
+    // Each dependency exports the same functions, so the imports are a round robin over them.
+    size_t dep_exports = deps_len * params.exports;
+    size_t imports     = 0;
+    if (dep_exports) {
+        size_t kinds[KIND_COUNT];
+        split_relocs(kinds, true);
+        imports = kinds[KIND_ABS] + kinds[KIND_GOT] + kinds[KIND_PLT];
+        if (imports > dep_exports)
+            imports = dep_exports;
+    }
+
+    layout_t lay;
+    plan_layout(&lay, deps_len, imports, file == 0);
+    uint8_t *buf = calloc(1, lay.size);
+    if (!buf)
+        return false;
+
+    // String table.
+    char   name[64];
+    size_t str    = lay.dynstr + 1;
+    size_t needed[MAX_LIBS];
+    size_t soname = 0;
+    for (size_t i = 0; i < deps_len; i++) {
+        file_name(deps[i], name, sizeof(name));
+        needed[i] = str - lay.dynstr;
+        strcpy((char *)buf + str, name);
+        str += strlen(name) + 1;
+    }
+    if (file) {
+        file_name(file, name, sizeof(name));
+        soname = str - lay.dynstr;
+        strcpy((char *)buf + str, name);
+        str += strlen(name) + 1;
+    }
+
+    // Symbol table and hash table.
+    size_t    sym_sz  = is64 ? 24 : 16;
+    uint32_t *chains  = calloc(lay.syms, sizeof(uint32_t));
+    uint32_t *buckets = calloc(lay.nbucket, sizeof(uint32_t));
+    if (!chains || !buckets) {
+        free(chains);
+        free(buckets);
+        free(buf);
+        return false;
+    }
+    for (size_t i = 1; i < lay.syms; i++) {
+        size_t export  = i - 1;
+        bool   defined = export < params.exports;
+        if (defined) {
+            export_name(file, export, name, sizeof(name));
+        } else {
+            size_t imp = export - params.exports;
+            export_name(deps[imp % deps_len], imp / deps_len, name, sizeof(name));
+        }
+        size_t   sym   = lay.dynsym + i * sym_sz;
+        uint32_t nidx  = str - lay.dynstr;
+        uint64_t value = defined ? lay.text + export * FUNC_SIZE : 0;
+        uint64_t size  = defined ? FUNC_SIZE : 0;
+        uint16_t shndx = defined ? 1 : 0;
+        strcpy((char *)buf + str, name);
+        str += strlen(name) + 1;
+        put32(buf, sym, nidx);
+        if (is64) {
+            buf[sym + 4] = STB_GLOBAL << 4 | STT_FUNC;
+            put16(buf, sym + 6, shndx);
+            put64(buf, sym + 8, value);
+            put64(buf, sym + 16, size);
+        } else {
+            put32(buf, sym + 4, value);
+            put32(buf, sym + 8, size);
+            buf[sym + 12] = STB_GLOBAL << 4 | STT_FUNC;
+            put16(buf, sym + 14, shndx);
+        }
+        uint32_t bucket = elf_hash(name) % lay.nbucket;
+        chains[i]       = buckets[bucket];
+        buckets[bucket] = i;
+    }
+    put32(buf, lay.hash, lay.nbucket);
+    put32(buf, lay.hash + 4, lay.syms);
+    for (size_t i = 0; i < lay.nbucket; i++) {
+        put32(buf, lay.hash + 8 + i * 4, buckets[i]);
+    }
+    for (size_t i = 0; i < lay.syms; i++) {
+        put32(buf, lay.hash + 8 + (lay.nbucket + i) * 4, chains[i]);
+    }
+    free(chains);
+    free(buckets);
+
+    // Functions.
+    for (size_t i = 0; i < (params.exports ? params.exports : 1); i++) {
+        memcpy(buf + lay.text + i * FUNC_SIZE, tgt->ret, tgt->ret_len);
+    }
+
+    // Relocations; symbol relocations refer to the imports if there are any and the exports otherwise.
+    size_t rela_sz = is64 ? 24 : 12;
+    size_t rela    = lay.rela;
+    size_t word    = 0;
+    size_t symref  = 0;
+    for (int k = KIND_RELATIVE; k < KIND_COUNT; k++) {
+        for (size_t i = 0; i < lay.kinds[k]; i++) {
+            size_t sym = 0;
+            if (k != KIND_RELATIVE)
+                sym = imports ? 1 + params.exports + symref++ % imports : 1 + symref++ % params.exports;
+            size_t   ent    = k == KIND_PLT ? lay.jmprel + i * rela_sz : rela;
+            size_t   offset = k == KIND_PLT ? lay.got_plt + i * lay.word : word_addr(&lay, word++);
+            uint64_t addend = k == KIND_RELATIVE ? lay.text + i % (params.exports ? params.exports : 1) * FUNC_SIZE : 0;
+            put_word(buf, ent, offset);
+            put_rinfo(buf, ent + lay.word, sym, tgt->types[k]);
+            put_word(buf, ent + 2 * lay.word, addend);
+            if (k != KIND_PLT)
+                rela += rela_sz;
+        }
+    }
+    if (params.init) {
+        put_word(buf, rela, lay.init_array);
+        put_rinfo(buf, rela + lay.word, 0, tgt->types[KIND_RELATIVE]);
+        put_word(buf, rela + 2 * lay.word, lay.text);
+        put_word(buf, lay.init_array, lay.text);
+    }
+
+    // Dynamic table.
+    size_t dyn = lay.dynamic;
+#define DYN(tag, value)                                                                                                \
+    do {                                                                                                               \
+        put_word(buf, dyn, tag);                                                                                           \
+        put_word(buf, dyn + lay.word, value);                                                                              \
+        dyn += 2 * lay.word;                                                                                           \
+    } while (0)
+    for (size_t i = 0; i < deps_len; i++) {
+        DYN(DT_NEEDED, needed[i]);
+    }
+    if (file)
+        DYN(DT_SONAME, soname);
+    DYN(DT_HASH, lay.hash);
+    DYN(DT_STRTAB, lay.dynstr);
+    DYN(DT_SYMTAB, lay.dynsym);
+    DYN(DT_STRSZ, str - lay.dynstr);
+    DYN(DT_SYMENT, sym_sz);
+    if (lay.rela_len) {
+        DYN(DT_RELA, lay.rela);
+        DYN(DT_RELASZ, lay.rela_len * rela_sz);
+        DYN(DT_RELAENT, rela_sz);
+    }
+    if (lay.kinds[KIND_PLT]) {
+        DYN(DT_JMPREL, lay.jmprel);
+        DYN(DT_PLTRELSZ, lay.kinds[KIND_PLT] * rela_sz);
+        DYN(DT_PLTREL, DT_RELA);
+    }
+    if (params.init) {
+        DYN(DT_INIT_ARRAY, lay.init_array);
+        DYN(DT_INIT_ARRAYSZ, lay.word);
+    }
+    DYN(DT_NULL, 0);
+#undef DYN
+
+    // ELF header.
+    memcpy(buf, "\x7f" "ELF", 4);
+    buf[4] = is64 ? 2 : 1;
+    buf[5] = 1;
+    buf[6] = 1;
+    size_t ph = is64 ? 64 : 52;
+    put16(buf, 16, ET_DYN);
+    put16(buf, 18, tgt->machine);
+    put32(buf, 20, 1);
+    put_word(buf, 24, file ? 0 : lay.text);
+    put_word(buf, 24 + lay.word, ph);
+    put_word(buf, 24 + 2 * lay.word, 0);
+    size_t off = 24 + 3 * lay.word;
+    put32(buf, off, tgt->flags);
+    put16(buf, off + 4, ph);
+    put16(buf, off + 6, is64 ? 56 : 32);
+    put16(buf, off + 8, lay.phnum);
+    put16(buf, off + 10, is64 ? 64 : 40);
+
+    // Program headers.
+    for (size_t i = 0; i < lay.phnum; i++) {
+        size_t   p = ph + i * (is64 ? 56 : 32);
+        uint32_t type, flags;
+        size_t   start, file_size, mem_size;
+        if (i == 0) {
+            type      = PT_LOAD;
+            flags     = PF_R | PF_X;
+            start     = 0;
+            file_size = lay.text_end;
+            mem_size  = file_size;
+        } else if (i <= params.data_segs) {
+            type      = PT_LOAD;
+            flags     = PF_R | PF_W;
+            start     = lay.data[i - 1];
+            file_size = lay.data_end[i - 1] - start;
+            mem_size  = file_size + params.bss;
+        } else {
+            type      = PT_DYNAMIC;
+            flags     = PF_R | PF_W;
+            start     = lay.dynamic;
+            file_size = lay.dyn_len * 2 * lay.word;
+            mem_size  = file_size;
+        }
+        put32(buf, p, type);
+        if (is64) {
+            put32(buf, p + 4, flags);
+            put64(buf, p + 8, start);
+            put64(buf, p + 16, start);
+            put64(buf, p + 24, start);
+            put64(buf, p + 32, file_size);
+            put64(buf, p + 40, mem_size);
+            put64(buf, p + 48, type == PT_LOAD ? params.page : lay.word);
+        } else {
+            put32(buf, p + 4, start);
+            put32(buf, p + 8, start);
+            put32(buf, p + 12, start);
+            put32(buf, p + 16, file_size);
+            put32(buf, p + 20, mem_size);
+            put32(buf, p + 24, flags);
+            put32(buf, p + 28, type == PT_LOAD ? params.page : lay.word);
+        }
+    }
+
+    // Write the file.
+    char path[MAX_PATH];
+    file_name(file, name, sizeof(name));
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fd = fopen(path, "wb");
+    bool  ok = fd && fwrite(buf, 1, lay.size, fd) == lay.size;
+    if (fd && fclose(fd))
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "Unable to write %s\n", path);
+    free(buf);
+    return ok;
+}
+
+
+
+/* ==== Command line ==== */
+
+// Show the usage of the generator.
+static void show_help(char const *argv0) {
+    printf("%s -o <dir> [options]\n", argv0);
+    printf("\n");
+    printf("Writes an executable called main and the libraries it needs into an existing directory.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("    -m <x86_64|riscv32|riscv64>\n");
+    printf("        Target machine, x86_64 by default.\n");
+    printf("    -l <count>\n");
+    printf("        Number of libraries, %zu by default.\n", params.libs);
+    printf("    -g <chain|diamond|fan>\n");
+    printf("        Shape of the dependency graph, chain by default.\n");
+    printf("    -e <count>\n");
+    printf("        Number of functions exported by each file, %zu by default.\n", params.exports);
+    printf("    -r <count>\n");
+    printf("        Number of relocations in each file, %zu by default.\n", params.relocs);
+    printf("    -x <relative>:<abs>:<got>:<plt>\n");
+    printf("        Weights of the kinds of relocations, 50:20:20:10 by default.\n");
+    printf("    -s <count>\n");
+    printf("        Number of writable segments in each file, %zu by default.\n", params.data_segs);
+    printf("    -b <bytes>\n");
+    printf("        Zero-initialised bytes at the end of each writable segment, %zu by default.\n", params.bss);
+    printf("    -p <bytes>\n");
+    printf("        Segment alignment, %zu by default.\n", params.page);
+    printf("    -n\n");
+    printf("        Leave out the initialisation functions.\n");
+}
+
+// Parse a number from the command line.
+// Returns success status.
+static bool parse_size(char const *val, size_t *out) {
+    char *end;
+    *out = strtoul(val, &end, 0);
+    return *val && !*end;
+}
+
+int main(int argc, char **argv) {
+    char const *dir = NULL;
+
+    // Parse arguments.
+    for (int i = 1; i < argc; i++) {
+        char const *arg = argv[i];
+        bool        ok  = true;
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            show_help(argv[0]);
+            return 0;
+        } else if (!strcmp(arg, "-n")) {
+            params.init = false;
+        } else if (arg[0] == '-' && arg[1] && !arg[2] && i + 1 < argc) {
+            char const *val = argv[++i];
+            if (arg[1] == 'o') {
+                dir = val;
+            } else if (arg[1] == 'm') {
+                ok = false;
+                for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+                    if (!strcmp(targets[t].name, val)) {
+                        params.target = &targets[t];
+                        ok            = true;
+                    }
+                }
+            } else if (arg[1] == 'l') {
+                ok = parse_size(val, &params.libs) && params.libs < MAX_LIBS;
+            } else if (arg[1] == 'g') {
+                ok = true;
+                if (!strcmp(val, "chain"))
+                    params.shape = SHAPE_CHAIN;
+                else if (!strcmp(val, "diamond"))
+                    params.shape = SHAPE_DIAMOND;
+                else if (!strcmp(val, "fan"))
+                    params.shape = SHAPE_FAN;
+                else
+                    ok = false;
+            } else if (arg[1] == 'e') {
+                ok = parse_size(val, &params.exports);
+            } else if (arg[1] == 'r') {
+                ok = parse_size(val, &params.relocs);
+            } else if (arg[1] == 'x') {
+                ok = sscanf(val, "%u:%u:%u:%u", &params.mix[0], &params.mix[1], &params.mix[2], &params.mix[3]) == 4;
+            } else if (arg[1] == 's') {
+                ok = parse_size(val, &params.data_segs) && params.data_segs >= 1 && params.data_segs <= 64;
+            } else if (arg[1] == 'b') {
+                ok = parse_size(val, &params.bss);
+            } else if (arg[1] == 'p') {
+                ok = parse_size(val, &params.page) && params.page && !(params.page & (params.page - 1));
+            } else {
+                ok = false;
+            }
+            if (!ok) {
+                fprintf(stderr, "Invalid option %s %s\n", arg, val);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Invalid argument %s\n", arg);
+            return 1;
+        }
+    }
+    if (!dir) {
+        show_help(argv[0]);
+        return 1;
+    }
+
+    // Generate the executable and the libraries.
+    for (size_t i = 0; i <= params.libs; i++) {
+        if (!gen_file(dir, i))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,481 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Host micro-benchmarks that call the hot functions of the loader in isolation on a fixture loaded into memory once.
+// The loader and relocation sources are compiled into this file to reach their static functions; the other sources
+// and the libc hooks of `examples/kbelfx_libc.c` are linked in, see `kbelf_micro` in CMakeLists.txt.
+
+#define _GNU_SOURCE
+#include "../src/kbelf_dyn.c"
+#include "../src/kbelf_reloc.c"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// Default number of timed rounds of each benchmark.
+#define DEFAULT_ROUNDS 15
+// Number of addresses translated per round.
+#define ADDRS_LEN      4096
+// Number of symbols in the built-in library.
+#define BUILTIN_SYMS   256
+// Number of times the initialisation order is sorted per round.
+#define SORTS          64
+// Maximum length of a symbol name.
+#define NAME_CAP       64
+
+// Micro-benchmark.
+typedef struct {
+    // Name of the benchmark.
+    char const *name;
+    // Run one round and return the number of operations performed.
+    size_t (*run)();
+} micro_t;
+
+// Address to translate in each address space.
+typedef struct {
+    // Instance the address belongs to.
+    kbelf_inst  inst;
+    // Address requested by the ELF file.
+    kbelf_addr  vaddr_req;
+    // Address it was loaded at.
+    kbelf_addr  vaddr_real;
+    // Address it can be accessed at by the loader.
+    kbelf_laddr laddr;
+} addr_t;
+
+// Process image the benchmarks run on.
+static kbelf_dyn         dyn;
+// Relocation context with the executable and libraries of the process image in load order.
+static kbelf_reloc       reloc_libs;
+// Relocation context with only the built-in library.
+static kbelf_reloc       reloc_builtin;
+// Addresses to translate.
+static addr_t            addrs[ADDRS_LEN];
+// Names of the symbols defined by the executable and libraries.
+static char            **lib_names;
+// Number of names in `lib_names`.
+static size_t            lib_names_len;
+// Copies of `lib_names` at different addresses for comparing strings.
+static char            **lib_names_copy;
+// Names of the symbols in the built-in library.
+static char              builtin_sym_names[BUILTIN_SYMS][NAME_CAP];
+// Symbols of the built-in library.
+static kbelf_builtin_sym builtin_syms[BUILTIN_SYMS];
+// Built-in library looked up by `find_sym`.
+static kbelf_builtin_lib builtin_lib = {
+    .path        = "libbuiltin.so",
+    .symbols_len = BUILTIN_SYMS,
+    .symbols     = builtin_syms,
+};
+// Sink for results so the calls are not optimised out.
+static size_t volatile sink;
+// File descriptor of the cache miss counter, or -1 if unavailable.
+static int             perf_fd = -1;
+
+// Get the current time in nanoseconds.
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+
+/* ==== Cache miss counter ==== */
+
+// Open the cache miss counter of this thread; it stays unavailable if the kernel or CPU does not provide one.
+static void perf_open() {
+#ifdef __linux__
+    struct perf_event_attr attr = {0};
+    attr.type                   = PERF_TYPE_HARDWARE;
+    attr.size                   = sizeof(attr);
+    attr.config                 = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled               = 1;
+    attr.exclude_kernel         = 1;
+    attr.exclude_hv             = 1;
+    perf_fd                     = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+// Reset and start the cache miss counter.
+static void perf_start() {
+#ifdef __linux__
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+// Stop the cache miss counter and read it.
+// Returns the number of cache misses, or -1 if unavailable.
+static long long perf_stop() {
+#ifdef __linux__
+    long long count;
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(perf_fd, &count, sizeof(count)) == sizeof(count))
+            return count;
+    }
+#endif
+    return -1;
+}
+
+
+
+/* ==== Fixture ==== */
+
+// Pick the addresses to translate, spread evenly over the segments of all instances.
+static void setup_addrs() {
+    size_t segs_total = 0;
+    for (size_t i = 0; i < reloc_libs->libs_len; i++) {
+        segs_total += reloc_libs->libs_inst[i]->segments_len;
+    }
+    srand(1);
+    for (size_t i = 0; i < ADDRS_LEN; i++) {
+        size_t seg = (size_t)rand() % segs_total;
+        size_t lib = 0;
+        while (seg >= reloc_libs->libs_inst[lib]->segments_len) {
+            seg -= reloc_libs->libs_inst[lib++]->segments_len;
+        }
+        kbelf_inst           inst = reloc_libs->libs_inst[lib];
+        kbelf_segment const *s    = &inst->segments[seg];
+        size_t               off  = s->size ? (size_t)rand() % s->size : 0;
+        addrs[i].inst             = inst;
+        addrs[i].vaddr_req        = s->vaddr_req + off;
+        addrs[i].vaddr_real       = s->vaddr_real + off;
+        addrs[i].laddr            = s->laddr + off;
+    }
+}
+
+// Collect the names of the symbols defined by all instances.
+// Returns success status.
+static bool setup_names() {
+    size_t cap = 0;
+    for (size_t i = 0; i < reloc_libs->libs_len; i++) {
+        cap += reloc_libs->libs_inst[i]->dynsym_len;
+    }
+    lib_names      = calloc(cap ? cap : 1, sizeof(char *));
+    lib_names_copy = calloc(cap ? cap : 1, sizeof(char *));
+    if (!lib_names || !lib_names_copy)
+        return false;
+    for (size_t i = 0; i < reloc_libs->libs_len; i++) {
+        kbelf_inst inst = reloc_libs->libs_inst[i];
+        for (size_t y = 1; y < inst->dynsym_len; y++) {
+            kbelf_symentry sym;
+            kbelfx_copy_from_user(inst, &sym, inst->dynsym + y * sizeof(kbelf_symentry), sizeof(kbelf_symentry));
+            if (!sym.section || KBELF_ST_BIND(sym.info) == STB_LOCAL)
+                continue;
+            char const *name              = (char const *)(inst->dynstr + sym.name_index);
+            lib_names[lib_names_len]      = strdup(name);
+            lib_names_copy[lib_names_len] = strdup(name);
+            lib_names_len++;
+        }
+    }
+    return true;
+}
+
+// Load the fixture in the current directory and prepare the data the benchmarks use.
+// Returns success status.
+static bool setup() {
+    dyn = kbelf_dyn_create(0);
+    if (!dyn || !kbelf_dyn_set_exec(dyn, "main", NULL) || !kbelf_dyn_load(dyn))
+        return false;
+
+    // Same lookup order as `kbelf_dyn_load`: the executable, then the libraries.
+    for (size_t i = 0; i < BUILTIN_SYMS; i++) {
+        snprintf(builtin_sym_names[i], NAME_CAP, "builtin_f%zu", i);
+        builtin_syms[i] = (kbelf_builtin_sym){.name = builtin_sym_names[i], .vaddr = 0x1000 + 16 * i};
+    }
+    reloc_builtin = kbelf_reloc_create();
+    reloc_libs    = kbelf_reloc_create();
+    if (!reloc_builtin || !reloc_libs || !kbelf_reloc_add_builtin(reloc_builtin, &builtin_lib)
+        || !kbelf_reloc_add(reloc_libs, dyn->exec_file, dyn->exec_inst))
+        return false;
+    for (size_t i = 0; i < dyn->libs_len; i++) {
+        if (!kbelf_reloc_add(reloc_libs, dyn->libs_file[i], dyn->libs_inst[i]))
+            return false;
+    }
+
+    setup_addrs();
+    return setup_names();
+}
+
+
+
+/* ==== Benchmarks ==== */
+
+// Translate virtual addresses as requested by the ELF file to load addresses.
+static size_t run_getladdr() {
+    size_t acc = 0;
+    for (size_t i = 0; i < ADDRS_LEN; i++) {
+        acc += kbelf_inst_getladdr(addrs[i].inst, addrs[i].vaddr_req);
+    }
+    sink = acc;
+    return ADDRS_LEN;
+}
+
+// Translate virtual addresses as loaded to load addresses.
+static size_t run_vaddr_to_laddr() {
+    size_t acc = 0;
+    for (size_t i = 0; i < ADDRS_LEN; i++) {
+        acc += kbelf_inst_vaddr_to_laddr(addrs[i].inst, addrs[i].vaddr_real);
+    }
+    sink = acc;
+    return ADDRS_LEN;
+}
+
+// Translate load addresses to virtual addresses as loaded.
+static size_t run_laddr_to_vaddr() {
+    size_t acc = 0;
+    for (size_t i = 0; i < ADDRS_LEN; i++) {
+        acc += kbelf_inst_laddr_to_vaddr(addrs[i].inst, addrs[i].laddr);
+    }
+    sink = acc;
+    return ADDRS_LEN;
+}
+
+// Look up every symbol of the built-in library.
+static size_t run_find_sym_builtin() {
+    size_t acc = 0;
+    for (size_t i = 0; i < BUILTIN_SYMS; i++) {
+        kbelf_addr val;
+        kbelf_inst def;
+        acc += find_sym(reloc_builtin, builtin_sym_names[i], &val, &def) ? val : 0;
+    }
+    sink = acc;
+    return BUILTIN_SYMS;
+}
+
+// Look up every symbol defined by the executable and libraries.
+static size_t run_find_sym_libs() {
+    size_t acc = 0;
+    for (size_t i = 0; i < lib_names_len; i++) {
+        kbelf_addr val;
+        kbelf_inst def;
+        acc += find_sym(reloc_libs, lib_names[i], &val, &def) ? val : 0;
+    }
+    sink = acc;
+    return lib_names_len;
+}
+
+// Apply the RELA and JMPREL tables of every instance again.
+static size_t run_rela_perform() {
+    size_t count = 0;
+    for (size_t i = 0; i < reloc_libs->libs_len; i++) {
+        kbelf_file           file = reloc_libs->libs_file[i];
+        kbelf_inst           inst = reloc_libs->libs_inst[i];
+        kbelf_dyninfo const *info = &inst->dyninfo;
+        if (info->rela.size && info->rela.vaddr) {
+            size_t len = info->rela.size / sizeof(kbelf_relaentry);
+            rela_perform(reloc_libs, file, inst, len, kbelf_inst_getladdr(inst, info->rela.vaddr));
+            count += len;
+        }
+        bool in_rela = info->jmprel.vaddr >= info->rela.vaddr
+                       && info->jmprel.vaddr + info->jmprel.size <= info->rela.vaddr + info->rela.size;
+        if (info->jmprel.size && info->jmprel.vaddr && !in_rela && info->jmprel.ent != sizeof(kbelf_relentry)) {
+            size_t len = info->jmprel.size / sizeof(kbelf_relaentry);
+            rela_perform(reloc_libs, file, inst, len, kbelf_inst_getladdr(inst, info->jmprel.vaddr));
+            count += len;
+        }
+    }
+    return count;
+}
+
+// Sort the initialisation order of the process image.
+static size_t run_sort_init_order() {
+    for (size_t i = 0; i < SORTS; i++) {
+        sort_init_order(dyn);
+    }
+    return SORTS;
+}
+
+// Measure the length of every symbol name.
+static size_t run_strlen() {
+    size_t acc = 0;
+    for (size_t i = 0; i < lib_names_len; i++) {
+        acc += kbelfq_strlen(lib_names[i]);
+    }
+    sink = acc;
+    return lib_names_len;
+}
+
+// Compare every symbol name to an equal copy, which compares the whole string.
+static size_t run_streq() {
+    size_t acc = 0;
+    for (size_t i = 0; i < lib_names_len; i++) {
+        acc += kbelfq_streq(lib_names[i], lib_names_copy[i]);
+    }
+    sink = acc;
+    return lib_names_len;
+}
+
+// Copy every symbol name into a buffer.
+static size_t run_strcpy() {
+    char buf[NAME_CAP * 4];
+    for (size_t i = 0; i < lib_names_len; i++) {
+        if (strlen(lib_names[i]) < sizeof(buf))
+            kbelfq_strcpy(buf, lib_names[i]);
+    }
+    sink = buf[0];
+    return lib_names_len;
+}
+
+// Copy symbol table entries, as the symbol lookup does for every candidate.
+static size_t run_memcpy() {
+    kbelf_symentry src[64] = {0};
+    kbelf_symentry dst;
+    size_t         acc     = 0;
+    for (size_t i = 0; i < ADDRS_LEN; i++) {
+        kbelfq_memcpy(&dst, &src[i % 64], sizeof(dst));
+        acc += dst.name_index;
+    }
+    sink = acc;
+    return ADDRS_LEN;
+}
+
+// Benchmarks in the order they are run.
+static micro_t const micros[] = {
+    {"getladdr", run_getladdr},
+    {"vaddr_to_laddr", run_vaddr_to_laddr},
+    {"laddr_to_vaddr", run_laddr_to_vaddr},
+    {"find_sym_builtin", run_find_sym_builtin},
+    {"find_sym_libs", run_find_sym_libs},
+    {"rela_perform", run_rela_perform},
+    {"sort_init_order", run_sort_init_order},
+    {"kbelfq_strlen", run_strlen},
+    {"kbelfq_streq", run_streq},
+    {"kbelfq_strcpy", run_strcpy},
+    {"kbelfq_memcpy", run_memcpy},
+};
+
+// Compare two doubles for `qsort`.
+static int cmp_double(void const *a, void const *b) {
+    double x = *(double const *)a;
+    double y = *(double const *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Run a benchmark a number of rounds and report the median time and the cache misses per operation.
+static void run_micro(micro_t const *micro, size_t rounds) {
+    double   *ns_per_op = calloc(rounds, sizeof(double));
+    long long misses    = 0;
+    size_t    ops_total = 0;
+    if (!ns_per_op)
+        return;
+
+    // Warm up, then measure.
+    micro->run();
+    for (size_t i = 0; i < rounds; i++) {
+        perf_start();
+        uint64_t start = now_ns();
+        size_t   ops   = micro->run();
+        uint64_t time  = now_ns() - start;
+        long long miss = perf_stop();
+        ns_per_op[i]   = ops ? (double)time / ops : 0;
+        ops_total     += ops;
+        misses         = miss < 0 || misses < 0 ? -1 : misses + miss;
+    }
+    qsort(ns_per_op, rounds, sizeof(double), cmp_double);
+
+    if (misses < 0 || !ops_total)
+        printf("  %-18s %10.1f %10zu %12s\n", micro->name, ns_per_op[rounds / 2], ops_total / rounds, "-");
+    else
+        printf(
+            "  %-18s %10.1f %10zu %12.3f\n",
+            micro->name,
+            ns_per_op[rounds / 2],
+            ops_total / rounds,
+            (double)misses / ops_total
+        );
+    free(ns_per_op);
+}
+
+// Show the usage of the micro-benchmarks.
+static void show_help(char const *arg0) {
+    printf("Usage: %s [-n rounds] [-f filter] [fixture]\n", arg0);
+    printf("  -n  Number of timed rounds of each benchmark, %d by default\n", DEFAULT_ROUNDS);
+    printf("  -f  Only run benchmarks whose name contains the filter\n");
+#ifdef KBELF_MICRO_FIXTURE
+    printf("Without a fixture, " KBELF_MICRO_FIXTURE " is loaded.\n");
+#endif
+}
+
+int main(int argc, char **argv) {
+    size_t      rounds  = DEFAULT_ROUNDS;
+    char const *filter  = NULL;
+    char const *fixture = NULL;
+#ifdef KBELF_MICRO_FIXTURE
+    fixture = KBELF_MICRO_FIXTURE;
+#endif
+
+    // Parse arguments.
+    for (int i = 1; i < argc; i++) {
+        char const *arg = argv[i];
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            show_help(argv[0]);
+            return 0;
+        } else if (!strcmp(arg, "-n") && i + 1 < argc) {
+            rounds = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(arg, "-f") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg[0] != '-') {
+            fixture = arg;
+        } else {
+            fprintf(stderr, "Invalid argument %s\n", arg);
+            return 1;
+        }
+    }
+    if (!fixture || !rounds) {
+        show_help(argv[0]);
+        return 1;
+    }
+
+    // Load the fixture.
+    if (chdir(fixture) || !setup()) {
+        fprintf(stderr, "Unable to load %s/main\n", fixture);
+        return 1;
+    }
+    perf_open();
+    printf("%s: %zu instances, %zu symbols, %zu rounds\n", fixture, reloc_libs->libs_len, lib_names_len, rounds);
+    if (perf_fd < 0)
+        printf("Cache miss counter unavailable\n");
+    printf("  %-18s %10s %10s %12s\n", "benchmark", "ns/op", "ops", "misses/op");
+
+    // Run the benchmarks.
+    for (size_t i = 0; i < sizeof(micros) / sizeof(micros[0]); i++) {
+        if (!filter || strstr(micros[i].name, filter))
+            run_micro(&micros[i], rounds);
+    }
+    return 0;
+}
@@ -0,0 +1,633 @@
+/*
+    MIT License
+
+    Copyright (c) 2025 Julian Scheffers
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Host tool that links a dynamic executable and its libraries at fixed addresses ahead of time.
+// Must be built with `KBELF_CROSS` and the target's `KBELF_MACHINE` and `KBELF_IS_ELF64`, see `kbelf_prelink` in
+// CMakeLists.txt. Writes a flat image that is copied to its load address as-is and a `kbelf_prelink_desc`.
+
+#define KBELF_REVEAL_PRIVATE
+#include <kbelf.h>
+#include <kbelf/prelink.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifndef KBELF_CROSS
+#error "kbelf_prelink must be built with KBELF_CROSS"
+#endif
+
+// Maximum number of library search directories.
+#define MAX_LIBDIRS   32
+// Maximum number of built-in libraries.
+#define MAX_BUILTINS  32
+// Maximum length of a line in the input files.
+#define MAX_LINE      1024
+
+// Fixed load address of a file.
+typedef struct {
+    // File name without directory.
+    char      *name;
+    // Virtual address of the lowest segment.
+    kbelf_addr addr;
+} placement_t;
+
+// Symbol address from the firmware's symbol map.
+typedef struct {
+    // Symbol name.
+    char      *name;
+    // Virtual address.
+    kbelf_addr addr;
+} mapsym_t;
+
+// Number of fixed load addresses.
+static size_t       placements_len;
+// Fixed load addresses from the memory map.
+static placement_t *placements;
+// Number of firmware symbols.
+static size_t       mapsyms_len;
+// Firmware symbols from the address map.
+static mapsym_t    *mapsyms;
+// Number of library search directories.
+static size_t       libdirs_len;
+// Library search directories.
+static char const  *libdirs[MAX_LIBDIRS];
+
+// Number of built-in libraries.
+size_t                   kbelfx_builtin_libs_len;
+// Built-in libraries from the symgen CSV files.
+kbelf_builtin_lib const *kbelfx_builtin_libs[MAX_BUILTINS];
+
+
+
+/* ==== KBELF hooks ==== */
+
+// Measure the length of `str`.
+size_t kbelfq_strlen(char const *str) {
+    return strlen(str);
+}
+
+// Copy string from `src` to `dst`.
+void kbelfq_strcpy(char *dst, char const *src) {
+    strcpy(dst, src);
+}
+
+// Find last occurrance of `c` in `str`.
+char const *kbelfq_strrchr(char const *str, char c) {
+    return strrchr(str, c);
+}
+
+// Compare string `a` to `b`.
+bool kbelfq_streq(char const *a, char const *b) {
+    return !strcmp(a, b);
+}
+
+// Copy memory from `src` to `dst`.
+void kbelfq_memcpy(void *dst, void const *src, size_t nmemb) {
+    memcpy(dst, src, nmemb);
+}
+
+// Fill memory `dst` with `c`.
+void kbelfq_memset(void *dst, uint8_t c, size_t nmemb) {
+    memset(dst, c, nmemb);
+}
+
+// Compare memory `a` to `b`.
+bool kbelfq_memeq(void const *a, void const *b, size_t nmemb) {
+    return !memcmp(a, b, nmemb);
+}
+
+// Memory allocator function to use for allocating metadata.
+void *kbelfx_malloc(size_t len) {
+    return malloc(len);
+}
+
+// Memory allocator function to use for allocating metadata.
+void *kbelfx_realloc(void *mem, size_t len) {
+    return realloc(mem, len);
+}
+
+// Memory allocator function to use for allocating metadata.
+void kbelfx_free(void *mem) {
+    free(mem);
+}
+
+// Find the fixed load address of a file.
+static placement_t const *find_placement(char const *name) {
+    for (size_t i = 0; i < placements_len; i++) {
+        if (!strcmp(placements[i].name, name))
+            return &placements[i];
+    }
+    return NULL;
+}
+
+// Place the segments of a file at its fixed address in the target and in a host buffer.
+bool kbelfx_seg_alloc(kbelf_inst inst, size_t segs_len, kbelf_segment *segs) {
+    if (!segs_len)
+        return false;
+
+    // Determine required size.
+    kbelf_addr addr_min = -1;
+    kbelf_addr addr_max = 0;
+    for (size_t i = 0; i < segs_len; i++) {
+        if (segs[i].vaddr_req < addr_min)
+            addr_min = segs[i].vaddr_req;
+        if (segs[i].vaddr_req + segs[i].size > addr_max)
+            addr_max = segs[i].vaddr_req + segs[i].size;
+    }
+
+    // Determine the load address.
+    kbelf_addr         base  = addr_min;
+    placement_t const *place = find_placement(inst->file->name);
+    if (place) {
+        if (!inst->is_pie && place->addr != addr_min) {
+            fprintf(stderr, "%s is not position-independent and cannot be moved\n", inst->file->path);
+            return false;
+        }
+        base = place->addr;
+    } else if (inst->is_pie) {
+        fprintf(stderr, "No address for %s in the memory map\n", inst->file->name);
+        return false;
+    }
+
+    // Allocate memory.
+    uint8_t *mem = calloc(1, addr_max - addr_min);
+    if (!mem)
+        return false;
+
+    // Compute segment addresses.
+    for (size_t i = 0; i < segs_len; i++) {
+        segs[i].alloc_cookie = NULL;
+        segs[i].laddr        = (kbelf_laddr)mem + segs[i].vaddr_req - addr_min;
+        segs[i].vaddr_real   = base + segs[i].vaddr_req - addr_min;
+        segs[i].paddr        = segs[i].vaddr_real;
+    }
+    segs[0].alloc_cookie = mem;
+
+    return true;
+}
+
+// Release the host buffer of the segments of a file.
+void kbelfx_seg_free(kbelf_inst inst, size_t segs_len, kbelf_segment *segs) {
+    (void)inst;
+    if (segs_len)
+        free(segs[0].alloc_cookie);
+}
+
+// Open a binary file for reading.
+void *kbelfx_open(char const *path) {
+    return fopen(path, "rb");
+}
+
+// Close a file.
+void kbelfx_close(void *fd) {
+    fclose(fd);
+}
+
+// Reads a number of bytes from a file.
+long kbelfx_read(void *fd, void *buf, long buf_len) {
+    return (long)fread(buf, 1, buf_len, fd);
+}
+
+// Reads a number of bytes from a file to a load address in the program.
+long kbelfx_load(kbelf_inst inst, void *fd, kbelf_laddr laddr, kbelf_laddr file_size, kbelf_laddr mem_size) {
+    (void)inst;
+    long len = (long)fread((void *)laddr, 1, file_size, fd);
+    memset((uint8_t *)laddr + file_size, 0, mem_size - file_size);
+    return len;
+}
+
+// Sets the absolute offset in the file.
+int kbelfx_seek(void *fd, long pos) {
+    return fseek(fd, pos, SEEK_SET) ? -1 : 0;
+}
+
+// Read bytes from a load address in the program.
+bool kbelfx_copy_from_user(kbelf_inst inst, void *buf, kbelf_laddr laddr, size_t len) {
+    (void)inst;
+    memcpy(buf, (void const *)laddr, len);
+    return true;
+}
+
+// Write bytes to a load address in the program.
+bool kbelfx_copy_to_user(kbelf_inst inst, kbelf_laddr laddr, void *buf, size_t len) {
+    (void)inst;
+    memcpy((void *)laddr, buf, len);
+    return true;
+}
+
+// Get string length from a load address in the program.
+ptrdiff_t kbelfx_strlen_from_user(kbelf_inst inst, kbelf_laddr laddr) {
+    (void)inst;
+    return (ptrdiff_t)strlen((char const *)laddr);
+}
+
+// Find and open a dynamic library file in the search directories.
+kbelf_file kbelfx_find_lib(char const *needed) {
+    char path[MAX_LINE];
+    for (size_t i = 0; i < libdirs_len; i++) {
+        snprintf(path, sizeof(path), "%s/%s", libdirs[i], needed);
+        FILE *fd = fopen(path, "rb");
+        if (fd)
+            return kbelf_file_open(path, fd);
+    }
+    return kbelf_file_open(needed, NULL);
+}
+
+
+
+/* ==== Input files ==== */
+
+// Remove trailing whitespace from a line.
+static void trim_line(char *line) {
+    size_t len = strlen(line);
+    while (len && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t')) {
+        line[--len] = 0;
+    }
+}
+
+// Read the memory map; each line is a file name and its load address.
+static bool read_memmap(char const *path) {
+    FILE *fd = fopen(path, "r");
+    if (!fd) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+    char line[MAX_LINE];
+    char name[MAX_LINE];
+    while (fgets(line, sizeof(line), fd)) {
+        trim_line(line);
+        unsigned long long addr;
+        if (!line[0] || line[0] == '#')
+            continue;
+        if (sscanf(line, "%1023s %llx", name, &addr) != 2) {
+            fprintf(stderr, "%s: Invalid line: %s\n", path, line);
+            fclose(fd);
+            return false;
+        }
+        placements                       = realloc(placements, (placements_len + 1) * sizeof(placement_t));
+        placements[placements_len].name  = strdup(name);
+        placements[placements_len].addr  = (kbelf_addr)addr;
+        placements_len++;
+    }
+    fclose(fd);
+    return true;
+}
+
+// Read the firmware's address map in `nm` format.
+static bool read_addrmap(char const *path) {
+    FILE *fd = fopen(path, "r");
+    if (!fd) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+    char line[MAX_LINE];
+    char name[MAX_LINE];
+    char type;
+    while (fgets(line, sizeof(line), fd)) {
+        trim_line(line);
+        unsigned long long addr;
+        if (sscanf(line, "%llx %c %1023s", &addr, &type, name) != 3)
+            continue;
+        mapsyms                     = realloc(mapsyms, (mapsyms_len + 1) * sizeof(mapsym_t));
+        mapsyms[mapsyms_len].name   = strdup(name);
+        mapsyms[mapsyms_len].addr   = (kbelf_addr)addr;
+        mapsyms_len++;
+    }
+    fclose(fd);
+    return true;
+}
+
+// Find a symbol in the firmware's address map.
+static mapsym_t const *find_mapsym(char const *name) {
+    for (size_t i = 0; i < mapsyms_len; i++) {
+        if (!strcmp(mapsyms[i].name, name))
+            return &mapsyms[i];
+    }
+    return NULL;
+}
+
+// Split a CSV line into at most `max` fields in place.
+// Returns the number of fields.
+static size_t split_csv(char *line, char **fields, size_t max) {
+    size_t count = 0;
+    char  *rd    = line;
+    while (count < max) {
+        char *wr      = rd;
+        fields[count] = wr;
+        bool quoted   = *rd == '"';
+        if (quoted)
+            rd++;
+        while (*rd) {
+            if (quoted && rd[0] == '"' && rd[1] == '"') {
+                *wr++  = '"';
+                rd    += 2;
+            } else if (quoted && *rd == '"') {
+                quoted = false;
+                rd++;
+            } else if (!quoted && *rd == ',') {
+                break;
+            } else {
+                *wr++ = *rd++;
+            }
+        }
+        count++;
+        if (!*rd) {
+            *wr = 0;
+            break;
+        }
+        *wr = 0;
+        rd++;
+    }
+    return count;
+}
+
+// Read a symgen CSV file describing the built-in library `lib_path`.
+// Application symbols are resolved to the address of their implementation in the address map.
+static bool read_symgen(char const *lib_path, char const *path) {
+    if (kbelfx_builtin_libs_len >= MAX_BUILTINS) {
+        fprintf(stderr, "Too many built-in libraries\n");
+        return false;
+    }
+    FILE *fd = fopen(path, "r");
+    if (!fd) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+
+    // Find the columns in the header.
+    char   line[MAX_LINE];
+    char  *fields[16];
+    size_t impl_col = SIZE_MAX, sym_col = SIZE_MAX;
+    if (fgets(line, sizeof(line), fd)) {
+        trim_line(line);
+        size_t count = split_csv(line, fields, 16);
+        for (size_t i = 0; i < count; i++) {
+            if (!strcasecmp(fields[i], "implementation"))
+                impl_col = i;
+            if (!strcasecmp(fields[i], "symbol"))
+                sym_col = i;
+        }
+    }
+    if (impl_col == SIZE_MAX || sym_col == SIZE_MAX) {
+        fprintf(stderr, "%s: Missing implementation or symbol column\n", path);
+        fclose(fd);
+        return false;
+    }
+
+    // Resolve the symbols.
+    kbelf_builtin_sym *symbols     = NULL;
+    size_t             symbols_len = 0;
+    while (fgets(line, sizeof(line), fd)) {
+        trim_line(line);
+        if (!line[0])
+            continue;
+        size_t count = split_csv(line, fields, 16);
+        if (count <= impl_col || count <= sym_col)
+            continue;
+        mapsym_t const *impl = find_mapsym(fields[impl_col]);
+        if (!impl) {
+            fprintf(stderr, "%s: No address for %s\n", path, fields[impl_col]);
+            fclose(fd);
+            return false;
+        }
+        symbols                          = realloc(symbols, (symbols_len + 1) * sizeof(kbelf_builtin_sym));
+        symbols[symbols_len].name        = strdup(fields[sym_col]);
+        symbols[symbols_len].vaddr       = impl->addr;
+        symbols_len++;
+    }
+    fclose(fd);
+
+    kbelf_builtin_lib *lib = calloc(1, sizeof(kbelf_builtin_lib));
+    lib->path              = strdup(lib_path);
+    lib->symbols_len       = symbols_len;
+    lib->symbols           = symbols;
+    kbelfx_builtin_libs[kbelfx_builtin_libs_len++] = lib;
+    return true;
+}
+
+
+
+/* ==== Output files ==== */
+
+// Copy the segments of an instance into the flat image.
+static void copy_segments(kbelf_inst inst, uint8_t *image, kbelf_addr load_addr) {
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        kbelf_segment const *seg = &inst->segments[i];
+        memcpy(image + (seg->vaddr_real - load_addr), (void const *)seg->laddr, seg->size);
+    }
+}
+
+// Find the address range covered by an instance.
+static void addr_range(kbelf_inst inst, kbelf_addr *lo, kbelf_addr *hi) {
+    for (size_t i = 0; i < inst->segments_len; i++) {
+        kbelf_segment const *seg = &inst->segments[i];
+        if (seg->vaddr_real < *lo)
+            *lo = seg->vaddr_real;
+        if (seg->vaddr_real + seg->size > *hi)
+            *hi = seg->vaddr_real + seg->size;
+    }
+}
+
+// Check whether two instances overlap.
+static bool overlaps(kbelf_inst a, kbelf_inst b) {
+    for (size_t i = 0; i < a->segments_len; i++) {
+        for (size_t j = 0; j < b->segments_len; j++) {
+            kbelf_segment const *sa = &a->segments[i];
+            kbelf_segment const *sb = &b->segments[j];
+            if (sa->vaddr_real < sb->vaddr_real + sb->size && sb->vaddr_real < sa->vaddr_real + sa->size)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Get an instance of a process image by index; the executable comes first.
+static kbelf_inst get_inst(kbelf_dyn dyn, size_t index) {
+    return index ? dyn->libs_inst[index - 1] : dyn->exec_inst;
+}
+
+// Write the flat image and its descriptor.
+static bool write_output(kbelf_dyn dyn, char const *image_path, char const *desc_path) {
+    size_t     insts_len = dyn->libs_len + 1;
+    kbelf_addr lo = -1, hi = 0;
+    for (size_t i = 0; i < insts_len; i++) {
+        addr_range(get_inst(dyn, i), &lo, &hi);
+        for (size_t j = 0; j < i; j++) {
+            if (overlaps(get_inst(dyn, i), get_inst(dyn, j))) {
+                fprintf(
+                    stderr,
+                    "%s overlaps %s\n",
+                    get_inst(dyn, i)->file->name,
+                    get_inst(dyn, j)->file->name
+                );
+                return false;
+            }
+        }
+    }
+
+    // Write the flat image.
+    uint8_t *image = calloc(1, hi - lo);
+    if (!image)
+        return false;
+    for (size_t i = 0; i < insts_len; i++) {
+        copy_segments(get_inst(dyn, i), image, lo);
+    }
+    FILE *fd = fopen(image_path, "wb");
+    if (!fd || fwrite(image, 1, hi - lo, fd) != hi - lo) {
+        fprintf(stderr, "Unable to write %s\n", image_path);
+        if (fd)
+            fclose(fd);
+        free(image);
+        return false;
+    }
+    fclose(fd);
+    free(image);
+
+    // Write the descriptor.
+    kbelf_prelink_desc desc = {
+        .magic       = KBELF_PRELINK_MAGIC,
+        .version     = KBELF_PRELINK_VERSION,
+        .load_addr   = lo,
+        .image_size  = hi - lo,
+        .entry       = kbelf_dyn_entrypoint(dyn),
+        .preinit_len = kbelf_dyn_preinit_len(dyn),
+        .init_len    = kbelf_dyn_init_len(dyn),
+        .fini_len    = kbelf_dyn_fini_len(dyn),
+    };
+    fd = fopen(desc_path, "wb");
+    if (!fd) {
+        fprintf(stderr, "Unable to write %s\n", desc_path);
+        return false;
+    }
+    bool ok = fwrite(&desc, sizeof(desc), 1, fd) == 1;
+    for (size_t i = 0; i < desc.preinit_len; i++) {
+        uint64_t addr  = kbelf_dyn_preinit_get(dyn, i);
+        ok            &= fwrite(&addr, sizeof(addr), 1, fd) == 1;
+    }
+    for (size_t i = 0; i < desc.init_len; i++) {
+        uint64_t addr  = kbelf_dyn_init_get(dyn, i);
+        ok            &= fwrite(&addr, sizeof(addr), 1, fd) == 1;
+    }
+    for (size_t i = 0; i < desc.fini_len; i++) {
+        uint64_t addr  = kbelf_dyn_fini_get(dyn, i);
+        ok            &= fwrite(&addr, sizeof(addr), 1, fd) == 1;
+    }
+    ok &= !fclose(fd);
+    if (!ok)
+        fprintf(stderr, "Unable to write %s\n", desc_path);
+    return ok;
+}
+
+
+
+// Show the usage.
+static void show_help(char const *argv0) {
+    printf("%s -m <memmap> -o <image> -d <descriptor> [options] <executable>\n", argv0);
+    printf("\n");
+    printf("Links a dynamic executable and its libraries at fixed addresses and writes a flat image\n");
+    printf("and a descriptor with the entrypoint and init/fini order.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("    -m <memmap>\n");
+    printf("        Memory map; each line is a file name and its load address in hexadecimal.\n");
+    printf("    -o <image>\n");
+    printf("        Flat image output file.\n");
+    printf("    -d <descriptor>\n");
+    printf("        Descriptor output file.\n");
+    printf("    -L <dir>\n");
+    printf("        Add a library search directory.\n");
+    printf("    -a <addrmap>\n");
+    printf("        Firmware symbol addresses in `nm` format.\n");
+    printf("    -b <library>=<csv>\n");
+    printf("        Built-in library described by a symgen.py CSV file; requires -a.\n");
+}
+
+int main(int argc, char **argv) {
+    char const *memmap_path = NULL;
+    char const *image_path  = NULL;
+    char const *desc_path   = NULL;
+    char const *exec_path   = NULL;
+    char const *builtins[MAX_BUILTINS];
+    size_t      builtins_len = 0;
+
+    // Parse arguments.
+    for (int i = 1; i < argc; i++) {
+        char const *arg = argv[i];
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            show_help(argv[0]);
+            return 0;
+        } else if (arg[0] == '-' && arg[1] && !arg[2] && i + 1 < argc) {
+            char const *val = argv[++i];
+            if (arg[1] == 'm') {
+                memmap_path = val;
+            } else if (arg[1] == 'o') {
+                image_path = val;
+            } else if (arg[1] == 'd') {
+                desc_path = val;
+            } else if (arg[1] == 'L' && libdirs_len < MAX_LIBDIRS) {
+                libdirs[libdirs_len++] = val;
+            } else if (arg[1] == 'a') {
+                if (!read_addrmap(val))
+                    return 1;
+            } else if (arg[1] == 'b' && builtins_len < MAX_BUILTINS && strchr(val, '=')) {
+                builtins[builtins_len++] = val;
+            } else {
+                fprintf(stderr, "Invalid option %s %s\n", arg, val);
+                return 1;
+            }
+        } else if (arg[0] != '-' && !exec_path) {
+            exec_path = arg;
+        } else {
+            fprintf(stderr, "Invalid argument %s\n", arg);
+            return 1;
+        }
+    }
+    if (!memmap_path || !image_path || !desc_path || !exec_path) {
+        show_help(argv[0]);
+        return 1;
+    }
+    if (!read_memmap(memmap_path))
+        return 1;
+    for (size_t i = 0; i < builtins_len; i++) {
+        char  *lib = strdup(builtins[i]);
+        char  *csv = strchr(lib, '=');
+        *csv++     = 0;
+        if (!read_symgen(lib, csv))
+            return 1;
+        free(lib);
+    }
+
+    // Link the process image.
+    kbelf_dyn dyn = kbelf_dyn_create(0);
+    if (!dyn || !kbelf_dyn_set_exec(dyn, exec_path, NULL) || !kbelf_dyn_load(dyn)) {
+        fprintf(stderr, "Unable to link %s\n", exec_path);
+        return 1;
+    }
+    bool ok = write_output(dyn, image_path, desc_path);
+    kbelf_dyn_unload(dyn);
+    kbelf_dyn_destroy(dyn);
+    return !ok;
+}